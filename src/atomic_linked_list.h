@@ -2,45 +2,114 @@
 #define ATOMIC_LINKED_LIST_H_
 
 #include <atomic>
+#include <cstring>
 #include <iostream>
+#include <type_traits>
+#include <utility>
+
+#include "epoch_manager.h"
+#include "key_traits.h"
+#include "node_pool.h"
+#include "table_stats.h"
 
 /**
  * A header file implementation for atomic linked list, used as an internal
- * data structure for chaining in the hash table
+ * data structure for chaining in the hash table.
+ *
+ * Nodes are kept sorted by an order key supplied by the caller (the
+ * split-order key of the lock-free hash table), so a traversal can start from
+ * any node in the list instead of only from the head. Nodes sharing an order
+ * key are kept in insertion order and told apart by key equality.
+ *
+ * Key-value nodes use odd order keys and are owned by the list. Sentinel nodes
+ * use even order keys, mark a position to start traversals from, and are
+ * owned by the caller; they are never deleted.
+ *
+ * Key-value nodes are allocated through `NodeAllocator` (see node_pool.h).
+ *
+ * Values that fit in a lock-free atomic word (ATOMIC_VALUES) can also be
+ * modified in place by Upsert, with an atomic read-modify-write on the value
+ * of the node; readers then load values atomically too. Upsert replaces the
+ * node of any other value instead, so those values never change once linked.
  */
 
-template <typename KeyType, typename ValueType>
+template <typename KeyType, typename ValueType,
+          typename NodeAllocator = PoolAllocator>
 class AtomicLinkedList {
  public:
   // Forward declaration
   struct MarkPtrType;
 
+  // Whether values are modified in place by Upsert, rather than replaced
+  static constexpr bool ATOMIC_VALUES =
+      std::is_trivially_copyable_v<ValueType> &&
+      (sizeof(ValueType) == 1 || sizeof(ValueType) == 2 ||
+       sizeof(ValueType) == 4 || sizeof(ValueType) == 8) &&
+      alignof(ValueType) == sizeof(ValueType);
+
+  /**
+   * Adds a delta to a value, saving the value it had. Upsert applies it with
+   * an atomic fetch-and-add to the integral values of existing nodes
+   */
+  struct AddValue {
+    ValueType delta_;    // the amount to add
+    ValueType *result_;  // receives the value before the addition
+
+    void operator()(ValueType &value, bool) const {
+      *result_ = value;
+      value += delta_;
+    }
+  };
+
   /**
    * Node object contains key-value pair and MarkPtr field
    */
   struct Node {
-    KeyType key_;      // the key of a node
-    ValueType value_;  // the value of a node
+    size_t order_key_;  // the position of a node in the list
+    KeyType key_;       // the key of a node
+    ValueType value_;   // the value of a node
     MarkPtrType
         ptr_{};  // a wrapper for the `next` pointer pointing to the next node
 
     /**
      * Constructs a Node instance
-     * @param key the key of an entry
-     * @param value the value of an entry
+     * @param order_key the order key of an entry
+     * @param key the key of an entry, moved in if an rvalue
+     * @param args the arguments of the value's constructor
      */
-    Node(const KeyType &key, const ValueType &value)
-        : key_(key), value_(value) {}
+    template <typename KeyArg, typename... Args>
+    Node(size_t order_key, KeyArg &&key, Args &&...args)
+        : order_key_(order_key),
+          key_(std::forward<KeyArg>(key)),
+          value_(std::forward<Args>(args)...) {}
+
+    /**
+     * Constructs a sentinel Node that only marks a position in the list
+     */
+    Node() : order_key_(0), key_(), value_() {}
   };
 
   /**
    * MarkPtrType is a wrapper for `next` field within each node of the linked
    * list. The MarkPtrType contains a `next` pointer pointing to the next node
    * and extra information
+   *
+   * By default the tag occupies a second 64-bit word and links are updated
+   * with a 128-bit CAS. Defining SINGLE_WORD_MARK_PTR packs the mark into bit
+   * 0 and a 16-bit tag into the unused top bits of the pointer, so a link is a
+   * single word updated with a 64-bit CAS. The shorter tag is enough because
+   * epoch-based reclamation already keeps a node from being reused while a
+   * thread may still compare against it.
    */
 
   class MarkPtrType {
    public:
+#ifdef SINGLE_WORD_MARK_PTR
+    using WordType = uint64_t;
+#else
+    using WordType = __int128_t;
+#endif
+
     MarkPtrType() = default;
 
     /**
@@ -51,9 +120,8 @@ class AtomicLinkedList {
      * @param tag a unique tag for this node
      */
     MarkPtrType(bool mark, Node *next, uint64_t tag) {
-      val |= tag;
-      val <<= 64;
-      val |= ((uint64_t)next) | (mark ? 1 : 0);
+      SetTag(tag);
+      SetMarkPtr(mark, next);
     }
 
     /**
@@ -76,14 +144,16 @@ class AtomicLinkedList {
      * Gets the pointer field
      * @return a pointer to the next node
      */
-    constexpr Node *GetNextPtr() const { return (Node *)(val & MASK); }
+    constexpr Node *GetNextPtr() const {
+      return (Node *)(static_cast<uint64_t>(val) & PTR_MASK);
+    }
 
     /**
      * Gets the tag field
      * @return the tag of the MarkPtrType object
      */
     constexpr uint64_t GetTag() const {
-      return static_cast<uint64_t>((val >> 64) & MASK);
+      return static_cast<uint64_t>(val >> TAG_SHIFT) & TAG_MASK;
     }
 
     /**
@@ -97,7 +167,7 @@ class AtomicLinkedList {
      * Gets the underlying value of the MarkPtrType
      * Used for compare-and-swap
      */
-    constexpr __int128_t GetValue() const { return val; }
+    constexpr WordType GetValue() const { return val; }
 
     /**
      * Sets the mark and `next` pointer field
@@ -106,6 +176,7 @@ class AtomicLinkedList {
      * @param next a pointer to the next node
      */
     void SetMarkPtr(bool mark, Node *next) {
+      val &= ~static_cast<WordType>(PTR_MASK | 0x1);
       val |= ((uint64_t)next) | (mark ? 1 : 0);
     }
 
@@ -114,15 +185,57 @@ class AtomicLinkedList {
      * @param tag the tag of the MarkPtrType object
      */
     void SetTag(uint64_t tag) {
-      __int128_t ctag = tag;
-      ctag <<= 64;
+      WordType ctag = tag & TAG_MASK;
+      ctag <<= TAG_SHIFT;
+      val &= ~(static_cast<WordType>(TAG_MASK) << TAG_SHIFT);
       val |= ctag;
     }
 
+    /**
+     * Reads a link that other threads may update concurrently
+     * @param ptr the link to read
+     * @return a copy of the link
+     */
+    static MarkPtrType Load(const MarkPtrType *ptr) {
+#ifdef SINGLE_WORD_MARK_PTR
+      MarkPtrType copy;
+      copy.val = __atomic_load_n(&ptr->val, __ATOMIC_ACQUIRE);
+      return copy;
+#else
+      // A torn read is caught by the validation in Find
+      return *ptr;
+#endif
+    }
+
+    /**
+     * Atomically replaces a link if it still holds an expected value
+     * @param ptr the link to update
+     * @param old_val the expected value of the link
+     * @param new_val the new value of the link
+     * @return true if the link was updated; otherwise, return false
+     */
+    static bool CompareAndSwap(MarkPtrType *ptr, const MarkPtrType &old_val,
+                               const MarkPtrType &new_val) {
+      return __sync_bool_compare_and_swap(&ptr->val, old_val.val, new_val.val);
+    }
+
    private:
-    __int128_t val{};  // underlying type for the pointer
-    // Mask for extracting lower-order 8 bytes
-    static const uint64_t MASK = 0xffffffffffffffff;
+#ifdef SINGLE_WORD_MARK_PTR
+    static_assert(sizeof(void *) == 8, "tagged pointers need 64-bit pointers");
+    // The tag lives in the top 16 bits, above the 48-bit virtual address
+    static constexpr int TAG_SHIFT = 48;
+    static constexpr uint64_t TAG_MASK = 0xffff;
+    // Mask for extracting the `next` pointer without the mark bit and tag
+    static constexpr uint64_t PTR_MASK = 0x0000fffffffffffe;
+#else
+    // The tag lives in the higher-order 8 bytes
+    static constexpr int TAG_SHIFT = 64;
+    static constexpr uint64_t TAG_MASK = 0xffffffffffffffff;
+    // Mask for extracting the `next` pointer without the mark bit
+    static constexpr uint64_t PTR_MASK = 0xfffffffffffffffe;
+#endif
+
+    WordType val{};  // underlying type for the pointer
   };
 
   /**
@@ -147,57 +260,171 @@ class AtomicLinkedList {
    * Destroys the AtomicLinked list instance
    */
   ~AtomicLinkedList() {
-    Deallocate(head);
+    Clear();
     delete head;
   }
 
+  /**
+   * Frees every key-value node and unlinks every sentinel. Must not run
+   * concurrently with any other operation
+   */
+  void Clear() {
+    Deallocate(head);
+    *head = MarkPtrType();
+  }
+
+  /**
+   * Gets the head of the linked list, the starting point of a traversal over
+   * the whole list
+   * @return a pointer to the `next` pointer wrapper of the head
+   */
+  MarkPtrType *GetHead() const { return head; }
+
   /**
    * Inserts a key-value pair into the linked list
+   * @param start the `next` pointer of a node preceding the key's position
+   * @param order_key the order key of the key
    * @param key the key to insert
    * @param value the value to insert
+   * @param[out] existing the value of the key if it is already in the list,
+   * if not nullptr
    * @return true if insertion is successful; otherwise, return false
    */
-  bool Insert(const KeyType &key, const ValueType &value) {
-    auto node = new Node(key, value);
+  bool Insert(MarkPtrType *start, size_t order_key, const KeyType &key,
+              const ValueType &value, ValueType *existing = nullptr) {
+    return Emplace(start, order_key, existing, key, value);
+  }
+
+  /**
+   * Inserts a key with a value constructed in place, if the key is not in the
+   * linked list. The node is only built once the key is known to be absent,
+   * but a concurrent insertion of the same key may still win; the node, with
+   * whatever was moved into it, is then discarded
+   * @param start the `next` pointer of a node preceding the key's position
+   * @param order_key the order key of the key
+   * @param[out] existing the value of the key if it is already in the list,
+   * if not nullptr
+   * @param key the key to insert, moved into the node if an rvalue
+   * @param args the arguments of the value's constructor
+   * @return true if insertion is successful; otherwise, return false
+   */
+  template <typename KeyArg, typename... Args>
+  bool Emplace(MarkPtrType *start, size_t order_key, ValueType *existing,
+               KeyArg &&key, Args &&...args) {
+    EpochManager::Guard guard;
     Snapshot snapshot; // a snapshot capturing a segment of the linked list
-    MarkPtrType *prev_ptr;
-    MarkPtrType prev;
+    Node *node = nullptr;
+    const KeyType *search_key = &key;  // the node's key once `key` moved
 
     while (true) {
-      if (Find(key, nullptr, &snapshot)) {
-        delete node;
+      if (Find(start, order_key, *search_key, existing, &snapshot)) {
+        if (node != nullptr) {
+          NodeAllocator::Delete(node);
+        }
         return false;
       }
-      prev_ptr = snapshot.prev_ptr;
-      prev = snapshot.prev;
-
-      // Set a new `next` pointer for the node we want to insert
-      node->ptr_.SetMarkPtr(0, prev.GetNextPtr());
+      // Only allocate once the key is known to be absent, and reuse the node
+      // across retries
+      if (node == nullptr) {
+        node = NodeAllocator::template New<Node>(
+            order_key, std::forward<KeyArg>(key), std::forward<Args>(args)...);
+        search_key = &node->key_;
+      }
+      if (LinkNode(snapshot, node)) {
+        return true;
+      }
+      stats_.Add(StatsCounters::CAS_FAILURES);
+    }
+  }
 
-      MarkPtrType old_val(0, prev.GetNextPtr(), prev.GetTag());
-      MarkPtrType new_val(0, node, prev.GetTag() + 1);
+  /**
+   * Writes the value of a key, inserting the key first if asked to. The
+   * value of an existing node is replaced in place with a compare-and-swap
+   * for ATOMIC_VALUES, skipping the store if `fn` leaves it unchanged; an
+   * update racing with a Delete of the same key may then land on the removed
+   * node and be lost. Any other value is modified on a copy in a new node
+   * that replaces the old one (see ReplaceNode). Either way `fn` may run
+   * several times on copies of the value
+   * @param start the `next` pointer of a node preceding the key's position
+   * @param order_key the order key of the key
+   * @param key the key to write
+   * @param insert whether to insert the key, with a value-initialized value,
+   * if it is not in the list
+   * @param fn called as fn(value, found) with a reference to the value of the
+   * key and whether it was in the list; not called if the key is absent and
+   * not inserted
+   * @return true if the key was in the list; otherwise, false
+   */
+  template <typename Fn>
+  bool Upsert(MarkPtrType *start, size_t order_key, const KeyType &key,
+              bool insert, Fn fn) {
+    EpochManager::Guard guard;
+    Snapshot snapshot;
+    Node *node = nullptr;
 
-      // Insertion is successful if the previous node is intact
-      if (__sync_bool_compare_and_swap((__int128_t *)prev_ptr,
-                                       old_val.GetValue(), new_val.GetValue())) {
-        return true;
+    while (true) {
+      if (Find(start, order_key, key, nullptr, &snapshot)) {
+        bool modified;
+        if constexpr (ATOMIC_VALUES) {
+          modified = ModifyValue(snapshot.prev.GetNextPtr(), fn);
+        } else {
+          modified = ReplaceNode(snapshot, fn);
+        }
+        if (modified) {
+          if (node != nullptr) {
+            NodeAllocator::Delete(node);
+          }
+          return true;
+        }
+        // The node was deleted or replaced meanwhile; Find unlinks it on the
+        // next try
+        continue;
+      }
+      if (!insert) {
+        return false;
+      }
+      // The node is not visible until it is linked, so `fn` writes it as is
+      if (node == nullptr) {
+        node = NodeAllocator::template New<Node>(order_key, key, ValueType{});
+        fn(node->value_, false);
+      }
+      if (LinkNode(snapshot, node)) {
+        return false;
       }
+      stats_.Add(StatsCounters::CAS_FAILURES);
     }
   }
 
+  /**
+   * Links a sentinel node into the list, unless a sentinel with the same
+   * order key is already linked
+   * @param start the `next` pointer of a node preceding the sentinel's
+   * position
+   * @param sentinel the sentinel to link, with its order key already set
+   * @return the sentinel in the list: `sentinel`, or the one linked before
+   */
+  Node *InsertSentinel(MarkPtrType *start, Node *sentinel) {
+    EpochManager::Guard guard;
+    return InsertNode(start, sentinel);
+  }
+
   /**
    * Deletes a key from the linked list
+   * @param start the `next` pointer of a node preceding the key's position
+   * @param order_key the order key of the key
    * @param key the key to delete
    * @return true if deletion is successful and false if the key is not found
    */
-  bool Delete(const KeyType &key) {
+  template <typename LookupKey>
+  bool Delete(MarkPtrType *start, size_t order_key, const LookupKey &key) {
+    EpochManager::Guard guard;
     Snapshot snapshot;
     MarkPtrType *prev_ptr;
     MarkPtrType prev;
     MarkPtrType cur;
 
     while (true) {
-      if (!Find(key, nullptr, &snapshot)) {
+      if (!Find(start, order_key, key, nullptr, &snapshot)) {
         return false;
       }
       prev_ptr = snapshot.prev_ptr;
@@ -207,8 +434,9 @@ class AtomicLinkedList {
       MarkPtrType old_val(0, cur.GetNextPtr(), cur.GetTag());
       MarkPtrType new_val(1, cur.GetNextPtr(), cur.GetTag() + 1);
       // Try to mark the node we want to delete as deleted (1 is for deleted)
-      if (!__sync_bool_compare_and_swap((__int128_t *)&prev.GetNextPtr()->ptr_,
-                                        old_val.GetValue(), new_val.GetValue())) {
+      if (!MarkPtrType::CompareAndSwap(&prev.GetNextPtr()->ptr_, old_val,
+                                       new_val)) {
+        stats_.Add(StatsCounters::CAS_FAILURES);
         continue;
       }
 
@@ -216,11 +444,11 @@ class AtomicLinkedList {
       new_val = MarkPtrType(0, cur.GetNextPtr(), prev.GetTag() + 1);
 
       // Delete node if no threads change the previous node
-      if (__sync_bool_compare_and_swap((__int128_t *)prev_ptr,
-                                       old_val.GetValue(), new_val.GetValue())) {
+      if (MarkPtrType::CompareAndSwap(prev_ptr, old_val, new_val)) {
         DeleteNode(prev.GetNextPtr());
       } else {
-        Find(key, nullptr, &snapshot);
+        stats_.Add(StatsCounters::CAS_FAILURES);
+        Find(start, order_key, key, nullptr, &snapshot);
       }
       return true;
     }
@@ -228,16 +456,20 @@ class AtomicLinkedList {
 
   /**
    * Finds a node with a given key
+   * @param start the `next` pointer of a node preceding the key's position
+   * @param order_key the order key of the key
    * @param key the key to search
    * @param[out] value the value of that key
    * @param[out] snapshot the snapshot of the linked list
    * @return true if the key is found; otherwise, return false
    */
-  bool Find(const KeyType &key, ValueType *value = nullptr,
-            Snapshot *snapshot = nullptr) {
+  template <typename LookupKey>
+  bool Find(MarkPtrType *start, size_t order_key, const LookupKey &key,
+            ValueType *value = nullptr, Snapshot *snapshot = nullptr) {
+    EpochManager::Guard guard;
   try_again:
-    MarkPtrType *prev_ptr = head;
-    MarkPtrType prev = *prev_ptr;
+    MarkPtrType *prev_ptr = start;
+    MarkPtrType prev = MarkPtrType::Load(prev_ptr);
     MarkPtrType cur;
     while (true) {
       if (prev.GetNextPtr() == nullptr) {
@@ -249,23 +481,30 @@ class AtomicLinkedList {
         }
         return false;
       }
-      cur = prev.GetNextPtr()->ptr_;
-      KeyType ckey = prev.GetNextPtr()->key_;
-      if (*prev_ptr != MarkPtrType(0, prev.GetNextPtr(), prev.GetTag())) {
+      cur = MarkPtrType::Load(&prev.GetNextPtr()->ptr_);
+      size_t corder_key = prev.GetNextPtr()->order_key_;
+      if (MarkPtrType::Load(prev_ptr) !=
+          MarkPtrType(0, prev.GetNextPtr(), prev.GetTag())) {
+        stats_.Add(StatsCounters::FIND_RESTARTS);
         goto try_again;
       }
       if (!cur.GetMark()) {
-        if (ckey >= key) {
+        // The key of a node never changes once it is linked, and the epoch
+        // keeps the node alive, so it is compared in place and only when the
+        // order keys match
+        bool found = corder_key == order_key &&
+                     KeyEqual<KeyType>{}(prev.GetNextPtr()->key_, key);
+        if (corder_key > order_key || found) {
           // An ordered is maintained in the linked list
-          if (ckey == key && value != nullptr) {
-            *value = prev.GetNextPtr()->value_;
+          if (found && value != nullptr) {
+            *value = LoadValue(prev.GetNextPtr());
           }
           if (snapshot != nullptr) {
             snapshot->prev_ptr = prev_ptr;
             snapshot->prev = prev;
             snapshot->cur = cur;
           }
-          return ckey == key;
+          return found;
         }
         // Move the pointer pointing the next node
         prev_ptr = &(prev.GetNextPtr()->ptr_);
@@ -274,11 +513,12 @@ class AtomicLinkedList {
         MarkPtrType old_val(0, prev.GetNextPtr(), prev.GetTag());
         MarkPtrType new_val(0, cur.GetNextPtr(), prev.GetTag() + 1);
 
-        if (__sync_bool_compare_and_swap(
-                (__int128_t *)prev_ptr, old_val.GetValue(), new_val.GetValue())) {
+        if (MarkPtrType::CompareAndSwap(prev_ptr, old_val, new_val)) {
           DeleteNode(prev.GetNextPtr());
           cur.SetTag(prev.GetTag() + 1);
         } else {
+          stats_.Add(StatsCounters::CAS_FAILURES);
+          stats_.Add(StatsCounters::FIND_RESTARTS);
           goto try_again;
         }
       }
@@ -286,14 +526,47 @@ class AtomicLinkedList {
     }
   }
 
+  /**
+   * Calls a function on the value of a key in place. The epoch keeps the
+   * node alive until the function returns, even if the key is deleted
+   * meanwhile. ATOMIC_VALUES, which Upsert may modify in place, are passed as
+   * a copy instead
+   * @param start the `next` pointer of a node preceding the key's position
+   * @param order_key the order key of the key
+   * @param key the key to search
+   * @param fn called with a const reference to the value of that key
+   * @return true if the key is found; otherwise, return false
+   */
+  template <typename LookupKey, typename Fn>
+  bool Visit(MarkPtrType *start, size_t order_key, const LookupKey &key,
+             Fn &fn) {
+    EpochManager::Guard guard;
+    Snapshot snapshot;
+    if (!Find(start, order_key, key, nullptr, &snapshot)) {
+      return false;
+    }
+    const Node *node = snapshot.prev.GetNextPtr();
+    if constexpr (ATOMIC_VALUES) {
+      const ValueType value = LoadValue(node);
+      fn(value);
+    } else {
+      fn(node->value_);
+    }
+    return true;
+  }
+
   /**
    * Searchs the linked list for a key
+   * @param start the `next` pointer of a node preceding the key's position
+   * @param order_key the order key of the key
    * @param key the key to search
    * @return the value of that key
    */
-  ValueType Search(const KeyType &key) {
+  template <typename LookupKey>
+  ValueType Search(MarkPtrType *start, size_t order_key,
+                   const LookupKey &key) {
     ValueType value{};
-    Find(key, &value);
+    Find(start, order_key, key, &value);
     return value;
   }
 
@@ -310,25 +583,178 @@ class AtomicLinkedList {
   }
 
   /**
-   * Frees the memory occupied by a node
+   * Retires an unlinked node. The memory is freed by the epoch manager once
+   * no concurrent traversal can still be reading it
    * @param node the node to free
    */
-  void DeleteNode(Node *node) { delete node; }
+  void DeleteNode(Node *node) {
+    EpochManager::Instance().Retire(node, [](void *ptr) {
+      NodeAllocator::Delete(static_cast<Node *>(ptr));
+    });
+  }
 
   /**
-   * A subroutine for deallocating the whole linked list
-   * @param node the current node to free
+   * A subroutine for deallocating the key-value nodes of the whole linked list
+   * @param node the `next` pointer of the node to start freeing from
    */
   void Deallocate(MarkPtrType *node) {
-    if (node->GetNextPtr() == nullptr) {
-      return;
+    Node *next = node->GetNextPtr();
+    while (next != nullptr) {
+      Node *cur = next;
+      next = cur->ptr_.GetNextPtr();
+      if (IsSentinel(cur)) {
+        continue;
+      }
+      NodeAllocator::Delete(cur);
     }
-    Deallocate(&(node->GetNextPtr()->ptr_));
-    delete node->GetNextPtr();
   }
 
+  /**
+   * Checks whether a node is a sentinel
+   * @param node the node to check
+   * @return true if the node is a sentinel; otherwise, return false
+   */
+  static bool IsSentinel(const Node *node) { return !(node->order_key_ & 0x1); }
+
+  /**
+   * Gets the event counters of the list (CAS failures and restarted
+   * traversals), which the owning hash table also records its events into
+   * @return the counters of the list
+   */
+  StatsCounters &GetStatsCounters() { return stats_; }
+
  private:
+  /**
+   * Reads the value of a node, which Upsert may be modifying in place
+   * @param node the node to read
+   * @return a copy of the value
+   */
+  static ValueType LoadValue(const Node *node) {
+    if constexpr (ATOMIC_VALUES) {
+      ValueType value;
+      __atomic_load(&node->value_, &value, __ATOMIC_ACQUIRE);
+      return value;
+    } else {
+      return node->value_;
+    }
+  }
+
+  /**
+   * Atomically applies `fn` to the value of a linked node
+   * @param node the node to modify
+   * @param fn called as fn(value, true), see Upsert
+   * @return true if the value was modified; false if the node is deleted
+   */
+  template <typename Fn>
+  bool ModifyValue(Node *node, Fn &fn) {
+    if constexpr (std::is_same_v<Fn, AddValue> &&
+                  std::is_integral_v<ValueType>) {
+      if (MarkPtrType::Load(&node->ptr_).GetMark()) {
+        return false;
+      }
+      *fn.result_ =
+          __atomic_fetch_add(&node->value_, fn.delta_, __ATOMIC_ACQ_REL);
+      return true;
+    } else {
+      ValueType expected = LoadValue(node);
+      while (!MarkPtrType::Load(&node->ptr_).GetMark()) {
+        ValueType desired = expected;
+        fn(desired, true);
+        if (std::memcmp(&desired, &expected, sizeof(ValueType)) == 0 ||
+            __atomic_compare_exchange(&node->value_, &expected, &desired,
+                                      false, __ATOMIC_ACQ_REL,
+                                      __ATOMIC_ACQUIRE)) {
+          return true;
+        }
+        stats_.Add(StatsCounters::CAS_FAILURES);
+      }
+      return false;
+    }
+  }
+
+  /**
+   * Replaces a linked key-value node with a new node holding a modified copy
+   * of its value. Marking the old node deleted and pointing it at the new
+   * node is a single compare-and-swap, so the key never goes missing: a
+   * traversal that meets the marked node goes on to its replacement, and
+   * unlinks it like any deleted node
+   * @param snapshot the snapshot returned by Find for the node's key
+   * @param fn called as fn(value, true) on the copy, see Upsert
+   * @return true if the node was replaced; false if it was deleted, replaced
+   * or followed by a new node meanwhile
+   */
+  template <typename Fn>
+  bool ReplaceNode(const Snapshot &snapshot, Fn &fn) {
+    Node *old_node = snapshot.prev.GetNextPtr();
+    MarkPtrType cur = snapshot.cur;
+    Node *node = NodeAllocator::template New<Node>(
+        old_node->order_key_, old_node->key_, old_node->value_);
+    fn(node->value_, true);
+    node->ptr_.SetMarkPtr(0, cur.GetNextPtr());
+
+    MarkPtrType old_val(0, cur.GetNextPtr(), cur.GetTag());
+    MarkPtrType new_val(1, node, cur.GetTag() + 1);
+    if (!MarkPtrType::CompareAndSwap(&old_node->ptr_, old_val, new_val)) {
+      stats_.Add(StatsCounters::CAS_FAILURES);
+      NodeAllocator::Delete(node);
+      return false;
+    }
+
+    // Unlink the old node now, or leave it to the next traversal
+    old_val = MarkPtrType(0, old_node, snapshot.prev.GetTag());
+    new_val = MarkPtrType(0, node, snapshot.prev.GetTag() + 1);
+    if (MarkPtrType::CompareAndSwap(snapshot.prev_ptr, old_val, new_val)) {
+      DeleteNode(old_node);
+    } else {
+      stats_.Add(StatsCounters::CAS_FAILURES);
+    }
+    return true;
+  }
+
+  /**
+   * Links a node into the list unless a node with the same order key and key
+   * is already present
+   * @param start the `next` pointer of a node preceding the node's position
+   * @param node the node to insert
+   * @return `node` if it was linked; otherwise, the node already present
+   */
+  Node *InsertNode(MarkPtrType *start, Node *node) {
+    Snapshot snapshot; // a snapshot capturing a segment of the linked list
+
+    while (true) {
+      if (Find(start, node->order_key_, node->key_, nullptr, &snapshot)) {
+        return snapshot.prev.GetNextPtr();
+      }
+      if (LinkNode(snapshot, node)) {
+        return node;
+      }
+      stats_.Add(StatsCounters::CAS_FAILURES);
+    }
+  }
+
+  /**
+   * Tries to link a node at the position captured by a snapshot
+   * @param snapshot the snapshot returned by Find for the node's key
+   * @param node the node to link
+   * @return true if the node is linked; false if the list changed since the
+   * snapshot was taken
+   */
+  bool LinkNode(const Snapshot &snapshot, Node *node) {
+    MarkPtrType *prev_ptr = snapshot.prev_ptr;
+    MarkPtrType prev = snapshot.prev;
+
+    // Set a new `next` pointer for the node we want to insert
+    node->ptr_.SetMarkPtr(0, prev.GetNextPtr());
+
+    MarkPtrType old_val(0, prev.GetNextPtr(), prev.GetTag());
+    MarkPtrType new_val(0, node, prev.GetTag() + 1);
+
+    // Insertion is successful if the previous node is intact
+    return MarkPtrType::CompareAndSwap(prev_ptr, old_val, new_val);
+  }
+
   MarkPtrType *head; // the head of the linked list
+  StatsCounters stats_;  // event counters, empty without TABLE_STATS
 };
 
 #endif  // ATOMIC_LINKED_LIST_H_
\ No newline at end of file
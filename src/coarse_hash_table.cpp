@@ -1,19 +1,24 @@
 #include "coarse_hash_table.h"
 
-template <typename KeyType, typename ValueType>
-CoarseHashTable<KeyType, ValueType>::~CoarseHashTable() {
+template <typename KeyType, typename ValueType, typename IndexPolicy,
+          typename LockType>
+CoarseHashTable<KeyType, ValueType, IndexPolicy, LockType>::~CoarseHashTable() {
   lock_.WriteLock();
   delete[] table_;
   lock_.WriteUnlock();
 }
 
-template <typename KeyType, typename ValueType>
-ValueType CoarseHashTable<KeyType, ValueType>::Get(const KeyType &key) {
-  lock_.ReadLock();
-  size_t idx = KeyToIndex(key);
+template <typename KeyType, typename ValueType, typename IndexPolicy,
+          typename LockType>
+template <typename LookupKey, typename>
+ValueType CoarseHashTable<KeyType, ValueType, IndexPolicy, LockType>::Get(
+    const LookupKey &key) {
+  size_t hash = Hash(key);
+  stats_.ReadLock(lock_);
+  size_t idx = HashToIndex(hash);
   ValueType value{};
   for (const auto &entry : table_[idx]) {
-    if (entry.key_ == key) {
+    if (entry.MayMatch(hash) && KeyEqual<KeyType>{}(entry.key_, key)) {
       value = entry.value_;
       break;
     }
@@ -22,36 +27,135 @@ ValueType CoarseHashTable<KeyType, ValueType>::Get(const KeyType &key) {
   return value;
 }
 
-template <typename KeyType, typename ValueType>
-void CoarseHashTable<KeyType, ValueType>::Insert(const KeyType &key,
-                                                 const ValueType &value) {
-  lock_.WriteLock();
-  size_t idx = KeyToIndex(key);
-  for (auto &entry : table_[idx]) {
-    if (entry.key_ == key) {
-      entry.value_ = value;
-      lock_.WriteUnlock();
-      return;
+template <typename KeyType, typename ValueType, typename IndexPolicy,
+          typename LockType>
+template <typename LookupKey, typename>
+std::optional<ValueType>
+CoarseHashTable<KeyType, ValueType, IndexPolicy, LockType>::TryGet(
+    const LookupKey &key) {
+  std::optional<ValueType> value;
+  Find(key, [&value](const ValueType &found) { value = found; });
+  return value;
+}
+
+template <typename KeyType, typename ValueType, typename IndexPolicy,
+          typename LockType>
+template <typename LookupKey, typename Fn, typename>
+bool CoarseHashTable<KeyType, ValueType, IndexPolicy, LockType>::Find(
+    const LookupKey &key, Fn fn) {
+  size_t hash = Hash(key);
+  stats_.ReadLock(lock_);
+  size_t idx = HashToIndex(hash);
+  for (const auto &entry : table_[idx]) {
+    if (entry.MayMatch(hash) && KeyEqual<KeyType>{}(entry.key_, key)) {
+      fn(entry.value_);
+      lock_.ReadUnlock();
+      return true;
     }
   }
-  table_[idx].emplace_back(key, value);
-  ++size_;
+  lock_.ReadUnlock();
+  return false;
+}
 
-  if (size_ > max_load_factor_ * capacity_) {
-    lock_.WriteUnlock();
-    GrowHashTable();
-  } else {
-    lock_.WriteUnlock();
-  }
+template <typename KeyType, typename ValueType, typename IndexPolicy,
+          typename LockType>
+bool CoarseHashTable<KeyType, ValueType, IndexPolicy, LockType>::InsertOrAssign(
+    const KeyType &key, const ValueType &value) {
+  // A new entry is copy-constructed from the value
+  return !Upsert(
+      key, true,
+      [&value](ValueType &current, bool found) {
+        if (found) {
+          current = value;
+        }
+      },
+      value);
 }
 
-template <typename KeyType, typename ValueType>
-void CoarseHashTable<KeyType, ValueType>::Delete(const KeyType &key) {
-  lock_.WriteLock();
-  size_t idx = KeyToIndex(key);
+template <typename KeyType, typename ValueType, typename IndexPolicy,
+          typename LockType>
+bool CoarseHashTable<KeyType, ValueType, IndexPolicy, LockType>::InsertOrAssign(
+    KeyType key, ValueType &&value) {
+  return !Upsert(
+      std::move(key), true,
+      [&value](ValueType &current, bool found) {
+        if (found) {
+          current = std::move(value);
+        }
+      },
+      std::move(value));
+}
+
+template <typename KeyType, typename ValueType, typename IndexPolicy,
+          typename LockType>
+bool CoarseHashTable<KeyType, ValueType, IndexPolicy, LockType>::TryEmplace(
+    const KeyType &key, const ValueType &value, ValueType *existing) {
+  return !Upsert(
+      key, true,
+      [existing](ValueType &current, bool found) {
+        if (found && existing != nullptr) {
+          *existing = current;
+        }
+      },
+      value);
+}
+
+template <typename KeyType, typename ValueType, typename IndexPolicy,
+          typename LockType>
+bool CoarseHashTable<KeyType, ValueType, IndexPolicy, LockType>::TryEmplace(
+    KeyType key, ValueType &&value, ValueType *existing) {
+  return !Upsert(
+      std::move(key), true,
+      [existing](ValueType &current, bool found) {
+        if (found && existing != nullptr) {
+          *existing = current;
+        }
+      },
+      std::move(value));
+}
+
+template <typename KeyType, typename ValueType, typename IndexPolicy,
+          typename LockType>
+template <typename... Args>
+bool CoarseHashTable<KeyType, ValueType, IndexPolicy, LockType>::Emplace(
+    KeyType key, Args &&...args) {
+  return !Upsert(
+      std::move(key), true, [](ValueType &, bool) {},
+      std::forward<Args>(args)...);
+}
+
+template <typename KeyType, typename ValueType, typename IndexPolicy,
+          typename LockType>
+template <typename Fn>
+bool CoarseHashTable<KeyType, ValueType, IndexPolicy, LockType>::Update(
+    const KeyType &key, Fn fn) {
+  return Upsert(key, false, [&fn](ValueType &current, bool) { fn(current); });
+}
+
+template <typename KeyType, typename ValueType, typename IndexPolicy,
+          typename LockType>
+template <typename Fn>
+ValueType CoarseHashTable<KeyType, ValueType, IndexPolicy, LockType>::Compute(
+    const KeyType &key, Fn fn) {
+  ValueType result{};
+  Upsert(key, true, [&](ValueType &current, bool) {
+    fn(current);
+    result = current;
+  });
+  return result;
+}
+
+template <typename KeyType, typename ValueType, typename IndexPolicy,
+          typename LockType>
+template <typename LookupKey, typename>
+void CoarseHashTable<KeyType, ValueType, IndexPolicy, LockType>::Delete(
+    const LookupKey &key) {
+  size_t hash = Hash(key);
+  stats_.WriteLock(lock_);
+  size_t idx = HashToIndex(hash);
   std::vector<Entry> &list = table_[idx];
   for (auto it = list.begin(); it != list.end(); ++it) {
-    if (it->key_ == key) {
+    if (it->MayMatch(hash) && KeyEqual<KeyType>{}(it->key_, key)) {
       list.erase(it);
       --size_;
       break;
@@ -60,12 +164,16 @@ void CoarseHashTable<KeyType, ValueType>::Delete(const KeyType &key) {
   lock_.WriteUnlock();
 }
 
-template <typename KeyType, typename ValueType>
-bool CoarseHashTable<KeyType, ValueType>::Contains(const KeyType &key) {
-  lock_.ReadLock();
-  size_t idx = KeyToIndex(key);
+template <typename KeyType, typename ValueType, typename IndexPolicy,
+          typename LockType>
+template <typename LookupKey, typename>
+bool CoarseHashTable<KeyType, ValueType, IndexPolicy, LockType>::Contains(
+    const LookupKey &key) {
+  size_t hash = Hash(key);
+  stats_.ReadLock(lock_);
+  size_t idx = HashToIndex(hash);
   for (const auto &entry : table_[idx]) {
-    if (entry.key_ == key) {
+    if (entry.MayMatch(hash) && KeyEqual<KeyType>{}(entry.key_, key)) {
       lock_.ReadUnlock();
       return true;
     }
@@ -74,22 +182,80 @@ bool CoarseHashTable<KeyType, ValueType>::Contains(const KeyType &key) {
   return false;
 }
 
-template <typename KeyType, typename ValueType>
-void CoarseHashTable<KeyType, ValueType>::GrowHashTable() {
-  // Allocates a new hash table and copies all key-value pair from
+template <typename KeyType, typename ValueType, typename IndexPolicy,
+          typename LockType>
+template <typename KeyArg, typename Fn, typename... Args>
+bool CoarseHashTable<KeyType, ValueType, IndexPolicy, LockType>::Upsert(
+    KeyArg &&key, bool insert, Fn fn, Args &&...args) {
+  size_t hash = Hash(key);
+  stats_.WriteLock(lock_);
+  size_t idx = HashToIndex(hash);
+  for (auto &entry : table_[idx]) {
+    if (entry.MayMatch(hash) && KeyEqual<KeyType>{}(entry.key_, key)) {
+      fn(entry.value_, true);
+      lock_.WriteUnlock();
+      return true;
+    }
+  }
+  if (!insert) {
+    lock_.WriteUnlock();
+    return false;
+  }
+  // The key is only moved from once it is known to be absent
+  fn(table_[idx]
+         .emplace_back(hash, std::forward<KeyArg>(key),
+                       std::forward<Args>(args)...)
+         .value_,
+     false);
+  ++size_;
+
+  if (size_ > max_load_factor_ * capacity_) {
+    lock_.WriteUnlock();
+    GrowHashTable();
+  } else {
+    lock_.WriteUnlock();
+  }
+  return false;
+}
+
+template <typename KeyType, typename ValueType, typename IndexPolicy,
+          typename LockType>
+void CoarseHashTable<KeyType, ValueType, IndexPolicy,
+                     LockType>::GrowHashTable() {
+  // Allocates a new hash table and moves all key-value pair from
   // the old hash table
-  lock_.WriteLock();
+  stats_.WriteLock(lock_);
+  uint64_t start = StatsCounters::Now();
   size_t old_capacity = capacity_;
   capacity_ *= 2;
   auto new_table = new std::vector<Entry>[capacity_];
   for (size_t idx = 0; idx < old_capacity; ++idx) {
-    for (const auto &entry : table_[idx]) {
-      size_t new_idx = KeyToIndex(entry.key_);
-      new_table[new_idx].push_back(entry);
+    for (auto &entry : table_[idx]) {
+      // A cached hash spares hashing every key under the write lock
+      size_t new_idx = HashToIndex(entry.Hash(entry.key_));
+      new_table[new_idx].push_back(std::move(entry));
     }
   }
 
   delete[] table_;
   table_ = new_table;
+  stats_.AddResize(start);
   lock_.WriteUnlock();
+}
+
+template <typename KeyType, typename ValueType, typename IndexPolicy,
+          typename LockType>
+TableStats
+CoarseHashTable<KeyType, ValueType, IndexPolicy, LockType>::Stats() {
+  TableStats stats;
+  stats_.Collect(&stats);
+  lock_.ReadLock();
+  stats.size_ = size_;
+  stats.capacity_ = capacity_;
+  for (size_t idx = 0; idx < capacity_; ++idx) {
+    stats.max_chain_length_ =
+        std::max(stats.max_chain_length_, table_[idx].size());
+  }
+  lock_.ReadUnlock();
+  return stats;
 }
\ No newline at end of file
@@ -1,17 +1,32 @@
 #ifndef COARSE_HASH_TABLE_H_
 #define COARSE_HASH_TABLE_H_
 
+#include <algorithm>
+#include <optional>
+#include <utility>
 #include <vector>
 
+#include "index_policy.h"
+#include "key_traits.h"
 #include "rwlock.h"
+#include "table_stats.h"
 
 /**
- * Coarse-grained hash table with one global reader/writer lock
+ * Coarse-grained hash table with one global reader/writer lock.
+ *
+ * IndexPolicy maps a key's hash to a bucket: ModuloIndex keeps any capacity
+ * and indexes with a modulo, MaskIndex rounds the capacity up to a power of
+ * two and indexes with a mixed hash and a mask. LockType is the global lock:
+ * ReaderWriterLock, or BravoReaderWriterLock so that readers do not all write
+ * the same cache line.
  */
-template <typename KeyType, typename ValueType>
+template <typename KeyType, typename ValueType,
+          typename IndexPolicy = ModuloIndex,
+          typename LockType = ReaderWriterLock>
 class CoarseHashTable {
  private:
-  struct Entry {
+  // The hash of the key is stored in the entry if CacheKeyHash is set
+  struct Entry : CachedHash<KeyType> {
     KeyType key_{};
     ValueType value_{};
 
@@ -19,11 +34,15 @@ class CoarseHashTable {
 
     /**
      * Creates an Entry instance
-     * @param key the key of the entry
-     * @param value the value of the entry
+     * @param hash the hash of the key
+     * @param key the key of the entry, moved in if an rvalue
+     * @param args the arguments of the value's constructor
      */
-    Entry(const KeyType &key, const ValueType &value)
-        : key_(key), value_(value) {}
+    template <typename KeyArg, typename... Args>
+    Entry(size_t hash, KeyArg &&key, Args &&...args)
+        : CachedHash<KeyType>(hash),
+          key_(std::forward<KeyArg>(key)),
+          value_(std::forward<Args>(args)...) {}
   };
 
  public:
@@ -39,7 +58,7 @@ class CoarseHashTable {
    * elements per bucket)
    */
   CoarseHashTable(size_t capacity, float max_load_factor)
-      : capacity_(capacity),
+      : capacity_(IndexPolicy::RoundCapacity(capacity)),
         max_load_factor_(max_load_factor),
         table_(new std::vector<Entry>[capacity_]) {}
 
@@ -59,38 +78,220 @@ class CoarseHashTable {
    * @param key the key of the key-value pair
    * @return the value of that key
    */
-  ValueType Get(const KeyType &key);
+  ValueType Get(const KeyType &key) { return Get<KeyType>(key); }
+
+  /**
+   * Gets the value of a key-value pair by a key of another type (see KeyHash)
+   * @param key the key of the key-value pair
+   * @return the value of that key
+   */
+  template <typename LookupKey,
+            typename = EnableIfLookupKey<KeyType, LookupKey>>
+  ValueType Get(const LookupKey &key);
+
+  /**
+   * Gets the value of a key-value pair, if the key exists
+   * @param key the key of the key-value pair
+   * @return the value of that key, or std::nullopt if the key does not exist
+   */
+  std::optional<ValueType> TryGet(const KeyType &key) {
+    return TryGet<KeyType>(key);
+  }
+
+  /**
+   * Gets the value of a key-value pair by a key of another type (see
+   * KeyHash), if the key exists
+   * @param key the key of the key-value pair
+   * @return the value of that key, or std::nullopt if the key does not exist
+   */
+  template <typename LookupKey,
+            typename = EnableIfLookupKey<KeyType, LookupKey>>
+  std::optional<ValueType> TryGet(const LookupKey &key);
+
+  /**
+   * Calls a function on the value of a key-value pair
+   * @param key the key of the key-value pair
+   * @param fn called with a const reference to the value, in place under the
+   * read lock; it must not access the hash table
+   * @return true if the key exists; otherwise, false
+   */
+  template <typename Fn>
+  bool Find(const KeyType &key, Fn fn) {
+    return Find<KeyType, Fn>(key, fn);
+  }
+
+  /**
+   * Calls a function on the value of a key-value pair, found by a key of
+   * another type (see KeyHash)
+   * @param key the key of the key-value pair
+   * @param fn called with a const reference to the value, in place under the
+   * read lock; it must not access the hash table
+   * @return true if the key exists; otherwise, false
+   */
+  template <typename LookupKey, typename Fn,
+            typename = EnableIfLookupKey<KeyType, LookupKey>>
+  bool Find(const LookupKey &key, Fn fn);
 
   /**
    * Inserts a key-value pair into the hash table
    * @param key the key to insert
    * @param value the value to insert
    */
-  void Insert(const KeyType &key, const ValueType &value);
+  void Insert(const KeyType &key, const ValueType &value) {
+    InsertOrAssign(key, value);
+  }
+
+  /**
+   * Inserts a key-value pair into the hash table, moving the key and value in
+   * @param key the key to insert
+   * @param value the value to insert
+   */
+  void Insert(KeyType key, ValueType &&value) {
+    InsertOrAssign(std::move(key), std::move(value));
+  }
+
+  /**
+   * Inserts a key-value pair, or assigns the value if the key exists
+   * @param key the key to insert
+   * @param value the value to insert or assign
+   * @return true if the key was inserted; false if it existed
+   */
+  bool InsertOrAssign(const KeyType &key, const ValueType &value);
+
+  /**
+   * Inserts a key-value pair, or assigns the value if the key exists, moving
+   * the key and value in
+   * @param key the key to insert
+   * @param value the value to insert or assign
+   * @return true if the key was inserted; false if it existed
+   */
+  bool InsertOrAssign(KeyType key, ValueType &&value);
+
+  /**
+   * Inserts a key-value pair only if the key does not exist
+   * @param key the key to insert
+   * @param value the value to insert
+   * @param[out] existing the value of the key if it exists, if not nullptr
+   * @return true if the key was inserted; false if it existed
+   */
+  bool TryEmplace(const KeyType &key, const ValueType &value,
+                  ValueType *existing = nullptr);
+
+  /**
+   * Inserts a key-value pair only if the key does not exist, moving the key
+   * and value in. The value is left alone if the key exists
+   * @param key the key to insert
+   * @param value the value to insert
+   * @param[out] existing the value of the key if it exists, if not nullptr
+   * @return true if the key was inserted; false if it existed
+   */
+  bool TryEmplace(KeyType key, ValueType &&value,
+                  ValueType *existing = nullptr);
+
+  /**
+   * Inserts a key with a value constructed in place from some arguments,
+   * only if the key does not exist; the value is not constructed otherwise
+   * @param key the key to insert
+   * @param args the arguments of the value's constructor
+   * @return true if the key was inserted; false if it existed
+   */
+  template <typename... Args>
+  bool Emplace(KeyType key, Args &&...args);
+
+  /**
+   * Atomically modifies the value of a key if it exists
+   * @param key the key to update
+   * @param fn called with a reference to the value, under the write lock; it
+   * must not access the hash table
+   * @return true if the key exists; otherwise, false
+   */
+  template <typename Fn>
+  bool Update(const KeyType &key, Fn fn);
+
+  /**
+   * Atomically modifies the value of a key, inserting the key with a
+   * value-initialized value first if it does not exist
+   * @param key the key to update
+   * @param fn called with a reference to the value, under the write lock; it
+   * must not access the hash table
+   * @return the modified value
+   */
+  template <typename Fn>
+  ValueType Compute(const KeyType &key, Fn fn);
 
   /**
    * Deletes a key-value pair from the hash table
    * @param key the key to delete
    */
-  void Delete(const KeyType &key);
+  void Delete(const KeyType &key) { Delete<KeyType>(key); }
+
+  /**
+   * Deletes a key-value pair from the hash table by a key of another type
+   * (see KeyHash)
+   * @param key the key to delete
+   */
+  template <typename LookupKey,
+            typename = EnableIfLookupKey<KeyType, LookupKey>>
+  void Delete(const LookupKey &key);
 
   /**
    * Checks if a key exists in the hash table
    * @param key the key to check
    * @return true if that key exists; otherwise, false
    */
-  bool Contains(const KeyType &key);
+  bool Contains(const KeyType &key) { return Contains<KeyType>(key); }
+
+  /**
+   * Checks if a key exists in the hash table, by a key of another type
+   * (see KeyHash)
+   * @param key the key to check
+   * @return true if that key exists; otherwise, false
+   */
+  template <typename LookupKey,
+            typename = EnableIfLookupKey<KeyType, LookupKey>>
+  bool Contains(const LookupKey &key);
+
+  /**
+   * Gets the runtime statistics of the hash table (see TableStats)
+   * @return a snapshot of the statistics
+   */
+  TableStats Stats();
 
  private:
   /**
-   * Calculates the index into the hash table given a key
-   * @param key the key to calculate index from
+   * Calculates the hash of a key, before taking the lock
+   * @param key the key to hash
+   * @return the hash of that key
+   */
+  template <typename LookupKey>
+  static size_t Hash(const LookupKey &key) {
+    return KeyHash<KeyType>{}(key);
+  }
+
+  /**
+   * Calculates the index into the hash table given the hash of a key
+   * @param hash the hash to calculate index from
    * @return the index into the hash table
    */
-  size_t KeyToIndex(const KeyType &key) const {
-    return std::hash<KeyType>{}(key) % capacity_;
+  size_t HashToIndex(size_t hash) const {
+    return IndexPolicy::Index(hash, capacity_);
   }
 
+  /**
+   * Runs a write on the value of a key under the write lock. Every write
+   * operation goes through here, so the key is searched only once
+   * @param key the key to write, moved into a new entry if an rvalue
+   * @param insert whether to insert the key if it does not exist
+   * @param fn called as fn(value, found) with a reference to the value of the
+   * key and whether it existed; not called if the key is absent and not
+   * inserted
+   * @param args the arguments of the constructor of an inserted value (none
+   * to value-initialize it)
+   * @return true if the key existed; otherwise, false
+   */
+  template <typename KeyArg, typename Fn, typename... Args>
+  bool Upsert(KeyArg &&key, bool insert, Fn fn, Args &&...args);
+
   /**
    * Grows the hash table (doubles the number of buckets) when the hash table
    * gets dense
@@ -105,7 +306,8 @@ class CoarseHashTable {
   float max_load_factor_;
   size_t size_{0};   // current number of key-value pairs in the hash table
   std::vector<Entry> *table_;  // array of buckets
-  ReaderWriterLock lock_;      // global reader/writer lock
+  LockType lock_;              // global reader/writer lock
+  StatsCounters stats_;        // event counters, empty without TABLE_STATS
 };
 
 #include "coarse_hash_table.cpp"
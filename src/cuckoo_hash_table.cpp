@@ -0,0 +1,474 @@
+#include "cuckoo_hash_table.h"
+
+template <typename KeyType, typename ValueType>
+CuckooHashTable<KeyType, ValueType>::CuckooHashTable(size_t capacity,
+                                                     float max_load_factor)
+    : max_load_factor_(max_load_factor), stripes_(new Stripe[NUM_STRIPES]) {
+  size_t num_buckets = 1;
+  while (num_buckets * SLOTS_PER_BUCKET < capacity) {
+    num_buckets <<= 1;
+  }
+  table_ = new Table(num_buckets);
+}
+
+template <typename KeyType, typename ValueType>
+CuckooHashTable<KeyType, ValueType>::~CuckooHashTable() {
+  resize_lock_.WriteLock();
+  delete table_.load();
+  resize_lock_.WriteUnlock();
+  delete[] stripes_;
+}
+
+template <typename KeyType, typename ValueType>
+template <typename LookupKey, typename>
+ValueType CuckooHashTable<KeyType, ValueType>::Get(const LookupKey &key) {
+  // The epoch keeps a table replaced by Rebuild alive while we probe it
+  EpochManager::Guard guard;
+  ValueType value{};
+  FindOptimistic(table_.load(std::memory_order_acquire), Hash(key), key,
+                 &value);
+  return value;
+}
+
+template <typename KeyType, typename ValueType>
+template <typename LookupKey, typename>
+std::optional<ValueType> CuckooHashTable<KeyType, ValueType>::TryGet(
+    const LookupKey &key) {
+  EpochManager::Guard guard;
+  ValueType value{};
+  if (!FindOptimistic(table_.load(std::memory_order_acquire), Hash(key), key,
+                      &value)) {
+    return std::nullopt;
+  }
+  return value;
+}
+
+template <typename KeyType, typename ValueType>
+template <typename LookupKey, typename Fn, typename>
+bool CuckooHashTable<KeyType, ValueType>::Find(
+    const LookupKey &key, Fn fn) {
+  // Readers never lock, so the function gets a validated copy
+  std::optional<ValueType> value = TryGet<LookupKey>(key);
+  if (value.has_value()) {
+    fn(std::as_const(*value));
+  }
+  return value.has_value();
+}
+
+template <typename KeyType, typename ValueType>
+template <typename LookupKey, typename>
+bool CuckooHashTable<KeyType, ValueType>::Contains(const LookupKey &key) {
+  EpochManager::Guard guard;
+  return FindOptimistic(table_.load(std::memory_order_acquire), Hash(key),
+                        key, nullptr);
+}
+
+template <typename KeyType, typename ValueType>
+bool CuckooHashTable<KeyType, ValueType>::InsertOrAssign(
+    const KeyType &key, const ValueType &value) {
+  return !Upsert(key, true,
+                 [&value](ValueType &current, bool) { current = value; });
+}
+
+template <typename KeyType, typename ValueType>
+bool CuckooHashTable<KeyType, ValueType>::TryEmplace(
+    const KeyType &key, const ValueType &value, ValueType *existing) {
+  return !Upsert(key, true, [&](ValueType &current, bool found) {
+    if (!found) {
+      current = value;
+    } else if (existing != nullptr) {
+      *existing = current;
+    }
+  });
+}
+
+template <typename KeyType, typename ValueType>
+template <typename Fn>
+bool CuckooHashTable<KeyType, ValueType>::Update(
+    const KeyType &key, Fn fn) {
+  return Upsert(key, false, [&fn](ValueType &current, bool) { fn(current); });
+}
+
+template <typename KeyType, typename ValueType>
+template <typename Fn>
+ValueType CuckooHashTable<KeyType, ValueType>::Compute(
+    const KeyType &key, Fn fn) {
+  ValueType result{};
+  Upsert(key, true, [&](ValueType &current, bool) {
+    fn(current);
+    result = current;
+  });
+  return result;
+}
+
+template <typename KeyType, typename ValueType>
+template <typename Fn>
+bool CuckooHashTable<KeyType, ValueType>::Upsert(
+    const KeyType &key, bool insert, Fn fn) {
+  uint64_t hash = Hash(key);
+  while (true) {
+    stats_.ReadLock(resize_lock_);
+    Table *table = table_.load(std::memory_order_acquire);
+    WriteResult result = UpsertSlot(table, hash, key, insert, fn);
+    if (result == INSERTED) {
+      size_.Increment();
+    }
+    bool grow = result == NO_SLOT ||
+                (result == INSERTED &&
+                 size_.Exceeds(table->num_buckets_ * SLOTS_PER_BUCKET *
+                               max_load_factor_));
+    resize_lock_.ReadUnlock();
+
+    if (grow) {
+      Rebuild(table);
+    }
+    if (result == INSERTED || result == UPDATED || result == NOT_FOUND) {
+      return result == UPDATED;
+    }
+    if (result == RETRY) {
+      std::this_thread::yield();
+    }
+  }
+}
+
+template <typename KeyType, typename ValueType>
+template <typename LookupKey, typename>
+void CuckooHashTable<KeyType, ValueType>::Delete(const LookupKey &key) {
+  uint64_t hash = Hash(key);
+  stats_.ReadLock(resize_lock_);
+  WriteResult result =
+      DeleteSlot(table_.load(std::memory_order_acquire), hash, key);
+  resize_lock_.ReadUnlock();
+  if (result == UPDATED) {
+    size_.Decrement();
+  }
+}
+
+template <typename KeyType, typename ValueType>
+template <typename LookupKey>
+bool CuckooHashTable<KeyType, ValueType>::ScanBucket(const Bucket &bucket,
+                                                     const LookupKey &key,
+                                                     size_t *slot) {
+  for (size_t i = 0; i < SLOTS_PER_BUCKET; ++i) {
+    if (((bucket.occupied_ >> i) & 1) &&
+        KeyEqual<KeyType>{}(bucket.slots_[i].key_, key)) {
+      *slot = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+template <typename KeyType, typename ValueType>
+uint64_t CuckooHashTable<KeyType, ValueType>::ReadBegin(const Stripe &stripe) {
+  uint64_t version;
+  while ((version = stripe.version_.load(std::memory_order_acquire)) & 1) {
+    std::this_thread::yield();
+  }
+  return version;
+}
+
+template <typename KeyType, typename ValueType>
+bool CuckooHashTable<KeyType, ValueType>::ReadValidate(const Stripe &stripe,
+                                                       uint64_t version) {
+  // Orders the plain reads of the buckets before the second version read
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return stripe.version_.load(std::memory_order_relaxed) == version;
+}
+
+template <typename KeyType, typename ValueType>
+void CuckooHashTable<KeyType, ValueType>::LockStripe(Stripe &stripe) const {
+  bool waited = false;
+  uint64_t start = 0;
+  uint64_t version = stripe.version_.load(std::memory_order_relaxed);
+  while ((version & 1) ||
+         !stripe.version_.compare_exchange_weak(version, version + 1,
+                                                std::memory_order_acquire)) {
+    if (!waited) {
+      waited = true;
+      start = StatsCounters::Now();
+    }
+    std::this_thread::yield();
+    version = stripe.version_.load(std::memory_order_relaxed);
+  }
+  if (waited) {
+    stats_.AddLockWait(start);
+  }
+}
+
+template <typename KeyType, typename ValueType>
+void CuckooHashTable<KeyType, ValueType>::LockBuckets(size_t b1, size_t b2) {
+  Stripe *first = &GetStripe(b1);
+  Stripe *second = &GetStripe(b2);
+  if (first > second) {
+    std::swap(first, second);
+  }
+  LockStripe(*first);
+  if (second != first) {
+    LockStripe(*second);
+  }
+  // Keeps the writes to the buckets from becoming visible before the odd
+  // versions
+  std::atomic_thread_fence(std::memory_order_release);
+}
+
+template <typename KeyType, typename ValueType>
+void CuckooHashTable<KeyType, ValueType>::UnlockBuckets(size_t b1, size_t b2) {
+  Stripe &first = GetStripe(b1);
+  Stripe &second = GetStripe(b2);
+  first.version_.fetch_add(1, std::memory_order_release);
+  if (&second != &first) {
+    second.version_.fetch_add(1, std::memory_order_release);
+  }
+}
+
+template <typename KeyType, typename ValueType>
+template <typename LookupKey>
+bool CuckooHashTable<KeyType, ValueType>::FindOptimistic(
+    const Table *table, uint64_t hash, const LookupKey &key,
+    ValueType *value) const {
+  size_t b1 = PrimaryBucket(table, hash);
+  size_t b2 = AltBucket(table, b1, hash);
+  const Stripe &s1 = GetStripe(b1);
+  const Stripe &s2 = GetStripe(b2);
+  while (true) {
+    uint64_t v1 = ReadBegin(s1);
+    uint64_t v2 = ReadBegin(s2);
+    const Bucket *bucket = &table->buckets_[b1];
+    size_t slot;
+    bool found = ScanBucket(*bucket, key, &slot);
+    if (!found) {
+      bucket = &table->buckets_[b2];
+      found = ScanBucket(*bucket, key, &slot);
+    }
+    ValueType copy{};
+    if (found && value != nullptr) {
+      copy = bucket->slots_[slot].value_;
+    }
+    // Both stripes must be unchanged, or the key may have been moving
+    // between its buckets
+    if (!ReadValidate(s1, v1) || !ReadValidate(s2, v2)) {
+      stats_.Add(StatsCounters::READ_RETRIES);
+      continue;
+    }
+    if (found && value != nullptr) {
+      *value = copy;
+    }
+    return found;
+  }
+}
+
+template <typename KeyType, typename ValueType>
+template <typename Fn>
+typename CuckooHashTable<KeyType, ValueType>::WriteResult
+CuckooHashTable<KeyType, ValueType>::UpsertSlot(Table *table, uint64_t hash,
+                                                const KeyType &key,
+                                                bool insert, Fn &fn) {
+  size_t b1 = PrimaryBucket(table, hash);
+  size_t b2 = AltBucket(table, b1, hash);
+  LockBuckets(b1, b2);
+
+  size_t slot;
+  for (size_t idx : {b1, b2}) {
+    Bucket &bucket = table->buckets_[idx];
+    if (ScanBucket(bucket, key, &slot)) {
+      fn(bucket.slots_[slot].value_, true);
+      UnlockBuckets(b1, b2);
+      return UPDATED;
+    }
+  }
+  if (!insert) {
+    UnlockBuckets(b1, b2);
+    return NOT_FOUND;
+  }
+  for (size_t idx : {b1, b2}) {
+    Bucket &bucket = table->buckets_[idx];
+    if (bucket.occupied_ != FULL) {
+      slot = __builtin_ctz(~bucket.occupied_ & FULL);
+      bucket.slots_[slot].key_ = key;
+      bucket.slots_[slot].value_ = ValueType{};
+      fn(bucket.slots_[slot].value_, false);
+      bucket.occupied_ |= 1 << slot;
+      UnlockBuckets(b1, b2);
+      return INSERTED;
+    }
+  }
+  UnlockBuckets(b1, b2);
+
+  // Both buckets are full: make room by moving keys along a cuckoo path
+  Move path[MAX_PATH_LENGTH];
+  size_t num_moves;
+  if (!SearchPath(table, b1, b2, path, &num_moves)) {
+    return NO_SLOT;
+  }
+  return MovePath(table, path, num_moves) ? MOVED : RETRY;
+}
+
+template <typename KeyType, typename ValueType>
+template <typename LookupKey>
+typename CuckooHashTable<KeyType, ValueType>::WriteResult
+CuckooHashTable<KeyType, ValueType>::DeleteSlot(Table *table, uint64_t hash,
+                                                const LookupKey &key) {
+  size_t b1 = PrimaryBucket(table, hash);
+  size_t b2 = AltBucket(table, b1, hash);
+  LockBuckets(b1, b2);
+
+  WriteResult result = NOT_FOUND;
+  size_t slot;
+  for (size_t idx : {b1, b2}) {
+    Bucket &bucket = table->buckets_[idx];
+    if (ScanBucket(bucket, key, &slot)) {
+      bucket.occupied_ &= ~(1 << slot);
+      result = UPDATED;
+      break;
+    }
+  }
+  UnlockBuckets(b1, b2);
+  return result;
+}
+
+template <typename KeyType, typename ValueType>
+bool CuckooHashTable<KeyType, ValueType>::SearchPath(const Table *table,
+                                                     size_t b1, size_t b2,
+                                                     Move *path,
+                                                     size_t *num_moves) const {
+  // A node is a bucket reached by moving the key in `slot_` of the parent's
+  // bucket to its other bucket
+  struct Node {
+    size_t bucket_;
+    size_t parent_;
+    size_t slot_;
+    size_t depth_;
+  };
+  Node nodes[MAX_BFS_NODES];
+  size_t tail = 0;
+  nodes[tail++] = {b1, 0, 0, 0};
+  if (b2 != b1) {
+    nodes[tail++] = {b2, 0, 0, 0};
+  }
+
+  for (size_t head = 0; head < tail; ++head) {
+    Node node = nodes[head];
+    const Bucket &bucket = table->buckets_[node.bucket_];
+    const Stripe &stripe = GetStripe(node.bucket_);
+    uint8_t occupied;
+    KeyType keys[SLOTS_PER_BUCKET];
+    uint64_t version;
+    do {
+      version = ReadBegin(stripe);
+      occupied = bucket.occupied_;
+      for (size_t i = 0; i < SLOTS_PER_BUCKET; ++i) {
+        keys[i] = bucket.slots_[i].key_;
+      }
+    } while (!ReadValidate(stripe, version));
+
+    if (occupied != FULL) {
+      // Walk back to the root, which yields the moves from the last one
+      *num_moves = 0;
+      for (size_t idx = head; nodes[idx].depth_ > 0; idx = nodes[idx].parent_) {
+        path[(*num_moves)++] = {nodes[nodes[idx].parent_].bucket_,
+                                nodes[idx].slot_, nodes[idx].bucket_};
+      }
+      return true;
+    }
+    if (node.depth_ == MAX_PATH_LENGTH) {
+      continue;
+    }
+    for (size_t i = 0; i < SLOTS_PER_BUCKET && tail < MAX_BFS_NODES; ++i) {
+      size_t alt = AltBucket(table, node.bucket_, Hash(keys[i]));
+      if (alt != node.bucket_) {
+        nodes[tail++] = {alt, head, i, node.depth_ + 1};
+      }
+    }
+  }
+  return false;
+}
+
+template <typename KeyType, typename ValueType>
+bool CuckooHashTable<KeyType, ValueType>::MovePath(Table *table,
+                                                   const Move *path,
+                                                   size_t num_moves) {
+  for (size_t i = 0; i < num_moves; ++i) {
+    const Move &move = path[i];
+    LockBuckets(move.from_, move.to_);
+    Bucket &from = table->buckets_[move.from_];
+    Bucket &to = table->buckets_[move.to_];
+    // The path was found without locks; other writers may have changed it
+    bool valid =
+        ((from.occupied_ >> move.slot_) & 1) && to.occupied_ != FULL &&
+        AltBucket(table, move.from_, Hash(from.slots_[move.slot_].key_)) ==
+            move.to_;
+    if (valid) {
+      // Readers hold both stripes' versions, so the key is never missed
+      size_t slot = __builtin_ctz(~to.occupied_ & FULL);
+      to.slots_[slot] = from.slots_[move.slot_];
+      to.occupied_ |= 1 << slot;
+      from.occupied_ &= ~(1 << move.slot_);
+    }
+    UnlockBuckets(move.from_, move.to_);
+    if (!valid) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename KeyType, typename ValueType>
+void CuckooHashTable<KeyType, ValueType>::Rebuild(Table *table) {
+  stats_.WriteLock(resize_lock_);
+  if (table_.load() != table) {
+    // Another thread already rebuilt the table
+    resize_lock_.WriteUnlock();
+    return;
+  }
+
+  uint64_t start = StatsCounters::Now();
+  size_t num_buckets = table->num_buckets_ * 2;
+  Table *new_table;
+  while (true) {
+    new_table = new Table(num_buckets);
+    bool complete = true;
+    for (size_t i = 0; i < table->num_buckets_ && complete; ++i) {
+      const Bucket &bucket = table->buckets_[i];
+      for (size_t j = 0; j < SLOTS_PER_BUCKET; ++j) {
+        if (!((bucket.occupied_ >> j) & 1)) {
+          continue;
+        }
+        const Slot &slot = bucket.slots_[j];
+        auto copy = [&slot](ValueType &value, bool) { value = slot.value_; };
+        WriteResult result;
+        do {
+          result =
+              UpsertSlot(new_table, Hash(slot.key_), slot.key_, true, copy);
+        } while (result == MOVED || result == RETRY);
+        if (result == NO_SLOT) {
+          complete = false;
+          break;
+        }
+      }
+    }
+    if (complete) {
+      break;
+    }
+    // Unlucky hashes; try again with more room
+    delete new_table;
+    num_buckets *= 2;
+  }
+
+  // Readers may still probe the old table; it is freed once they are done
+  table_.store(new_table, std::memory_order_release);
+  EpochManager::Instance().Retire(table);
+  stats_.AddResize(start);
+  resize_lock_.WriteUnlock();
+}
+
+template <typename KeyType, typename ValueType>
+TableStats CuckooHashTable<KeyType, ValueType>::Stats() {
+  EpochManager::Guard guard;
+  TableStats stats;
+  stats_.Collect(&stats);
+  stats.size_ = size_.Load();
+  stats.capacity_ =
+      table_.load(std::memory_order_acquire)->num_buckets_ * SLOTS_PER_BUCKET;
+  return stats;
+}
@@ -0,0 +1,476 @@
+#ifndef CUCKOO_HASH_TABLE_H_
+#define CUCKOO_HASH_TABLE_H_
+
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include "epoch_manager.h"
+#include "index_policy.h"
+#include "key_traits.h"
+#include "rwlock.h"
+#include "sharded_counter.h"
+#include "table_stats.h"
+
+/**
+ * Concurrent bucketized cuckoo hash table for trivially copyable keys and
+ * values.
+ *
+ * Every key has two candidate buckets of 4 slots each, so a lookup inspects
+ * at most 8 slots, whatever the load. When both buckets of a new key are
+ * full, a breadth-first search finds a short path of keys that can each move
+ * to their other bucket, ending at a free slot; the keys are then moved one
+ * by one, last first, so that every intermediate state still holds every key.
+ * This keeps the table usable at load factors well above 0.9.
+ *
+ * Buckets are guarded by a fixed array of stripes whose version doubles as
+ * their lock, like the groups of SwissHashTable. A writer locks the stripes
+ * of (at most) two buckets at a time, in address order. Readers never write
+ * shared memory: they scan both buckets of the key and retry if either
+ * stripe changed meanwhile; moving a key locks both of its buckets, so a
+ * reader never misses a key in flight. Growing the table is exclusive: writers
+ * hold a shared lock against it, readers keep probing the frozen old table
+ * until the epoch manager frees it.
+ */
+template <typename KeyType, typename ValueType>
+class CuckooHashTable {
+  static_assert(std::is_trivially_copyable_v<KeyType> &&
+                    std::is_trivially_copyable_v<ValueType>,
+                "optimistic reads copy keys and values that may be written "
+                "concurrently, so they must be trivially copyable");
+
+ private:
+  static constexpr size_t SLOTS_PER_BUCKET{4};
+  // Occupancy mask of a full bucket
+  static constexpr uint8_t FULL{(1 << SLOTS_PER_BUCKET) - 1};
+
+  struct Slot {
+    KeyType key_;
+    ValueType value_;
+  };
+
+  struct alignas(64) Bucket {
+    uint8_t occupied_{0};  // bit i is set if slot i holds a key
+    Slot slots_[SLOTS_PER_BUCKET];
+  };
+
+  /**
+   * An array of buckets together with its size, swapped as a whole on growth
+   */
+  struct Table {
+    size_t num_buckets_;  // number of buckets (a power of two)
+    Bucket *buckets_;     // array of buckets
+
+    explicit Table(size_t num_buckets)
+        : num_buckets_(num_buckets), buckets_(new Bucket[num_buckets]) {}
+    ~Table() { delete[] buckets_; }
+  };
+
+  struct alignas(64) Stripe {
+    std::atomic<uint64_t> version_{0};  // odd while a writer owns the stripe
+  };
+
+  /**
+   * One displacement of a cuckoo path: the key in `slot_` of `from_` moves to
+   * a free slot of its other bucket `to_`
+   */
+  struct Move {
+    size_t from_;
+    size_t slot_;
+    size_t to_;
+  };
+
+ public:
+  /**
+   * Default constructor
+   */
+  CuckooHashTable() : CuckooHashTable(DEFAULT_CAPACITY, DEFAULT_LOAD_FACTOR) {}
+
+  /**
+   * Creates a new CuckooHashTable instance
+   * @param capacity the initial number of slots (rounded up to a power-of-two
+   * number of buckets)
+   * @param max_load_factor the maximum fraction of occupied slots before the
+   * table grows
+   */
+  CuckooHashTable(size_t capacity, float max_load_factor);
+
+  /**
+   * Disallows copy
+   */
+  CuckooHashTable(const CuckooHashTable &other) = delete;
+  CuckooHashTable &operator=(const CuckooHashTable &other) = delete;
+
+  /**
+   * Destroys an existing CuckooHashTable instance
+   */
+  ~CuckooHashTable();
+
+  size_t size() const { return size_.Load(); }
+
+  /**
+   * Gets the value of a key-value pair
+   * @param key the key of the key-value pair
+   * @return the value of that key
+   */
+  ValueType Get(const KeyType &key) { return Get<KeyType>(key); }
+
+  /**
+   * Gets the value of a key-value pair by a key of another type (see KeyHash)
+   * @param key the key of the key-value pair
+   * @return the value of that key
+   */
+  template <typename LookupKey,
+            typename = EnableIfLookupKey<KeyType, LookupKey>>
+  ValueType Get(const LookupKey &key);
+
+  /**
+   * Gets the value of a key-value pair, if the key exists
+   * @param key the key of the key-value pair
+   * @return the value of that key, or std::nullopt if the key does not exist
+   */
+  std::optional<ValueType> TryGet(const KeyType &key) {
+    return TryGet<KeyType>(key);
+  }
+
+  /**
+   * Gets the value of a key-value pair by a key of another type (see
+   * KeyHash), if the key exists
+   * @param key the key of the key-value pair
+   * @return the value of that key, or std::nullopt if the key does not exist
+   */
+  template <typename LookupKey,
+            typename = EnableIfLookupKey<KeyType, LookupKey>>
+  std::optional<ValueType> TryGet(const LookupKey &key);
+
+  /**
+   * Calls a function on the value of a key-value pair
+   * @param key the key of the key-value pair
+   * @param fn called with a const reference to a copy of the value. Readers
+   * never lock, so the copy is validated against concurrent writers first
+   * @return true if the key exists; otherwise, false
+   */
+  template <typename Fn>
+  bool Find(const KeyType &key, Fn fn) {
+    return Find<KeyType, Fn>(key, fn);
+  }
+
+  /**
+   * Calls a function on the value of a key-value pair, found by a key of
+   * another type (see KeyHash)
+   * @param key the key of the key-value pair
+   * @param fn called with a const reference to a copy of the value. Readers
+   * never lock, so the copy is validated against concurrent writers first
+   * @return true if the key exists; otherwise, false
+   */
+  template <typename LookupKey, typename Fn,
+            typename = EnableIfLookupKey<KeyType, LookupKey>>
+  bool Find(const LookupKey &key, Fn fn);
+
+  /**
+   * Checks if a key exists in the hash table
+   * @param key the key to check
+   * @return true if that key exists; otherwise, false
+   */
+  bool Contains(const KeyType &key) { return Contains<KeyType>(key); }
+
+  /**
+   * Checks if a key exists in the hash table, by a key of another type
+   * (see KeyHash)
+   * @param key the key to check
+   * @return true if that key exists; otherwise, false
+   */
+  template <typename LookupKey,
+            typename = EnableIfLookupKey<KeyType, LookupKey>>
+  bool Contains(const LookupKey &key);
+
+  /**
+   * Inserts a key-value pair into the hash table
+   * @param key the key to insert
+   * @param value the value to insert
+   */
+  void Insert(const KeyType &key, const ValueType &value) {
+    InsertOrAssign(key, value);
+  }
+
+  /**
+   * Inserts a key-value pair, or assigns the value if the key exists
+   * @param key the key to insert
+   * @param value the value to insert or assign
+   * @return true if the key was inserted; false if it existed
+   */
+  bool InsertOrAssign(const KeyType &key, const ValueType &value);
+
+  /**
+   * Inserts a key-value pair only if the key does not exist
+   * @param key the key to insert
+   * @param value the value to insert
+   * @param[out] existing the value of the key if it exists, if not nullptr
+   * @return true if the key was inserted; false if it existed
+   */
+  bool TryEmplace(const KeyType &key, const ValueType &value,
+                  ValueType *existing = nullptr);
+
+  /**
+   * Inserts a key with a value constructed from some arguments, only if the
+   * key does not exist. Values are trivially copyable, so the value is built
+   * up front and copied into its slot like TryEmplace's
+   * @param key the key to insert
+   * @param args the arguments of the value's constructor
+   * @return true if the key was inserted; false if it existed
+   */
+  template <typename... Args>
+  bool Emplace(const KeyType &key, Args &&...args) {
+    return TryEmplace(key, ValueType(std::forward<Args>(args)...));
+  }
+
+  /**
+   * Atomically modifies the value of a key if it exists
+   * @param key the key to update
+   * @param fn called with a reference to the value, with both buckets of
+   * the key locked; it must not access the hash table
+   * @return true if the key exists; otherwise, false
+   */
+  template <typename Fn>
+  bool Update(const KeyType &key, Fn fn);
+
+  /**
+   * Atomically modifies the value of a key, inserting the key with a
+   * value-initialized value first if it does not exist
+   * @param key the key to update
+   * @param fn called with a reference to the value, with both buckets of
+   * the key locked; it must not access the hash table
+   * @return the modified value
+   */
+  template <typename Fn>
+  ValueType Compute(const KeyType &key, Fn fn);
+
+  /**
+   * Deletes a key-value pair from the hash table
+   * @param key the key to delete
+   */
+  void Delete(const KeyType &key) { Delete<KeyType>(key); }
+
+  /**
+   * Deletes a key-value pair from the hash table by a key of another type
+   * (see KeyHash)
+   * @param key the key to delete
+   */
+  template <typename LookupKey,
+            typename = EnableIfLookupKey<KeyType, LookupKey>>
+  void Delete(const LookupKey &key);
+
+  /**
+   * Gets the runtime statistics of the hash table (see TableStats). Spinning
+   * on a stripe owned by another writer counts as a lock wait
+   * @return a snapshot of the statistics
+   */
+  TableStats Stats();
+
+ private:
+  // Outcomes of the operations performed under resize_lock_
+  enum WriteResult {
+    INSERTED,   // the key took a free slot
+    UPDATED,    // the key was updated or deleted
+    NOT_FOUND,  // the key to delete or update is absent
+    MOVED,      // a cuckoo path freed a slot in one of the key's buckets
+    NO_SLOT,    // no cuckoo path was found; the table must grow
+    RETRY,      // a cuckoo path was invalidated by another writer
+  };
+
+  /**
+   * Calculates the hash of a key
+   * @param key the key to hash
+   * @return the hash of that key
+   */
+  template <typename LookupKey>
+  static uint64_t Hash(const LookupKey &key) {
+    return MixHash(KeyHash<KeyType>{}(key));
+  }
+
+  /**
+   * Gets the first candidate bucket of a key
+   * @param table the table to index
+   * @param hash the hash of the key
+   * @return the index of the bucket
+   */
+  static size_t PrimaryBucket(const Table *table, uint64_t hash) {
+    return hash & (table->num_buckets_ - 1);
+  }
+
+  /**
+   * Gets the other candidate bucket of a key. The offset only depends on the
+   * top byte of the hash and is applied with a XOR, so the alternate of the
+   * alternate is the bucket itself
+   * @param table the table to index
+   * @param bucket one candidate bucket of the key
+   * @param hash the hash of the key
+   * @return the index of the other bucket
+   */
+  static size_t AltBucket(const Table *table, size_t bucket, uint64_t hash) {
+    uint64_t tag = (hash >> 56) + 1;
+    return (bucket ^ (tag * 0xc6a4a7935bd1e995ULL)) &
+           (table->num_buckets_ - 1);
+  }
+
+  /**
+   * Scans one bucket for a key. The caller validates the result if it does
+   * not own the bucket's stripe
+   * @param bucket the bucket to scan
+   * @param key the key to search
+   * @param[out] slot the index of the key's slot if it is found
+   * @return true if the key is found; otherwise, false
+   */
+  template <typename LookupKey>
+  static bool ScanBucket(const Bucket &bucket, const LookupKey &key,
+                         size_t *slot);
+
+  /**
+   * Gets the stripe guarding a bucket
+   * @param bucket the index of the bucket
+   * @return the stripe of that bucket
+   */
+  Stripe &GetStripe(size_t bucket) const {
+    return stripes_[bucket & (NUM_STRIPES - 1)];
+  }
+
+  /**
+   * Reads a stable (even) version of a stripe
+   * @param stripe the stripe to read
+   * @return the version of the stripe
+   */
+  static uint64_t ReadBegin(const Stripe &stripe);
+
+  /**
+   * Checks that a stripe did not change since ReadBegin
+   * @param stripe the stripe that was read
+   * @param version the version returned by ReadBegin
+   * @return true if the read is consistent; otherwise, false
+   */
+  static bool ReadValidate(const Stripe &stripe, uint64_t version);
+
+  /**
+   * Takes ownership of a stripe, making its version odd
+   * @param stripe the stripe to lock
+   */
+  void LockStripe(Stripe &stripe) const;
+
+  /**
+   * Locks the stripes of two buckets in address order (once if they share
+   * a stripe)
+   * @param b1 the index of the first bucket
+   * @param b2 the index of the second bucket
+   */
+  void LockBuckets(size_t b1, size_t b2);
+
+  /**
+   * Releases the stripes locked by LockBuckets, publishing their changes
+   * @param b1 the index of the first bucket
+   * @param b2 the index of the second bucket
+   */
+  void UnlockBuckets(size_t b1, size_t b2);
+
+  /**
+   * Looks a key up without taking any lock
+   * @param table the table to probe
+   * @param hash the hash of the key
+   * @param key the key to search
+   * @param[out] value the value of the key, if not nullptr
+   * @return true if the key is found; otherwise, false
+   */
+  template <typename LookupKey>
+  bool FindOptimistic(const Table *table, uint64_t hash, const LookupKey &key,
+                      ValueType *value) const;
+
+  /**
+   * Runs a write on the value of a key, rebuilding the table if it gets
+   * full. Every write operation but Delete goes through here
+   * @param key the key to write
+   * @param insert whether to insert the key, with a value-initialized value,
+   * if it does not exist
+   * @param fn called as fn(value, found) with a reference to the value of the
+   * key and whether it existed; not called if the key is absent and not
+   * inserted
+   * @return true if the key existed; otherwise, false
+   */
+  template <typename Fn>
+  bool Upsert(const KeyType &key, bool insert, Fn fn);
+
+  /**
+   * Inserts or updates a key-value pair, the caller holding resize_lock_
+   * @param table the table to insert into
+   * @param hash the hash of the key
+   * @param key the key to write
+   * @param insert whether to insert the key if it does not exist
+   * @param fn called as fn(value, found), see Upsert
+   * @return the outcome of the write
+   */
+  template <typename Fn>
+  WriteResult UpsertSlot(Table *table, uint64_t hash, const KeyType &key,
+                         bool insert, Fn &fn);
+
+  /**
+   * Deletes a key, the caller holding resize_lock_ in read mode
+   * @param table the table to delete from
+   * @param hash the hash of the key
+   * @param key the key to delete
+   * @return the outcome of the deletion
+   */
+  template <typename LookupKey>
+  WriteResult DeleteSlot(Table *table, uint64_t hash, const LookupKey &key);
+
+  /**
+   * Searches breadth-first for the shortest cuckoo path from one of two full
+   * buckets to a bucket with a free slot, without taking any lock
+   * @param table the table to search
+   * @param b1 the first bucket of the key to insert
+   * @param b2 the second bucket of the key to insert
+   * @param[out] path the moves to perform, in order
+   * @param[out] num_moves the number of moves
+   * @return true if a path is found; otherwise, false
+   */
+  bool SearchPath(const Table *table, size_t b1, size_t b2, Move *path,
+                  size_t *num_moves) const;
+
+  /**
+   * Performs the moves of a cuckoo path, checking each one under the locks
+   * of its two buckets
+   * @param table the table to modify
+   * @param path the moves to perform
+   * @param num_moves the number of moves
+   * @return true if every move was still valid; otherwise, false
+   */
+  bool MovePath(Table *table, const Move *path, size_t num_moves);
+
+  /**
+   * Doubles the number of buckets, unless another thread already replaced
+   * `table`
+   * @param table the table that got too full
+   */
+  void Rebuild(Table *table);
+
+  // Default hash table value
+  static constexpr size_t DEFAULT_CAPACITY{128};
+  static constexpr float DEFAULT_LOAD_FACTOR{0.9};
+  static constexpr size_t NUM_STRIPES{1024};
+  // Bounds of the cuckoo path search
+  static constexpr size_t MAX_PATH_LENGTH{5};
+  static constexpr size_t MAX_BFS_NODES{256};
+
+  float max_load_factor_;
+  std::atomic<Table *> table_;   // current array of buckets
+  ShardedCounter size_;          // number of key-value pairs
+  Stripe *stripes_;              // locks shared by the buckets
+  // Held in read mode by Insert/Delete and in write mode by Rebuild
+  ReaderWriterLock resize_lock_;
+  StatsCounters stats_;  // event counters, empty without TABLE_STATS
+};
+
+#include "cuckoo_hash_table.cpp"
+
+#endif  // CUCKOO_HASH_TABLE_H_
@@ -0,0 +1,274 @@
+#ifndef EPOCH_MANAGER_H_
+#define EPOCH_MANAGER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+/**
+ * Epoch-based memory reclamation (EBR) for the lock-free data structures.
+ *
+ * A thread enters an epoch before it touches shared nodes and leaves it when
+ * it is done. A node unlinked from a data structure is not freed right away:
+ * it is retired into the limbo list of the retiring thread, tagged with the
+ * global epoch at that moment. The global epoch only advances once every
+ * thread inside an epoch has observed the current one, so a node retired in
+ * epoch `e` can no longer be referenced once the global epoch reaches `e + 2`.
+ * Limbo lists are scanned in batches, which keeps the per-operation cost down
+ * to two stores to a thread-private cache line.
+ */
+class EpochManager {
+ public:
+  // Function used to free a retired pointer
+  using Deleter = void (*)(void *);
+
+  /**
+   * RAII helper that keeps the calling thread inside an epoch for the
+   * lifetime of the guard. Guards may be nested.
+   */
+  class Guard {
+   public:
+    Guard() { EpochManager::Instance().Enter(); }
+    ~Guard() { EpochManager::Instance().Leave(); }
+
+    Guard(const Guard &other) = delete;
+    Guard &operator=(const Guard &other) = delete;
+  };
+
+  /**
+   * Gets the process-wide epoch manager
+   * @return a reference to the epoch manager
+   */
+  static EpochManager &Instance() {
+    static EpochManager instance;
+    return instance;
+  }
+
+  EpochManager(const EpochManager &other) = delete;
+  EpochManager &operator=(const EpochManager &other) = delete;
+
+  /**
+   * Frees every pointer that is still waiting in a limbo list. Must only run
+   * once no thread is inside an epoch any more (i.e. at program exit).
+   */
+  ~EpochManager() {
+    // Deleters may retire further pointers, which are freed right away
+    shutting_down_ = true;
+    ThreadRecord *record = records_.load();
+    while (record != nullptr) {
+      ThreadRecord *next = record->next_;
+      for (const auto &retired : record->limbo_) {
+        retired.deleter_(retired.ptr_);
+      }
+      delete record;
+      record = next;
+    }
+  }
+
+  /**
+   * Enters an epoch. Pointers read from shared nodes stay valid until the
+   * matching call to Leave()
+   */
+  void Enter() {
+    ThreadRecord *record = LocalRecord();
+    if (record->nesting_++ == 0) {
+      uint64_t epoch = global_epoch_.load(std::memory_order_relaxed);
+      record->epoch_.store((epoch << 1) | ACTIVE, std::memory_order_relaxed);
+      // Announce the epoch before reading any shared node
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+  }
+
+  /**
+   * Leaves the epoch entered by the matching call to Enter()
+   */
+  void Leave() {
+    ThreadRecord *record = LocalRecord();
+    if (--record->nesting_ == 0) {
+      record->epoch_.store(0, std::memory_order_release);
+    }
+  }
+
+  /**
+   * Hands an unlinked pointer over to the reclamation subsystem. The pointer
+   * is freed with `deleter` once no thread can hold a reference to it
+   * @param ptr the pointer to retire
+   * @param deleter the function used to free the pointer
+   */
+  void Retire(void *ptr, Deleter deleter) {
+    if (shutting_down_) {
+      deleter(ptr);
+      return;
+    }
+    ThreadRecord *record = LocalRecord();
+    record->limbo_.push_back(
+        {ptr, deleter, global_epoch_.load(std::memory_order_acquire)});
+    if (++record->retired_since_scan_ >= RECLAIM_BATCH) {
+      record->retired_since_scan_ = 0;
+      TryAdvance();
+      Reclaim(record);
+    }
+  }
+
+  /**
+   * Retires an object that was allocated with `new`
+   * @param ptr the object to retire
+   */
+  template <typename T>
+  void Retire(T *ptr) {
+    Retire(ptr, [](void *p) { delete static_cast<T *>(p); });
+  }
+
+ private:
+  struct RetiredPtr {
+    void *ptr_;         // the retired pointer
+    Deleter deleter_;   // the function that frees the pointer
+    uint64_t epoch_;    // global epoch at the time of retirement
+  };
+
+  /**
+   * Per-thread state, padded to a cache line so that entering and leaving an
+   * epoch never writes to a line shared with another thread
+   */
+  struct alignas(64) ThreadRecord {
+    // (epoch << 1) | ACTIVE while the owner is inside an epoch, 0 otherwise
+    std::atomic<uint64_t> epoch_{0};
+    // whether a live thread currently owns this record
+    std::atomic<bool> in_use_{true};
+    ThreadRecord *next_{nullptr};  // next record in the registry
+    // The fields below are only accessed by the owning thread
+    unsigned nesting_{0};             // depth of nested guards
+    size_t retired_since_scan_{0};    // retirements since the last scan
+    std::vector<RetiredPtr> limbo_;   // retired pointers, oldest first
+  };
+
+  /**
+   * Releases the record of an exiting thread so that a new thread can adopt
+   * it (together with its limbo list)
+   */
+  struct ThreadExitHandler {
+    ThreadRecord *record_{nullptr};
+
+    ~ThreadExitHandler() {
+      if (record_ != nullptr) {
+        EpochManager::Instance().Reclaim(record_);
+        record_->in_use_.store(false, std::memory_order_release);
+        local_record_ = nullptr;
+      }
+    }
+  };
+
+  EpochManager() = default;
+
+  /**
+   * Gets the record of the calling thread, registering the thread on first
+   * use
+   * @return the record of the calling thread
+   */
+  ThreadRecord *LocalRecord() {
+    if (local_record_ == nullptr) {
+      static thread_local ThreadExitHandler exit_handler;
+      local_record_ = AcquireRecord();
+      exit_handler.record_ = local_record_;
+    }
+    return local_record_;
+  }
+
+  /**
+   * Adopts a record released by an exited thread or registers a new one
+   * @return a record owned by the calling thread
+   */
+  ThreadRecord *AcquireRecord() {
+    for (ThreadRecord *record = records_.load(); record != nullptr;
+         record = record->next_) {
+      bool in_use = false;
+      if (!record->in_use_.load(std::memory_order_relaxed) &&
+          record->in_use_.compare_exchange_strong(in_use, true)) {
+        return record;
+      }
+    }
+    auto record = new ThreadRecord();
+    record->next_ = records_.load();
+    while (!records_.compare_exchange_weak(record->next_, record)) {
+    }
+    return record;
+  }
+
+  /**
+   * Advances the global epoch if every thread inside an epoch has already
+   * observed the current one
+   */
+  void TryAdvance() {
+    uint64_t epoch = global_epoch_.load();
+    for (ThreadRecord *record = records_.load(); record != nullptr;
+         record = record->next_) {
+      uint64_t local = record->epoch_.load();
+      if ((local & ACTIVE) && (local >> 1) != epoch) {
+        return;
+      }
+    }
+    global_epoch_.compare_exchange_strong(epoch, epoch + 1);
+  }
+
+  /**
+   * Frees the retired pointers of a record that no thread can reference any
+   * more. Deleters may retire further pointers, so the safe prefix is
+   * detached from the limbo list before any deleter runs
+   * @param record the record whose limbo list to scan
+   */
+  void Reclaim(ThreadRecord *record) {
+    uint64_t epoch = global_epoch_.load(std::memory_order_acquire);
+    auto &limbo = record->limbo_;
+    size_t safe = 0;
+    while (safe < limbo.size() && limbo[safe].epoch_ + 2 <= epoch) {
+      ++safe;
+    }
+    if (safe == 0) {
+      return;
+    }
+    std::vector<RetiredPtr> ready(limbo.begin(), limbo.begin() + safe);
+    limbo.erase(limbo.begin(), limbo.begin() + safe);
+    for (const auto &retired : ready) {
+      retired.deleter_(retired.ptr_);
+    }
+  }
+
+  // Number of retirements between two scans of a limbo list
+  static constexpr size_t RECLAIM_BATCH{64};
+  static constexpr uint64_t ACTIVE{1};
+
+  std::atomic<uint64_t> global_epoch_{1};      // the global epoch
+  std::atomic<ThreadRecord *> records_{nullptr};  // registry of all threads
+  bool shutting_down_{false};  // set once the destructor starts
+  static inline thread_local ThreadRecord *local_record_{nullptr};
+};
+
+/**
+ * Standard allocator whose deallocations go through the epoch manager, so
+ * that a container can reallocate its storage while optimistic readers are
+ * still scanning the old buffer
+ */
+template <typename T>
+struct EpochAllocator {
+  using value_type = T;
+
+  EpochAllocator() = default;
+  template <typename U>
+  EpochAllocator(const EpochAllocator<U> &) {}
+
+  T *allocate(size_t n) {
+    return static_cast<T *>(::operator new(n * sizeof(T)));
+  }
+
+  void deallocate(T *ptr, size_t) {
+    EpochManager::Instance().Retire(ptr, [](void *p) { ::operator delete(p); });
+  }
+
+  template <typename U>
+  bool operator==(const EpochAllocator<U> &) const { return true; }
+  template <typename U>
+  bool operator!=(const EpochAllocator<U> &) const { return false; }
+};
+
+#endif  // EPOCH_MANAGER_H_
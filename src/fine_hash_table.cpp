@@ -1,145 +1,549 @@
 #include "fine_hash_table.h"
 
-template <typename KeyType, typename ValueType>
-Bucket<KeyType, ValueType>& Bucket<KeyType, ValueType>::operator=(Bucket &other) {
-  // avoid self-assignment
-  if (this != &other) {
-    lock_.WriteLock();
-    list_ = other.GetKVList();
-    lock_.WriteUnlock();
+template <typename KeyType, typename ValueType, typename LockType>
+template <typename LookupKey>
+bool Bucket<KeyType, ValueType, LockType>::ReadOptimistic(
+    const LookupKey &key, size_t hash, const StripeLock<LockType> &stripe,
+    ValueType *value, FindResult *result) const {
+  uint64_t version = stripe.version_.load(std::memory_order_acquire);
+  if (version & 1) {
+    return false;
   }
-  return *this;
+  // A migrated bucket never comes back
+  if (IsMigrated()) {
+    *result = MIGRATED;
+    return true;
+  }
+  const Entry *entries = list_.data();
+  size_t count = list_.size();
+  // The chain may be reallocated at any time; only scan a consistent view
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (stripe.version_.load(std::memory_order_relaxed) != version) {
+    return false;
+  }
+  bool found = false;
+  ValueType copy {};
+  for (size_t i = 0; i < count; ++i) {
+    if (entries[i].MayMatch(hash) &&
+        KeyEqual<KeyType>{}(entries[i].key_, key)) {
+      copy = entries[i].value_;
+      found = true;
+      break;
+    }
+  }
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (stripe.version_.load(std::memory_order_relaxed) != version) {
+    return false;
+  }
+  if (found && value != nullptr) {
+    *value = copy;
+  }
+  *result = found ? FOUND : NOT_FOUND;
+  return true;
 }
 
-template<typename KeyType, typename ValueType>
-ValueType Bucket<KeyType, ValueType>::GetKV(const KeyType &key) {
-  lock_.ReadLock();
-  ValueType value {};
-  for (const auto &entry : list_) {
-    if (entry.key_ == key) {
-      value = entry.value_;
-      break;
+template <typename KeyType, typename ValueType, typename LockType>
+template <typename LookupKey>
+typename Bucket<KeyType, ValueType, LockType>::FindResult
+Bucket<KeyType, ValueType, LockType>::FindKV(const LookupKey &key,
+                                             size_t hash,
+                                             StripeLock<LockType> &stripe,
+                                             const StatsCounters &stats,
+                                             ValueType *value) {
+  FindResult result;
+  if constexpr (OPTIMISTIC_READS) {
+    for (int attempt = 0; attempt < OPTIMISTIC_RETRIES; ++attempt) {
+      if (ReadOptimistic(key, hash, stripe, value, &result)) {
+        return result;
+      }
+      stats.Add(StatsCounters::READ_RETRIES);
     }
   }
-  lock_.ReadUnlock();
-  return value;
+  auto copy = [value](const ValueType &found) {
+    if (value != nullptr) {
+      *value = found;
+    }
+  };
+  return VisitKV(key, hash, stripe, stats, copy);
 }
 
-template<typename KeyType, typename ValueType>
-bool Bucket<KeyType, ValueType>::ContainsKV(const KeyType &key) {
-  lock_.ReadLock();
-  for (const auto &entry : list_) {
-    if (entry.key_ == key) {
-      lock_.ReadUnlock();
-      return true;
+template <typename KeyType, typename ValueType, typename LockType>
+template <typename LookupKey, typename Fn>
+typename Bucket<KeyType, ValueType, LockType>::FindResult
+Bucket<KeyType, ValueType, LockType>::VisitKV(const LookupKey &key,
+                                              size_t hash,
+                                              StripeLock<LockType> &stripe,
+                                              const StatsCounters &stats,
+                                              Fn &fn) {
+  stats.ReadLock(stripe.lock_);
+  FindResult result = IsMigrated() ? MIGRATED : NOT_FOUND;
+  if (result == NOT_FOUND) {
+    for (const auto &entry : list_) {
+      if (entry.MayMatch(hash) && KeyEqual<KeyType>{}(entry.key_, key)) {
+        fn(entry.value_);
+        result = FOUND;
+        break;
+      }
     }
   }
-  lock_.ReadUnlock();
-  return false;
+  stripe.lock_.ReadUnlock();
+  return result;
 }
 
-template <typename KeyType, typename ValueType>
-bool Bucket<KeyType, ValueType>::InsertKV(const KeyType &key,
-                                          const ValueType &value) {
-  lock_.WriteLock();
+template <typename KeyType, typename ValueType, typename LockType>
+template <typename KeyArg, typename Fn, typename... Args>
+bool Bucket<KeyType, ValueType, LockType>::UpsertKV(
+    KeyArg &&key, size_t hash, bool insert, Fn fn,
+    StripeLock<LockType> &stripe, Args &&...args) {
   for (auto &entry : list_) {
-    if (entry.key_ == key) {
-      entry.value_ = value;
-      lock_.WriteUnlock();
-      return false;
+    if (entry.MayMatch(hash) && KeyEqual<KeyType>{}(entry.key_, key)) {
+      stripe.BeginWrite();
+      fn(entry.value_, true);
+      stripe.EndWrite();
+      return true;
     }
   }
 
-  list_.emplace_back(key, value);
-  lock_.WriteUnlock();
-  return true;
+  if (insert) {
+    stripe.BeginWrite();
+    fn(list_
+           .emplace_back(hash, std::forward<KeyArg>(key),
+                         std::forward<Args>(args)...)
+           .value_,
+       false);
+    stripe.EndWrite();
+  }
+  return false;
 }
 
-template <typename KeyType, typename ValueType>
-bool Bucket<KeyType, ValueType>::DeleteKV(const KeyType &key) {
-  lock_.WriteLock();
+template <typename KeyType, typename ValueType, typename LockType>
+template <typename LookupKey>
+bool Bucket<KeyType, ValueType, LockType>::DeleteKV(
+    const LookupKey &key, size_t hash, StripeLock<LockType> &stripe) {
   for (auto it = list_.begin(); it != list_.end(); ++it) {
-    if (it->key_ == key) {
+    if (it->MayMatch(hash) && KeyEqual<KeyType>{}(it->key_, key)) {
+      stripe.BeginWrite();
       list_.erase(it);
-      lock_.WriteUnlock();
+      stripe.EndWrite();
       return true;
     }
   }
-  lock_.WriteUnlock();
   return false;
 }
 
-template<typename KeyType, typename ValueType>
-FineHashTable<KeyType, ValueType>::~FineHashTable() {
-  // Must take a write lock to destroy the hash table
-  global_lock_.WriteLock();
-  delete []table_;
-  global_lock_.WriteUnlock();
+template <typename KeyType, typename ValueType, typename IndexPolicy,
+          typename LockType>
+FineHashTable<KeyType, ValueType, IndexPolicy, LockType>::~FineHashTable() {
+  delete table_.load();
+  delete[] stripes_;
 }
 
-template<typename KeyType, typename ValueType>
-ValueType FineHashTable<KeyType, ValueType>::Get(const KeyType &key) {
-  global_lock_.ReadLock();
-  size_t idx = KeyToIndex(key);
-  ValueType value = table_[idx].GetKV(key);
-  global_lock_.ReadUnlock();
+template <typename KeyType, typename ValueType, typename IndexPolicy,
+          typename LockType>
+template <typename LookupKey, typename>
+ValueType FineHashTable<KeyType, ValueType, IndexPolicy, LockType>::Get(
+    const LookupKey &key) {
+  // The epoch keeps a replaced table and reallocated chains alive
+  EpochManager::Guard guard;
+  ValueType value {};
+  FindValue(key, Hash(key), &value);
   return value;
 }
 
-template<typename KeyType, typename ValueType>
-bool FineHashTable<KeyType, ValueType>::Contains(const KeyType &key) {
-  global_lock_.ReadLock();
-  size_t idx = KeyToIndex(key);
-  bool contains_key = table_[idx].ContainsKV(key);
-  global_lock_.ReadUnlock();
-  return contains_key;
+template <typename KeyType, typename ValueType, typename IndexPolicy,
+          typename LockType>
+template <typename LookupKey, typename>
+std::optional<ValueType>
+FineHashTable<KeyType, ValueType, IndexPolicy, LockType>::TryGet(
+    const LookupKey &key) {
+  EpochManager::Guard guard;
+  ValueType value{};
+  if (!FindValue(key, Hash(key), &value)) {
+    return std::nullopt;
+  }
+  return value;
 }
 
-template<typename KeyType, typename ValueType>
-void FineHashTable<KeyType, ValueType>::Insert(const KeyType &key, const ValueType &value) {
-  global_lock_.ReadLock();
-  size_t idx = KeyToIndex(key);
-  if (table_[idx].InsertKV(key, value)) {
-    ++size_;
+template <typename KeyType, typename ValueType, typename IndexPolicy,
+          typename LockType>
+template <typename LookupKey, typename Fn, typename>
+bool FineHashTable<KeyType, ValueType, IndexPolicy, LockType>::Find(
+    const LookupKey &key, Fn fn) {
+  // Unlike FindValue, never reads optimistically: `fn` sees the stored value
+  EpochManager::Guard guard;
+  return SearchTables(Hash(key), [&](auto &bucket, size_t hash, auto &stripe) {
+    return bucket.VisitKV(key, hash, stripe, stats_, fn);
+  });
+}
+
+template <typename KeyType, typename ValueType, typename IndexPolicy,
+          typename LockType>
+template <typename LookupKey, typename>
+bool FineHashTable<KeyType, ValueType, IndexPolicy, LockType>::Contains(
+    const LookupKey &key) {
+  EpochManager::Guard guard;
+  return FindValue(key, Hash(key), nullptr);
+}
+
+template <typename KeyType, typename ValueType, typename IndexPolicy,
+          typename LockType>
+bool FineHashTable<KeyType, ValueType, IndexPolicy, LockType>::InsertOrAssign(
+    const KeyType &key, const ValueType &value) {
+  // A new entry is copy-constructed from the value
+  return !Upsert(
+      Hash(key), key, true,
+      [&value](ValueType &current, bool found) {
+        if (found) {
+          current = value;
+        }
+      },
+      value);
+}
+
+template <typename KeyType, typename ValueType, typename IndexPolicy,
+          typename LockType>
+bool FineHashTable<KeyType, ValueType, IndexPolicy, LockType>::InsertOrAssign(
+    KeyType key, ValueType &&value) {
+  return !Upsert(
+      Hash(key), std::move(key), true,
+      [&value](ValueType &current, bool found) {
+        if (found) {
+          current = std::move(value);
+        }
+      },
+      std::move(value));
+}
+
+template <typename KeyType, typename ValueType, typename IndexPolicy,
+          typename LockType>
+bool FineHashTable<KeyType, ValueType, IndexPolicy, LockType>::TryEmplace(
+    const KeyType &key, const ValueType &value, ValueType *existing) {
+  return !Upsert(
+      Hash(key), key, true,
+      [existing](ValueType &current, bool found) {
+        if (found && existing != nullptr) {
+          *existing = current;
+        }
+      },
+      value);
+}
+
+template <typename KeyType, typename ValueType, typename IndexPolicy,
+          typename LockType>
+bool FineHashTable<KeyType, ValueType, IndexPolicy, LockType>::TryEmplace(
+    KeyType key, ValueType &&value, ValueType *existing) {
+  return !Upsert(
+      Hash(key), std::move(key), true,
+      [existing](ValueType &current, bool found) {
+        if (found && existing != nullptr) {
+          *existing = current;
+        }
+      },
+      std::move(value));
+}
+
+template <typename KeyType, typename ValueType, typename IndexPolicy,
+          typename LockType>
+template <typename... Args>
+bool FineHashTable<KeyType, ValueType, IndexPolicy, LockType>::Emplace(
+    KeyType key, Args &&...args) {
+  return !Upsert(
+      Hash(key), std::move(key), true, [](ValueType &, bool) {},
+      std::forward<Args>(args)...);
+}
+
+template <typename KeyType, typename ValueType, typename IndexPolicy,
+          typename LockType>
+template <typename Fn>
+bool FineHashTable<KeyType, ValueType, IndexPolicy, LockType>::Update(
+    const KeyType &key, Fn fn) {
+  return Upsert(Hash(key), key, false,
+                [&fn](ValueType &current, bool) { fn(current); });
+}
+
+template <typename KeyType, typename ValueType, typename IndexPolicy,
+          typename LockType>
+template <typename Fn>
+ValueType FineHashTable<KeyType, ValueType, IndexPolicy, LockType>::Compute(
+    const KeyType &key, Fn fn) {
+  ValueType result{};
+  Upsert(Hash(key), key, true, [&](ValueType &current, bool) {
+    fn(current);
+    result = current;
+  });
+  return result;
+}
+
+template <typename KeyType, typename ValueType, typename IndexPolicy,
+          typename LockType>
+template <typename LookupKey, typename>
+void FineHashTable<KeyType, ValueType, IndexPolicy, LockType>::Delete(
+    const LookupKey &key) {
+  EpochManager::Guard guard;
+  Table *table;
+  StripeLock<LockType> *stripe;
+  size_t hash = Hash(key);
+  auto &bucket = LockBucket(hash, &table, &stripe);
+  if (bucket.DeleteKV(key, hash, *stripe)) {
+    size_.Decrement();
   }
-  if (size_ > capacity_ * max_load_factor_) {
-    global_lock_.ReadUnlock();
-    GrowHashTable();
-  } else {
-    global_lock_.ReadUnlock();
+  stripe->lock_.WriteUnlock();
+  if (table->old_.load(std::memory_order_acquire) != nullptr) {
+    HelpMigrate(table);
   }
 }
 
-template<typename KeyType, typename ValueType>
-void FineHashTable<KeyType, ValueType>::Delete(const KeyType &key) {
-  global_lock_.ReadLock();
-  size_t idx = KeyToIndex(key);
-  if (table_[idx].DeleteKV(key)) {
-    --size_;
-  } 
-  global_lock_.ReadUnlock();
+template <typename KeyType, typename ValueType, typename IndexPolicy,
+          typename LockType>
+void FineHashTable<KeyType, ValueType, IndexPolicy, LockType>::MultiGet(
+    const KeyType *keys, size_t num_keys, ValueType *values) {
+  size_t hashes[PREFETCH_BATCH];
+  for (size_t start = 0; start < num_keys; start += PREFETCH_BATCH) {
+    size_t count = std::min(PREFETCH_BATCH, num_keys - start);
+    EpochManager::Guard guard;
+    PrefetchBuckets(keys + start, count, hashes);
+    for (size_t i = 0; i < count; ++i) {
+      values[start + i] = ValueType{};
+      FindValue(keys[start + i], hashes[i], &values[start + i]);
+    }
+  }
 }
 
-template<typename KeyType, typename ValueType>
-void FineHashTable<KeyType, ValueType>::GrowHashTable() {
-  // Must take a global write lock since we modify the entire hash table
-  global_lock_.WriteLock();
-  // Another thread already grew the hash table
-  if (size_ <= capacity_ * max_load_factor_) {
-    global_lock_.WriteUnlock();
+template <typename KeyType, typename ValueType, typename IndexPolicy,
+          typename LockType>
+void FineHashTable<KeyType, ValueType, IndexPolicy, LockType>::MultiContains(
+    const KeyType *keys, size_t num_keys, bool *found) {
+  size_t hashes[PREFETCH_BATCH];
+  for (size_t start = 0; start < num_keys; start += PREFETCH_BATCH) {
+    size_t count = std::min(PREFETCH_BATCH, num_keys - start);
+    EpochManager::Guard guard;
+    PrefetchBuckets(keys + start, count, hashes);
+    for (size_t i = 0; i < count; ++i) {
+      found[start + i] = FindValue(keys[start + i], hashes[i], nullptr);
+    }
+  }
+}
+
+template <typename KeyType, typename ValueType, typename IndexPolicy,
+          typename LockType>
+void FineHashTable<KeyType, ValueType, IndexPolicy, LockType>::MultiInsert(
+    const KeyType *keys, const ValueType *values, size_t num_keys) {
+  size_t hashes[PREFETCH_BATCH];
+  for (size_t start = 0; start < num_keys; start += PREFETCH_BATCH) {
+    size_t count = std::min(PREFETCH_BATCH, num_keys - start);
+    EpochManager::Guard guard;
+    PrefetchBuckets(keys + start, count, hashes);
+    for (size_t i = 0; i < count; ++i) {
+      const ValueType &value = values[start + i];
+      Upsert(
+          hashes[i], keys[start + i], true,
+          [&value](ValueType &current, bool found) {
+            if (found) {
+              current = value;
+            }
+          },
+          value);
+    }
+  }
+}
+
+template <typename KeyType, typename ValueType, typename IndexPolicy,
+          typename LockType>
+void FineHashTable<KeyType, ValueType, IndexPolicy, LockType>::PrefetchBuckets(
+    const KeyType *keys, size_t num_keys, size_t *hashes) {
+  // Keys whose bucket is still in a table being migrated just take the miss
+  Table *table = table_.load();
+  size_t idx[PREFETCH_BATCH];
+  for (size_t i = 0; i < num_keys; ++i) {
+    hashes[i] = Hash(keys[i]);
+    idx[i] = HashToIndex(table, hashes[i]);
+    __builtin_prefetch(&table->buckets_[idx[i]]);
+    __builtin_prefetch(&GetStripe(idx[i]));
+  }
+  for (size_t i = 0; i < num_keys; ++i) {
+    table->buckets_[idx[i]].Prefetch();
+  }
+}
+
+template <typename KeyType, typename ValueType, typename IndexPolicy,
+          typename LockType>
+template <typename Search>
+bool FineHashTable<KeyType, ValueType, IndexPolicy, LockType>::SearchTables(
+    size_t hash, Search search) {
+  while (true) {
+    Table *table = table_.load(std::memory_order_acquire);
+    Table *old_table = table->old_.load(std::memory_order_acquire);
+    typename Bucket<KeyType, ValueType, LockType>::FindResult result;
+    if (old_table != nullptr) {
+      size_t idx = HashToIndex(old_table, hash);
+      result = search(old_table->buckets_[idx], hash, GetStripe(idx));
+      if (result != Bucket<KeyType, ValueType, LockType>::MIGRATED) {
+        return result == Bucket<KeyType, ValueType, LockType>::FOUND;
+      }
+    }
+    size_t idx = HashToIndex(table, hash);
+    result = search(table->buckets_[idx], hash, GetStripe(idx));
+    if (result != Bucket<KeyType, ValueType, LockType>::MIGRATED) {
+      return result == Bucket<KeyType, ValueType, LockType>::FOUND;
+    }
+    // The table itself started migrating into a newer one
+  }
+}
+
+template <typename KeyType, typename ValueType, typename IndexPolicy,
+          typename LockType>
+template <typename KeyArg, typename Fn, typename... Args>
+bool FineHashTable<KeyType, ValueType, IndexPolicy, LockType>::Upsert(
+    size_t hash, KeyArg &&key, bool insert, Fn fn, Args &&...args) {
+  EpochManager::Guard guard;
+  Table *table;
+  StripeLock<LockType> *stripe;
+  auto &bucket = LockBucket(hash, &table, &stripe);
+  bool found = bucket.UpsertKV(std::forward<KeyArg>(key), hash, insert, fn,
+                               *stripe, std::forward<Args>(args)...);
+  if (!found && insert) {
+    size_.Increment();
+  }
+  stripe->lock_.WriteUnlock();
+  if (table->old_.load(std::memory_order_acquire) != nullptr) {
+    HelpMigrate(table);
+  } else if (!found && insert &&
+             size_.Exceeds(table->capacity_ * max_load_factor_)) {
+    GrowHashTable(table);
+  }
+  return found;
+}
+
+template <typename KeyType, typename ValueType, typename IndexPolicy,
+          typename LockType>
+Bucket<KeyType, ValueType, LockType> &
+FineHashTable<KeyType, ValueType, IndexPolicy, LockType>::LockBucket(
+    size_t hash, Table **table, StripeLock<LockType> **stripe) {
+  while (true) {
+    *table = table_.load(std::memory_order_acquire);
+    Table *old_table = (*table)->old_.load(std::memory_order_acquire);
+    // The key lives in the old table until its bucket is migrated
+    if (old_table != nullptr) {
+      size_t idx = HashToIndex(old_table, hash);
+      *stripe = &GetStripe(idx);
+      stats_.WriteLock((*stripe)->lock_);
+      if (!old_table->buckets_[idx].IsMigrated()) {
+        return old_table->buckets_[idx];
+      }
+      (*stripe)->lock_.WriteUnlock();
+    }
+    size_t idx = HashToIndex(*table, hash);
+    *stripe = &GetStripe(idx);
+    stats_.WriteLock((*stripe)->lock_);
+    if (!(*table)->buckets_[idx].IsMigrated()) {
+      return (*table)->buckets_[idx];
+    }
+    // The table itself started migrating into a newer one
+    (*stripe)->lock_.WriteUnlock();
+  }
+}
+
+template <typename KeyType, typename ValueType, typename IndexPolicy,
+          typename LockType>
+void FineHashTable<KeyType, ValueType, IndexPolicy, LockType>::GrowHashTable(
+    Table *table) {
+  if (table_.load() != table) {
     return;
   }
-  size_t old_capacity = capacity_;
-  capacity_ *= 2;
-  auto new_table = new Bucket<KeyType, ValueType>[capacity_];
-  for (size_t idx = 0; idx < old_capacity; ++idx) {
-    for (const auto &entry : table_[idx].GetKVList()) {
-      size_t new_idx = KeyToIndex(entry.key_);
-      new_table[new_idx].GetKVList().emplace_back(entry.key_, entry.value_);
+  auto new_table = new Table(table->capacity_ * 2, table);
+  new_table->grow_start_ = StatsCounters::Now();
+  if (!table_.compare_exchange_strong(table, new_table)) {
+    // Another thread already grew the hash table
+    new_table->old_.store(nullptr, std::memory_order_relaxed);
+    delete new_table;
+    return;
+  }
+  HelpMigrate(new_table);
+}
+
+template <typename KeyType, typename ValueType, typename IndexPolicy,
+          typename LockType>
+void FineHashTable<KeyType, ValueType, IndexPolicy, LockType>::HelpMigrate(
+    Table *table) {
+  Table *old_table = table->old_.load(std::memory_order_acquire);
+  if (old_table == nullptr) {
+    return;
+  }
+  for (size_t n = 0; n < MIGRATION_BATCH; ++n) {
+    size_t idx = table->next_migration_.fetch_add(1);
+    if (idx >= old_table->capacity_) {
+      return;
+    }
+    MigrateBucket(table, old_table, idx);
+    if (table->num_migrated_.fetch_add(1) + 1 == old_table->capacity_) {
+      // Readers may still be scanning the old table; it is freed once they
+      // are done
+      table->old_.store(nullptr, std::memory_order_release);
+      EpochManager::Instance().Retire(old_table);
+      stats_.AddResize(table->grow_start_);
+      return;
     }
   }
+}
 
-  delete[] table_;
-  table_ = new_table;
-  global_lock_.WriteUnlock();
-}
\ No newline at end of file
+template <typename KeyType, typename ValueType, typename IndexPolicy,
+          typename LockType>
+void FineHashTable<KeyType, ValueType, IndexPolicy, LockType>::MigrateBucket(
+    Table *table, Table *old_table, size_t idx) {
+  // New bucket `idx` shares the stripe of old bucket `idx`; new bucket
+  // `idx + capacity` may not. Stripes are locked in address order
+  StripeLock<LockType> *first = &GetStripe(idx);
+  StripeLock<LockType> *second = &GetStripe(idx + old_table->capacity_);
+  StripeLock<LockType> *lower = std::min(first, second);
+  StripeLock<LockType> *upper = std::max(first, second);
+  stats_.WriteLock(lower->lock_);
+  if (upper != lower) {
+    stats_.WriteLock(upper->lock_);
+  }
+
+  // Only readers of the old bucket need to notice: the new buckets are not
+  // read until the old one is marked as migrated
+  first->BeginWrite();
+  Bucket<KeyType, ValueType, LockType> &old_bucket = old_table->buckets_[idx];
+  for (auto &entry : old_bucket.GetKVList()) {
+    // A cached hash spares hashing every key while both stripes are locked.
+    // Readers that take the lock never look at a migrated bucket, so its
+    // entries are moved; optimistic readers only exist for trivially
+    // copyable entries, which moving leaves intact
+    size_t hash = entry.Hash(entry.key_);
+    table->buckets_[HashToIndex(table, hash)].GetKVList().push_back(
+        std::move(entry));
+  }
+  old_bucket.SetMigrated();
+  first->EndWrite();
+
+  if (upper != lower) {
+    upper->lock_.WriteUnlock();
+  }
+  lower->lock_.WriteUnlock();
+}
+
+template <typename KeyType, typename ValueType, typename IndexPolicy,
+          typename LockType>
+TableStats FineHashTable<KeyType, ValueType, IndexPolicy, LockType>::Stats() {
+  TableStats stats;
+  stats_.Collect(&stats);
+  stats.size_ = size_.Load();
+  EpochManager::Guard guard;
+  Table *table = table_.load(std::memory_order_acquire);
+  stats.capacity_ = table->capacity_;
+  // During a migration, the chains are split between the two tables
+  for (Table *t : {table->old_.load(std::memory_order_acquire), table}) {
+    for (size_t idx = 0; t != nullptr && idx < t->capacity_; ++idx) {
+      StripeLock<LockType> &stripe = GetStripe(idx);
+      Bucket<KeyType, ValueType, LockType> &bucket = t->buckets_[idx];
+      stripe.lock_.ReadLock();
+      if (!bucket.IsMigrated()) {
+        stats.max_chain_length_ =
+            std::max(stats.max_chain_length_, bucket.GetKVList().size());
+      }
+      stripe.lock_.ReadUnlock();
+    }
+  }
+  return stats;
+}
@@ -2,79 +2,241 @@
 #define FINE_HASH_TABLE_H_
 
 
+#include <algorithm>
 #include <atomic>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
+#include "epoch_manager.h"
+#include "index_policy.h"
+#include "key_traits.h"
 #include "rwlock.h"
+#include "sharded_counter.h"
+#include "table_stats.h"
 
 /**
- * Bucket object of a hash table
+ * Reader/writer lock shared by a stripe of buckets, together with a version
+ * counter that is odd while a writer modifies one of those buckets. Padded to
+ * a cache line so that neighbouring stripes do not false-share
  */
-template <typename KeyType, typename ValueType>
+template <typename LockType = ReaderWriterLock>
+struct alignas(64) StripeLock {
+  LockType lock_;
+  std::atomic<uint64_t> version_{0};
+
+  /**
+   * Marks the start of a modification (the caller holds the write lock)
+   */
+  void BeginWrite() {
+    version_.store(version_.load(std::memory_order_relaxed) + 1,
+                   std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+  }
+
+  /**
+   * Marks the end of a modification (the caller holds the write lock)
+   */
+  void EndWrite() {
+    version_.store(version_.load(std::memory_order_relaxed) + 1,
+                   std::memory_order_release);
+  }
+};
+
+/**
+ * Bucket object of a hash table.
+ *
+ * A bucket has no lock of its own; it is guarded by the StripeLock its table
+ * maps it to, which the caller passes in. Writers hold the stripe's write
+ * lock and make its version odd while they modify the chain. For trivially
+ * copyable keys and values, readers first try to scan the chain without any
+ * lock, validating the version before and after; they only take the read lock
+ * after repeated conflicts. The chain's storage is freed through the epoch
+ * manager, so the caller must hold an EpochManager::Guard around FindKV.
+ *
+ * Once its entries have been moved into a grown table, a bucket is marked
+ * as migrated and must no longer be read or modified.
+ */
+template <typename KeyType, typename ValueType,
+          typename LockType = ReaderWriterLock>
 class Bucket {
  private:
-  struct Entry {
+  // Copying a half-written key or value is only harmless for plain bytes
+  static constexpr bool OPTIMISTIC_READS =
+      std::is_trivially_copyable_v<KeyType> &&
+      std::is_trivially_copyable_v<ValueType>;
+
+  // The hash of the key is stored in the entry if CacheKeyHash is set
+  struct Entry : CachedHash<KeyType> {
     KeyType key_;
     ValueType value_;
 
     Entry() = default;
     /**
      * Creates an Entry instance
-     * @param key the key of the entry
-     * @param value the value of the entry
+     * @param hash the hash of the key
+     * @param key the key of the entry, moved in if an rvalue
+     * @param args the arguments of the value's constructor
      */
-    Entry(const KeyType &key, const ValueType &value)
-        : key_(key), value_(value) {}
+    template <typename KeyArg, typename... Args>
+    Entry(size_t hash, KeyArg &&key, Args &&...args)
+        : CachedHash<KeyType>(hash),
+          key_(std::forward<KeyArg>(key)),
+          value_(std::forward<Args>(args)...) {}
   };
 
+  using EntryAllocator =
+      std::conditional_t<OPTIMISTIC_READS, EpochAllocator<Entry>,
+                         std::allocator<Entry>>;
+
  public:
-  /**
-   * Copy assignment operator
-   * @param other the bucket to copy from
-   * @return a reference to this bucket
-   */
-  Bucket& operator=(Bucket &other);
+  // Outcomes of FindKV
+  enum FindResult {
+    FOUND,      // the key is in this bucket
+    NOT_FOUND,  // the key is not in this bucket
+    MIGRATED,   // the bucket was migrated; search the grown table instead
+  };
 
   /**
-   * Gets the value of a key within the current bucket
-   * @param key the key to retrieve
-   * @return the value of that key
+   * Searches the current bucket for a key
+   * @param key the key to search
+   * @param hash the hash of the key
+   * @param stripe the lock guarding this bucket
+   * @param stats the counters of the table, for retries and lock waits
+   * @param[out] value the value of that key, if not nullptr
+   * @return the outcome of the search
    */
-  ValueType GetKV(const KeyType &key);
+  template <typename LookupKey>
+  FindResult FindKV(const LookupKey &key, size_t hash,
+                    StripeLock<LockType> &stripe, const StatsCounters &stats,
+                    ValueType *value);
 
   /**
-   * Checks if the current bucket has a specified key
-   * @param key the key to check
-   * @return true if this bucket contains that key; otherwise, returns false
+   * Calls a function on the value of a key in this bucket, in place under the
+   * read lock of its stripe
+   * @param key the key to search
+   * @param hash the hash of the key
+   * @param stripe the lock guarding this bucket
+   * @param stats the counters of the table, for lock waits
+   * @param fn called with a const reference to the value of that key
+   * @return the outcome of the search
    */
-  bool ContainsKV(const KeyType &key);
+  template <typename LookupKey, typename Fn>
+  FindResult VisitKV(const LookupKey &key, size_t hash,
+                     StripeLock<LockType> &stripe, const StatsCounters &stats,
+                     Fn &fn);
 
   /**
-   * Inserts a key-value pair into this bucket
-   * @param key the key to insert
-   * @param value the value to insert
+   * Writes the value of a key in this bucket, inserting the key first if
+   * asked to
+   * @param key the key to write, moved into a new entry if an rvalue
+   * @param hash the hash of the key
+   * @param insert whether to insert the key if it is not in this bucket
+   * @param fn called as fn(value, found), see FineHashTable::Upsert
+   * @param stripe the lock guarding this bucket, write-locked by the caller
+   * @param args the arguments of the constructor of an inserted value
+   * @return true if the key was in this bucket; otherwise, false
    */
-  bool InsertKV(const KeyType &key, const ValueType &value);
+  template <typename KeyArg, typename Fn, typename... Args>
+  bool UpsertKV(KeyArg &&key, size_t hash, bool insert, Fn fn,
+                StripeLock<LockType> &stripe, Args &&...args);
 
   /**
    * Deletes a key-value pair from this bucket
    * @param key the key to delete
+   * @param hash the hash of the key
+   * @param stripe the lock guarding this bucket, write-locked by the caller
+   */
+  template <typename LookupKey>
+  bool DeleteKV(const LookupKey &key, size_t hash,
+                StripeLock<LockType> &stripe);
+
+  std::vector<Entry, EntryAllocator>& GetKVList() { return list_; }
+
+  /**
+   * Hints the processor to start loading the first entries of the chain.
+   * Only done when readers scan the chain without a lock anyway
    */
-  bool DeleteKV(const KeyType &key);
+  void Prefetch() const {
+    if constexpr (OPTIMISTIC_READS) {
+      __builtin_prefetch(list_.data());
+    }
+  }
 
-  std::vector<Entry>& GetKVList() { return list_; }
+  bool IsMigrated() const {
+    return migrated_.load(std::memory_order_acquire);
+  }
+
+  /**
+   * Marks this bucket as migrated (the caller holds the stripe's write lock)
+   */
+  void SetMigrated() { migrated_.store(true, std::memory_order_release); }
 
  private:
-  ReaderWriterLock lock_; // the private lock of each bucket
-  std::vector<Entry> list_; // a chain within each bucket (use vector for better locality)
+  /**
+   * Searches this bucket without taking its lock
+   * @param key the key to search
+   * @param hash the hash of the key
+   * @param stripe the lock guarding this bucket
+   * @param[out] value the value of that key, if not nullptr
+   * @param[out] result the outcome of the search
+   * @return true if the scan did not overlap with a writer; otherwise, false
+   */
+  template <typename LookupKey>
+  bool ReadOptimistic(const LookupKey &key, size_t hash,
+                      const StripeLock<LockType> &stripe, ValueType *value,
+                      FindResult *result) const;
+
+  // Optimistic attempts before a reader falls back to the lock
+  static constexpr int OPTIMISTIC_RETRIES{4};
+
+  std::vector<Entry, EntryAllocator> list_; // a chain within each bucket (use vector for better locality)
+  std::atomic<bool> migrated_{false}; // whether the entries moved to a grown table
 };
 
 
 /**
- * Fine-grained hash table where each bucket has its own reader/writer lock
+ * Fine-grained hash table with lock striping: bucket `i` is guarded by stripe
+ * `i % num_stripes` of a fixed array of locks, so lock memory does not grow
+ * with the table. IndexPolicy maps a key's hash to a bucket and LockType is
+ * the lock of each stripe (see CoarseHashTable).
+ *
+ * Growing is incremental. A table twice as large is published with a link
+ * to the old one, and every Insert/Delete then migrates a few old buckets
+ * into it. Old bucket `j` only feeds new buckets `j` and `j + capacity`, so
+ * migrating it needs at most two stripes. Until a bucket is migrated, its
+ * keys are read and written in the old table; afterwards in the new one. The
+ * old table is freed by the epoch manager once every bucket has moved.
  */
-template <typename KeyType, typename ValueType>
+template <typename KeyType, typename ValueType,
+          typename IndexPolicy = ModuloIndex,
+          typename LockType = ReaderWriterLock>
 class FineHashTable {
+ private:
+  /**
+   * An array of buckets together with its size, swapped as a whole on growth
+   */
+  struct Table {
+    size_t capacity_;                                // number of buckets
+    Bucket<KeyType, ValueType, LockType> *buckets_;  // array of buckets
+    // The table being migrated into this one, nullptr once it is done
+    std::atomic<Table *> old_{nullptr};
+    std::atomic<size_t> next_migration_{0};  // next old bucket to migrate
+    std::atomic<size_t> num_migrated_{0};    // number of old buckets migrated
+    uint64_t grow_start_{0};  // when the migration started, for the stats
+
+    explicit Table(size_t capacity, Table *old = nullptr)
+        : capacity_(capacity),
+          buckets_(new Bucket<KeyType, ValueType, LockType>[capacity]),
+          old_(old) {}
+    ~Table() {
+      delete[] buckets_;
+      delete old_.load();
+    }
+  };
+
  public:
   /**
    * Default constructor
@@ -86,74 +248,365 @@ class FineHashTable {
    * @param capacity the maximum bucket in the hash table
    * @param max_load_factor the maximum load factor (the average number of
    * elements per bucket)
+   * @param num_stripes the number of locks shared by the buckets (rounded up
+   * to a power of two)
    */
-  FineHashTable(size_t capacity, float max_load_factor)
-      : capacity_(capacity),
-        max_load_factor_(max_load_factor),
-        table_(new Bucket<KeyType, ValueType>[capacity_]) {}
+  FineHashTable(size_t capacity, float max_load_factor,
+                size_t num_stripes = DEFAULT_NUM_STRIPES)
+      : max_load_factor_(max_load_factor),
+        table_(new Table(IndexPolicy::RoundCapacity(capacity))),
+        num_stripes_(MaskIndex::RoundCapacity(num_stripes)),
+        stripes_(new StripeLock<LockType>[num_stripes_]) {}
 
   /**
    * Destroys an existing FineHashTable instance
    */
   ~FineHashTable();
 
-  size_t size() const { return size_; }
+  size_t size() const { return size_.Load(); }
 
   /**
    * Gets the value of a key-value pair
    * @param key the key of the key-value pair
    * @return the value of that key
    */
-  ValueType Get(const KeyType &key);
+  ValueType Get(const KeyType &key) { return Get<KeyType>(key); }
+
+  /**
+   * Gets the value of a key-value pair by a key of another type (see KeyHash)
+   * @param key the key of the key-value pair
+   * @return the value of that key
+   */
+  template <typename LookupKey,
+            typename = EnableIfLookupKey<KeyType, LookupKey>>
+  ValueType Get(const LookupKey &key);
+
+  /**
+   * Gets the value of a key-value pair, if the key exists
+   * @param key the key of the key-value pair
+   * @return the value of that key, or std::nullopt if the key does not exist
+   */
+  std::optional<ValueType> TryGet(const KeyType &key) {
+    return TryGet<KeyType>(key);
+  }
+
+  /**
+   * Gets the value of a key-value pair by a key of another type (see
+   * KeyHash), if the key exists
+   * @param key the key of the key-value pair
+   * @return the value of that key, or std::nullopt if the key does not exist
+   */
+  template <typename LookupKey,
+            typename = EnableIfLookupKey<KeyType, LookupKey>>
+  std::optional<ValueType> TryGet(const LookupKey &key);
+
+  /**
+   * Calls a function on the value of a key-value pair
+   * @param key the key of the key-value pair
+   * @param fn called with a const reference to the value, in place under the
+   * read lock of its bucket; it must not access the hash table
+   * @return true if the key exists; otherwise, false
+   */
+  template <typename Fn>
+  bool Find(const KeyType &key, Fn fn) {
+    return Find<KeyType, Fn>(key, fn);
+  }
+
+  /**
+   * Calls a function on the value of a key-value pair, found by a key of
+   * another type (see KeyHash)
+   * @param key the key of the key-value pair
+   * @param fn called with a const reference to the value, in place under the
+   * read lock of its bucket; it must not access the hash table
+   * @return true if the key exists; otherwise, false
+   */
+  template <typename LookupKey, typename Fn,
+            typename = EnableIfLookupKey<KeyType, LookupKey>>
+  bool Find(const LookupKey &key, Fn fn);
 
   /**
    * Checks if a key exists in the hash table
    * @param key the key to check
    * @return true if that key exists; otherwise, false
    */
-  bool Contains(const KeyType &key);
+  bool Contains(const KeyType &key) { return Contains<KeyType>(key); }
+
+  /**
+   * Checks if a key exists in the hash table, by a key of another type
+   * (see KeyHash)
+   * @param key the key to check
+   * @return true if that key exists; otherwise, false
+   */
+  template <typename LookupKey,
+            typename = EnableIfLookupKey<KeyType, LookupKey>>
+  bool Contains(const LookupKey &key);
 
   /**
    * Inserts a key-value pair into the hash table
    * @param key the key to insert
    * @param value the value to insert
    */
-  void Insert(const KeyType &key, const ValueType &value);
+  void Insert(const KeyType &key, const ValueType &value) {
+    InsertOrAssign(key, value);
+  }
+
+  /**
+   * Inserts a key-value pair into the hash table, moving the key and value in
+   * @param key the key to insert
+   * @param value the value to insert
+   */
+  void Insert(KeyType key, ValueType &&value) {
+    InsertOrAssign(std::move(key), std::move(value));
+  }
+
+  /**
+   * Inserts a key-value pair, or assigns the value if the key exists
+   * @param key the key to insert
+   * @param value the value to insert or assign
+   * @return true if the key was inserted; false if it existed
+   */
+  bool InsertOrAssign(const KeyType &key, const ValueType &value);
+
+  /**
+   * Inserts a key-value pair, or assigns the value if the key exists, moving
+   * the key and value in
+   * @param key the key to insert
+   * @param value the value to insert or assign
+   * @return true if the key was inserted; false if it existed
+   */
+  bool InsertOrAssign(KeyType key, ValueType &&value);
+
+  /**
+   * Inserts a key-value pair only if the key does not exist
+   * @param key the key to insert
+   * @param value the value to insert
+   * @param[out] existing the value of the key if it exists, if not nullptr
+   * @return true if the key was inserted; false if it existed
+   */
+  bool TryEmplace(const KeyType &key, const ValueType &value,
+                  ValueType *existing = nullptr);
+
+  /**
+   * Inserts a key-value pair only if the key does not exist, moving the key
+   * and value in. The value is left alone if the key exists
+   * @param key the key to insert
+   * @param value the value to insert
+   * @param[out] existing the value of the key if it exists, if not nullptr
+   * @return true if the key was inserted; false if it existed
+   */
+  bool TryEmplace(KeyType key, ValueType &&value,
+                  ValueType *existing = nullptr);
+
+  /**
+   * Inserts a key with a value constructed in place from some arguments,
+   * only if the key does not exist; the value is not constructed otherwise
+   * @param key the key to insert
+   * @param args the arguments of the value's constructor
+   * @return true if the key was inserted; false if it existed
+   */
+  template <typename... Args>
+  bool Emplace(KeyType key, Args &&...args);
+
+  /**
+   * Atomically modifies the value of a key if it exists
+   * @param key the key to update
+   * @param fn called with a reference to the value, under the write lock of
+   * its bucket; it must not access the hash table
+   * @return true if the key exists; otherwise, false
+   */
+  template <typename Fn>
+  bool Update(const KeyType &key, Fn fn);
+
+  /**
+   * Atomically modifies the value of a key, inserting the key with a
+   * value-initialized value first if it does not exist
+   * @param key the key to update
+   * @param fn called with a reference to the value, under the write lock of
+   * its bucket; it must not access the hash table
+   * @return the modified value
+   */
+  template <typename Fn>
+  ValueType Compute(const KeyType &key, Fn fn);
 
   /**
    * Deletes a key-value pair from the hash table
    * @param key the key to delete
    */
-  void Delete(const KeyType &key);
+  void Delete(const KeyType &key) { Delete<KeyType>(key); }
+
+  /**
+   * Deletes a key-value pair from the hash table by a key of another type
+   * (see KeyHash)
+   * @param key the key to delete
+   */
+  template <typename LookupKey,
+            typename = EnableIfLookupKey<KeyType, LookupKey>>
+  void Delete(const LookupKey &key);
+
+  /**
+   * Gets the values of several keys. The buckets of a group of keys are
+   * prefetched before any of them is searched, so their cache misses overlap
+   * @param keys the keys to look up
+   * @param num_keys the number of keys
+   * @param[out] values the value of each key (a default value if absent)
+   */
+  void MultiGet(const KeyType *keys, size_t num_keys, ValueType *values);
+
+  /**
+   * Checks which of several keys exist in the hash table
+   * @param keys the keys to check
+   * @param num_keys the number of keys
+   * @param[out] found whether each key exists
+   */
+  void MultiContains(const KeyType *keys, size_t num_keys, bool *found);
+
+  /**
+   * Inserts several key-value pairs into the hash table
+   * @param keys the keys to insert
+   * @param values the value of each key
+   * @param num_keys the number of key-value pairs
+   */
+  void MultiInsert(const KeyType *keys, const ValueType *values,
+                   size_t num_keys);
+
+  /**
+   * Gets the runtime statistics of the hash table (see TableStats). A resize
+   * lasts from the start of the growth until the last bucket is migrated
+   * @return a snapshot of the statistics
+   */
+  TableStats Stats();
 
  private:
   /**
-   * Calculates the index into the hash table given a key
-   * @param key the key to calculate index from
+   * Calculates the hash of a key, once per operation whatever the number of
+   * tables searched
+   * @param key the key to hash
+   * @return the hash of that key
+   */
+  template <typename LookupKey>
+  static size_t Hash(const LookupKey &key) {
+    return KeyHash<KeyType>{}(key);
+  }
+
+  /**
+   * Calculates the index into the hash table given the hash of a key
+   * @param table the table to index
+   * @param hash the hash to calculate index from
    * @return the index into the hash table
    */
-  size_t KeyToIndex(const KeyType &key) const {
-    return std::hash<KeyType>{}(key) % capacity_;
+  static size_t HashToIndex(const Table *table, size_t hash) {
+    return IndexPolicy::Index(hash, table->capacity_);
+  }
+
+  /**
+   * Gets the lock guarding a bucket
+   * @param idx the index of the bucket
+   * @return the stripe of that bucket
+   */
+  StripeLock<LockType> &GetStripe(size_t idx) {
+    return stripes_[idx & (num_stripes_ - 1)];
   }
 
   /**
-   * Grows the hash table (doubles the number of buckets) when the hash table
-   * gets dense
+   * Prefetches the buckets of a group of keys in two passes: the bucket
+   * headers and their stripes first, then the chains they point to. The
+   * caller must hold an EpochManager::Guard
+   * @param keys the keys whose buckets to prefetch
+   * @param num_keys the number of keys, at most PREFETCH_BATCH
+   * @param[out] hashes the hash of each key, for the searches that follow
    */
-  void GrowHashTable();
+  void PrefetchBuckets(const KeyType *keys, size_t num_keys, size_t *hashes);
+
+  /**
+   * Searches the bucket of a key in whichever table holds it. The caller
+   * must hold an EpochManager::Guard
+   * @param hash the hash of the key
+   * @param search called as search(bucket, hash, stripe) on a bucket that
+   * may hold the key, returning the Bucket::FindResult of searching it
+   * @return true if the key is found; otherwise, false
+   */
+  template <typename Search>
+  bool SearchTables(size_t hash, Search search);
+
+  /**
+   * Searches the bucket of a key in whichever table holds it, copying out
+   * the value. The caller must hold an EpochManager::Guard
+   * @param key the key to search
+   * @param hash the hash of that key
+   * @param[out] value the value of that key, if not nullptr
+   * @return true if the key is found; otherwise, false
+   */
+  template <typename LookupKey>
+  bool FindValue(const LookupKey &key, size_t hash, ValueType *value) {
+    return SearchTables(hash, [&](auto &bucket, size_t, auto &stripe) {
+      return bucket.FindKV(key, hash, stripe, stats_, value);
+    });
+  }
+
+  /**
+   * Runs a write on the value of a key under the write lock of its bucket.
+   * Every write operation goes through here, so the key is searched only once
+   * @param hash the hash of the key
+   * @param key the key to write, moved into a new entry if an rvalue
+   * @param insert whether to insert the key if it does not exist
+   * @param fn called as fn(value, found) with a reference to the value of the
+   * key and whether it existed; not called if the key is absent and not
+   * inserted
+   * @param args the arguments of the constructor of an inserted value (none
+   * to value-initialize it)
+   * @return true if the key existed; otherwise, false
+   */
+  template <typename KeyArg, typename Fn, typename... Args>
+  bool Upsert(size_t hash, KeyArg &&key, bool insert, Fn fn,
+              Args &&...args);
+
+  /**
+   * Write-locks the bucket of a key in whichever table holds it. The caller
+   * must hold an EpochManager::Guard
+   * @param hash the hash of the key whose bucket to lock
+   * @param[out] table the current table
+   * @param[out] stripe the stripe guarding the bucket, now write-locked
+   * @return the bucket
+   */
+  Bucket<KeyType, ValueType, LockType> &LockBucket(
+      size_t hash, Table **table, StripeLock<LockType> **stripe);
+
+  /**
+   * Migrates up to MIGRATION_BATCH buckets of the table being migrated into
+   * `table`, and retires it once every bucket has moved
+   * @param table the table being filled
+   */
+  void HelpMigrate(Table *table);
+
+  /**
+   * Moves the entries of one old bucket into the grown table
+   * @param table the grown table
+   * @param old_table the table being migrated
+   * @param idx the index of the old bucket
+   */
+  void MigrateBucket(Table *table, Table *old_table, size_t idx);
+  /**
+   * Starts growing the hash table (doubling the number of buckets) when the
+   * hash table gets dense
+   * @param table the table that got dense
+   */
+  void GrowHashTable(Table *table);
 
   // Default hash table size
   static constexpr size_t DEFAULT_CAPACITY{128};
   static constexpr float DEFAULT_LOAD_FACTOR{0.75};
+  static constexpr size_t DEFAULT_NUM_STRIPES{256};
+  // Number of old buckets migrated by each Insert/Delete during growth
+  static constexpr size_t MIGRATION_BATCH{8};
+  // Number of keys of a batch operation whose buckets are prefetched together
+  static constexpr size_t PREFETCH_BATCH{16};
 
-  size_t capacity_;                    // number of buckets
   float max_load_factor_;
-  std::atomic<size_t> size_{0};  // number of key-value pairs in the hash table
-  Bucket<KeyType, ValueType> *table_;  // array of buckets
-
-  // One global reader/writer lock: a writer lock is used when growing the hash
-  // table while other procedures use a reader lock
-  ReaderWriterLock global_lock_;
+  ShardedCounter size_;          // number of key-value pairs in the hash table
+  std::atomic<Table *> table_;   // current array of buckets
+  size_t num_stripes_;           // number of locks (a power of two)
+  StripeLock<LockType> *stripes_;  // array of locks shared by the buckets
+  StatsCounters stats_;  // event counters, empty without TABLE_STATS
 };
 
 #include "fine_hash_table.cpp"
@@ -0,0 +1,377 @@
+#include "hopscotch_hash_table.h"
+
+template <typename KeyType, typename ValueType>
+HopscotchHashTable<KeyType, ValueType>::HopscotchHashTable(
+    size_t capacity, float max_load_factor)
+    : max_load_factor_(max_load_factor) {
+  table_ = new Table(MaskIndex::RoundCapacity(capacity));
+}
+
+template <typename KeyType, typename ValueType>
+HopscotchHashTable<KeyType, ValueType>::~HopscotchHashTable() {
+  resize_lock_.WriteLock();
+  delete table_.load();
+  resize_lock_.WriteUnlock();
+}
+
+template <typename KeyType, typename ValueType>
+template <typename LookupKey, typename>
+ValueType HopscotchHashTable<KeyType, ValueType>::Get(const LookupKey &key) {
+  // The epoch keeps a table replaced by Rebuild alive while we probe it
+  EpochManager::Guard guard;
+  ValueType value{};
+  FindOptimistic(table_.load(std::memory_order_acquire), key, &value);
+  return value;
+}
+
+template <typename KeyType, typename ValueType>
+template <typename LookupKey, typename>
+std::optional<ValueType> HopscotchHashTable<KeyType, ValueType>::TryGet(
+    const LookupKey &key) {
+  EpochManager::Guard guard;
+  ValueType value{};
+  if (!FindOptimistic(table_.load(std::memory_order_acquire), key, &value)) {
+    return std::nullopt;
+  }
+  return value;
+}
+
+template <typename KeyType, typename ValueType>
+template <typename LookupKey, typename Fn, typename>
+bool HopscotchHashTable<KeyType, ValueType>::Find(
+    const LookupKey &key, Fn fn) {
+  // Readers never lock, so the function gets a validated copy
+  std::optional<ValueType> value = TryGet<LookupKey>(key);
+  if (value.has_value()) {
+    fn(std::as_const(*value));
+  }
+  return value.has_value();
+}
+
+template <typename KeyType, typename ValueType>
+template <typename LookupKey, typename>
+bool HopscotchHashTable<KeyType, ValueType>::Contains(const LookupKey &key) {
+  EpochManager::Guard guard;
+  return FindOptimistic(table_.load(std::memory_order_acquire), key, nullptr);
+}
+
+template <typename KeyType, typename ValueType>
+bool HopscotchHashTable<KeyType, ValueType>::InsertOrAssign(
+    const KeyType &key, const ValueType &value) {
+  return !Upsert(key, true,
+                 [&value](ValueType &current, bool) { current = value; });
+}
+
+template <typename KeyType, typename ValueType>
+bool HopscotchHashTable<KeyType, ValueType>::TryEmplace(
+    const KeyType &key, const ValueType &value, ValueType *existing) {
+  return !Upsert(key, true, [&](ValueType &current, bool found) {
+    if (!found) {
+      current = value;
+    } else if (existing != nullptr) {
+      *existing = current;
+    }
+  });
+}
+
+template <typename KeyType, typename ValueType>
+template <typename Fn>
+bool HopscotchHashTable<KeyType, ValueType>::Update(
+    const KeyType &key, Fn fn) {
+  return Upsert(key, false, [&fn](ValueType &current, bool) { fn(current); });
+}
+
+template <typename KeyType, typename ValueType>
+template <typename Fn>
+ValueType HopscotchHashTable<KeyType, ValueType>::Compute(
+    const KeyType &key, Fn fn) {
+  ValueType result{};
+  Upsert(key, true, [&](ValueType &current, bool) {
+    fn(current);
+    result = current;
+  });
+  return result;
+}
+
+template <typename KeyType, typename ValueType>
+template <typename Fn>
+bool HopscotchHashTable<KeyType, ValueType>::Upsert(
+    const KeyType &key, bool insert, Fn fn) {
+  while (true) {
+    stats_.ReadLock(resize_lock_);
+    Table *table = table_.load(std::memory_order_acquire);
+    WriteResult result = UpsertSlot(table, key, insert, fn);
+    if (result == INSERTED) {
+      size_.Increment();
+    }
+    bool grow =
+        result == NO_SLOT ||
+        (result == INSERTED &&
+         size_.Exceeds(table->num_buckets_ * max_load_factor_));
+    resize_lock_.ReadUnlock();
+
+    if (grow) {
+      Rebuild(table);
+    }
+    if (result != NO_SLOT) {
+      return result == UPDATED;
+    }
+  }
+}
+
+template <typename KeyType, typename ValueType>
+template <typename LookupKey, typename>
+void HopscotchHashTable<KeyType, ValueType>::Delete(const LookupKey &key) {
+  stats_.ReadLock(resize_lock_);
+  WriteResult result = DeleteSlot(table_.load(std::memory_order_acquire), key);
+  resize_lock_.ReadUnlock();
+  if (result == UPDATED) {
+    size_.Decrement();
+  }
+}
+
+template <typename KeyType, typename ValueType>
+template <typename LookupKey>
+bool HopscotchHashTable<KeyType, ValueType>::ScanNeighborhood(
+    const Table *table, size_t home, const LookupKey &key, size_t *slot) {
+  for (uint64_t hop = table->buckets_[home].hop_info_; hop != 0;
+       hop &= hop - 1) {
+    size_t idx = home + __builtin_ctzll(hop);
+    if (KeyEqual<KeyType>{}(table->buckets_[idx].key_, key)) {
+      *slot = idx;
+      return true;
+    }
+  }
+  return false;
+}
+
+template <typename KeyType, typename ValueType>
+uint64_t HopscotchHashTable<KeyType, ValueType>::ReadBegin(
+    const Segment &segment) {
+  uint64_t version;
+  while ((version = segment.version_.load(std::memory_order_acquire)) & 1) {
+    std::this_thread::yield();
+  }
+  return version;
+}
+
+template <typename KeyType, typename ValueType>
+bool HopscotchHashTable<KeyType, ValueType>::ReadValidate(
+    const Segment &segment, uint64_t version) {
+  // Orders the plain reads of the buckets before the second version read
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return segment.version_.load(std::memory_order_relaxed) == version;
+}
+
+template <typename KeyType, typename ValueType>
+void HopscotchHashTable<KeyType, ValueType>::LockSegment(
+    Segment &segment) const {
+  bool waited = false;
+  uint64_t start = 0;
+  uint64_t version = segment.version_.load(std::memory_order_relaxed);
+  while ((version & 1) ||
+         !segment.version_.compare_exchange_weak(version, version + 1,
+                                                 std::memory_order_acquire)) {
+    if (!waited) {
+      waited = true;
+      start = StatsCounters::Now();
+    }
+    std::this_thread::yield();
+    version = segment.version_.load(std::memory_order_relaxed);
+  }
+  if (waited) {
+    stats_.AddLockWait(start);
+  }
+  // Keeps the writes to the buckets from becoming visible before the odd
+  // version
+  std::atomic_thread_fence(std::memory_order_release);
+}
+
+template <typename KeyType, typename ValueType>
+void HopscotchHashTable<KeyType, ValueType>::UnlockSegments(Table *table,
+                                                            size_t first,
+                                                            size_t last) {
+  for (size_t i = first; i <= last; ++i) {
+    table->segments_[i].version_.fetch_add(1, std::memory_order_release);
+  }
+}
+
+template <typename KeyType, typename ValueType>
+template <typename LookupKey>
+bool HopscotchHashTable<KeyType, ValueType>::FindOptimistic(
+    const Table *table, const LookupKey &key, ValueType *value) const {
+  size_t home = HomeBucket(table, key);
+  const Segment &first = table->segments_[home / SEGMENT_SIZE];
+  const Segment &last =
+      table->segments_[(home + NEIGHBORHOOD - 1) / SEGMENT_SIZE];
+  while (true) {
+    uint64_t first_version = ReadBegin(first);
+    uint64_t last_version = ReadBegin(last);
+    size_t slot;
+    bool found = ScanNeighborhood(table, home, key, &slot);
+    ValueType copy{};
+    if (found && value != nullptr) {
+      copy = table->buckets_[slot].value_;
+    }
+    if (!ReadValidate(first, first_version) ||
+        !ReadValidate(last, last_version)) {
+      stats_.Add(StatsCounters::READ_RETRIES);
+      continue;
+    }
+    if (found && value != nullptr) {
+      *value = copy;
+    }
+    return found;
+  }
+}
+
+template <typename KeyType, typename ValueType>
+bool HopscotchHashTable<KeyType, ValueType>::HopBack(Table *table,
+                                                     size_t *free) {
+  Bucket *buckets = table->buckets_;
+  // The farthest home first, so that the key moves as far as possible
+  for (size_t home = *free - NEIGHBORHOOD + 1; home < *free; ++home) {
+    // Only keys stored before the free bucket can move into it
+    uint64_t hop =
+        buckets[home].hop_info_ & ((uint64_t{1} << (*free - home)) - 1);
+    if (hop == 0) {
+      continue;
+    }
+    size_t from = home + __builtin_ctzll(hop);
+    buckets[*free].key_ = buckets[from].key_;
+    buckets[*free].value_ = buckets[from].value_;
+    buckets[*free].occupied_ = true;
+    buckets[home].hop_info_ |= uint64_t{1} << (*free - home);
+    buckets[home].hop_info_ &= ~(uint64_t{1} << (from - home));
+    buckets[from].occupied_ = false;
+    *free = from;
+    return true;
+  }
+  return false;
+}
+
+template <typename KeyType, typename ValueType>
+template <typename Fn>
+typename HopscotchHashTable<KeyType, ValueType>::WriteResult
+HopscotchHashTable<KeyType, ValueType>::UpsertSlot(Table *table,
+                                                   const KeyType &key,
+                                                   bool insert, Fn &fn) {
+  Bucket *buckets = table->buckets_;
+  size_t home = HomeBucket(table, key);
+  size_t first = home / SEGMENT_SIZE;
+  size_t last = (home + NEIGHBORHOOD - 1) / SEGMENT_SIZE;
+  for (size_t i = first; i <= last; ++i) {
+    LockSegment(table->segments_[i]);
+  }
+
+  size_t slot;
+  if (ScanNeighborhood(table, home, key, &slot)) {
+    fn(buckets[slot].value_, true);
+    UnlockSegments(table, first, last);
+    return UPDATED;
+  }
+  if (!insert) {
+    UnlockSegments(table, first, last);
+    return NOT_FOUND;
+  }
+
+  // Finds the closest free bucket, locking the segments on the way
+  size_t free = home;
+  while (buckets[free].occupied_) {
+    if (++free == table->num_slots_ || free - home == MAX_PROBE) {
+      UnlockSegments(table, first, last);
+      return NO_SLOT;
+    }
+    if (free / SEGMENT_SIZE > last) {
+      LockSegment(table->segments_[++last]);
+    }
+  }
+  while (free - home >= NEIGHBORHOOD) {
+    if (!HopBack(table, &free)) {
+      UnlockSegments(table, first, last);
+      return NO_SLOT;
+    }
+  }
+
+  buckets[free].key_ = key;
+  buckets[free].value_ = ValueType{};
+  fn(buckets[free].value_, false);
+  buckets[free].occupied_ = true;
+  buckets[home].hop_info_ |= uint64_t{1} << (free - home);
+  UnlockSegments(table, first, last);
+  return INSERTED;
+}
+
+template <typename KeyType, typename ValueType>
+template <typename LookupKey>
+typename HopscotchHashTable<KeyType, ValueType>::WriteResult
+HopscotchHashTable<KeyType, ValueType>::DeleteSlot(Table *table,
+                                                   const LookupKey &key) {
+  size_t home = HomeBucket(table, key);
+  size_t first = home / SEGMENT_SIZE;
+  size_t last = (home + NEIGHBORHOOD - 1) / SEGMENT_SIZE;
+  for (size_t i = first; i <= last; ++i) {
+    LockSegment(table->segments_[i]);
+  }
+
+  WriteResult result = NOT_FOUND;
+  size_t slot;
+  if (ScanNeighborhood(table, home, key, &slot)) {
+    table->buckets_[slot].occupied_ = false;
+    table->buckets_[home].hop_info_ &= ~(uint64_t{1} << (slot - home));
+    result = UPDATED;
+  }
+  UnlockSegments(table, first, last);
+  return result;
+}
+
+template <typename KeyType, typename ValueType>
+void HopscotchHashTable<KeyType, ValueType>::Rebuild(Table *table) {
+  stats_.WriteLock(resize_lock_);
+  if (table_.load() != table) {
+    // Another thread already rebuilt the table
+    resize_lock_.WriteUnlock();
+    return;
+  }
+
+  uint64_t start = StatsCounters::Now();
+  size_t num_buckets = table->num_buckets_ * 2;
+  Table *new_table;
+  while (true) {
+    new_table = new Table(num_buckets);
+    bool complete = true;
+    for (size_t i = 0; i < table->num_slots_; ++i) {
+      const Bucket &bucket = table->buckets_[i];
+      auto copy = [&bucket](ValueType &value, bool) {
+        value = bucket.value_;
+      };
+      if (bucket.occupied_ &&
+          UpsertSlot(new_table, bucket.key_, true, copy) == NO_SLOT) {
+        complete = false;
+        break;
+      }
+    }
+    if (complete) {
+      break;
+    }
+    // Unlucky hashes; try again with more room
+    delete new_table;
+    num_buckets *= 2;
+  }
+
+  // Readers may still probe the old table; it is freed once they are done
+  table_.store(new_table, std::memory_order_release);
+  EpochManager::Instance().Retire(table);
+  stats_.AddResize(start);
+  resize_lock_.WriteUnlock();
+}
+
+template <typename KeyType, typename ValueType>
+TableStats HopscotchHashTable<KeyType, ValueType>::Stats() {
+  EpochManager::Guard guard;
+  TableStats stats;
+  stats_.Collect(&stats);
+  stats.size_ = size_.Load();
+  stats.capacity_ = table_.load(std::memory_order_acquire)->num_buckets_;
+  return stats;
+}
@@ -0,0 +1,416 @@
+#ifndef HOPSCOTCH_HASH_TABLE_H_
+#define HOPSCOTCH_HASH_TABLE_H_
+
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include "epoch_manager.h"
+#include "index_policy.h"
+#include "key_traits.h"
+#include "rwlock.h"
+#include "sharded_counter.h"
+#include "table_stats.h"
+
+/**
+ * Concurrent hopscotch hash table for trivially copyable keys and values.
+ *
+ * Entries are stored inline in a flat array of buckets. Every key lives
+ * within NEIGHBORHOOD buckets of its home bucket, and the home bucket keeps a
+ * hop bitmap of which of those buckets hold its keys, so a lookup only reads
+ * the buckets whose bit is set, usually one or two cache lines. An insert
+ * takes the closest free bucket after the home bucket; while that bucket is
+ * too far away, a key stored before it whose own neighborhood still covers
+ * it is moved into it, which brings the free bucket closer.
+ *
+ * The buckets are split into segments of SEGMENT_SIZE consecutive buckets,
+ * each with a version that doubles as its lock (odd while a writer owns it).
+ * A neighborhood spans at most two segments. Writers lock the segments from
+ * the home bucket up to the free bucket in ascending order, which rules out
+ * deadlocks and covers every bucket a displacement touches; the array has
+ * NEIGHBORHOOD - 1 extra buckets at the end so that neighborhoods never wrap
+ * around. Readers never write shared memory: they scan the neighborhood and
+ * retry if either of its segments changed meanwhile. Growing the table is
+ * exclusive like in SwissHashTable.
+ */
+template <typename KeyType, typename ValueType>
+class HopscotchHashTable {
+  static_assert(std::is_trivially_copyable_v<KeyType> &&
+                    std::is_trivially_copyable_v<ValueType>,
+                "optimistic reads copy keys and values that may be written "
+                "concurrently, so they must be trivially copyable");
+
+ private:
+  // Number of buckets a key may be away from its home bucket, one hop bit each
+  static constexpr size_t NEIGHBORHOOD{64};
+  static constexpr size_t SEGMENT_SIZE{64};
+
+  struct Bucket {
+    // Bit i is set if bucket `this + i` holds a key whose home is this bucket
+    uint64_t hop_info_{0};
+    bool occupied_{false};
+    KeyType key_;
+    ValueType value_;
+  };
+
+  struct alignas(64) Segment {
+    std::atomic<uint64_t> version_{0};  // odd while a writer owns the segment
+  };
+
+  /**
+   * The buckets and their segments, swapped as a whole on growth
+   */
+  struct Table {
+    size_t num_buckets_;   // number of home buckets (a power of two)
+    size_t num_slots_;     // num_buckets_ plus the overflow at the end
+    Bucket *buckets_;      // array of num_slots_ buckets
+    Segment *segments_;    // one segment per SEGMENT_SIZE buckets
+
+    explicit Table(size_t num_buckets)
+        : num_buckets_(num_buckets),
+          num_slots_(num_buckets + NEIGHBORHOOD - 1),
+          buckets_(new Bucket[num_slots_]),
+          segments_(new Segment[(num_slots_ + SEGMENT_SIZE - 1) /
+                                SEGMENT_SIZE]) {}
+    ~Table() {
+      delete[] buckets_;
+      delete[] segments_;
+    }
+  };
+
+ public:
+  /**
+   * Default constructor
+   */
+  HopscotchHashTable()
+      : HopscotchHashTable(DEFAULT_CAPACITY, DEFAULT_LOAD_FACTOR) {}
+
+  /**
+   * Creates a new HopscotchHashTable instance
+   * @param capacity the initial number of buckets (rounded up to a power of
+   * two)
+   * @param max_load_factor the maximum fraction of occupied buckets before
+   * the table grows
+   */
+  HopscotchHashTable(size_t capacity, float max_load_factor);
+
+  /**
+   * Disallows copy
+   */
+  HopscotchHashTable(const HopscotchHashTable &other) = delete;
+  HopscotchHashTable &operator=(const HopscotchHashTable &other) = delete;
+
+  /**
+   * Destroys an existing HopscotchHashTable instance
+   */
+  ~HopscotchHashTable();
+
+  size_t size() const { return size_.Load(); }
+
+  /**
+   * Gets the value of a key-value pair
+   * @param key the key of the key-value pair
+   * @return the value of that key
+   */
+  ValueType Get(const KeyType &key) { return Get<KeyType>(key); }
+
+  /**
+   * Gets the value of a key-value pair by a key of another type (see KeyHash)
+   * @param key the key of the key-value pair
+   * @return the value of that key
+   */
+  template <typename LookupKey,
+            typename = EnableIfLookupKey<KeyType, LookupKey>>
+  ValueType Get(const LookupKey &key);
+
+  /**
+   * Gets the value of a key-value pair, if the key exists
+   * @param key the key of the key-value pair
+   * @return the value of that key, or std::nullopt if the key does not exist
+   */
+  std::optional<ValueType> TryGet(const KeyType &key) {
+    return TryGet<KeyType>(key);
+  }
+
+  /**
+   * Gets the value of a key-value pair by a key of another type (see
+   * KeyHash), if the key exists
+   * @param key the key of the key-value pair
+   * @return the value of that key, or std::nullopt if the key does not exist
+   */
+  template <typename LookupKey,
+            typename = EnableIfLookupKey<KeyType, LookupKey>>
+  std::optional<ValueType> TryGet(const LookupKey &key);
+
+  /**
+   * Calls a function on the value of a key-value pair
+   * @param key the key of the key-value pair
+   * @param fn called with a const reference to a copy of the value. Readers
+   * never lock, so the copy is validated against concurrent writers first
+   * @return true if the key exists; otherwise, false
+   */
+  template <typename Fn>
+  bool Find(const KeyType &key, Fn fn) {
+    return Find<KeyType, Fn>(key, fn);
+  }
+
+  /**
+   * Calls a function on the value of a key-value pair, found by a key of
+   * another type (see KeyHash)
+   * @param key the key of the key-value pair
+   * @param fn called with a const reference to a copy of the value. Readers
+   * never lock, so the copy is validated against concurrent writers first
+   * @return true if the key exists; otherwise, false
+   */
+  template <typename LookupKey, typename Fn,
+            typename = EnableIfLookupKey<KeyType, LookupKey>>
+  bool Find(const LookupKey &key, Fn fn);
+
+  /**
+   * Checks if a key exists in the hash table
+   * @param key the key to check
+   * @return true if that key exists; otherwise, false
+   */
+  bool Contains(const KeyType &key) { return Contains<KeyType>(key); }
+
+  /**
+   * Checks if a key exists in the hash table, by a key of another type
+   * (see KeyHash)
+   * @param key the key to check
+   * @return true if that key exists; otherwise, false
+   */
+  template <typename LookupKey,
+            typename = EnableIfLookupKey<KeyType, LookupKey>>
+  bool Contains(const LookupKey &key);
+
+  /**
+   * Inserts a key-value pair into the hash table
+   * @param key the key to insert
+   * @param value the value to insert
+   */
+  void Insert(const KeyType &key, const ValueType &value) {
+    InsertOrAssign(key, value);
+  }
+
+  /**
+   * Inserts a key-value pair, or assigns the value if the key exists
+   * @param key the key to insert
+   * @param value the value to insert or assign
+   * @return true if the key was inserted; false if it existed
+   */
+  bool InsertOrAssign(const KeyType &key, const ValueType &value);
+
+  /**
+   * Inserts a key-value pair only if the key does not exist
+   * @param key the key to insert
+   * @param value the value to insert
+   * @param[out] existing the value of the key if it exists, if not nullptr
+   * @return true if the key was inserted; false if it existed
+   */
+  bool TryEmplace(const KeyType &key, const ValueType &value,
+                  ValueType *existing = nullptr);
+
+  /**
+   * Inserts a key with a value constructed from some arguments, only if the
+   * key does not exist. Values are trivially copyable, so the value is built
+   * up front and copied into its slot like TryEmplace's
+   * @param key the key to insert
+   * @param args the arguments of the value's constructor
+   * @return true if the key was inserted; false if it existed
+   */
+  template <typename... Args>
+  bool Emplace(const KeyType &key, Args &&...args) {
+    return TryEmplace(key, ValueType(std::forward<Args>(args)...));
+  }
+
+  /**
+   * Atomically modifies the value of a key if it exists
+   * @param key the key to update
+   * @param fn called with a reference to the value, with the segments of
+   * the key locked; it must not access the hash table
+   * @return true if the key exists; otherwise, false
+   */
+  template <typename Fn>
+  bool Update(const KeyType &key, Fn fn);
+
+  /**
+   * Atomically modifies the value of a key, inserting the key with a
+   * value-initialized value first if it does not exist
+   * @param key the key to update
+   * @param fn called with a reference to the value, with the segments of
+   * the key locked; it must not access the hash table
+   * @return the modified value
+   */
+  template <typename Fn>
+  ValueType Compute(const KeyType &key, Fn fn);
+
+  /**
+   * Deletes a key-value pair from the hash table
+   * @param key the key to delete
+   */
+  void Delete(const KeyType &key) { Delete<KeyType>(key); }
+
+  /**
+   * Deletes a key-value pair from the hash table by a key of another type
+   * (see KeyHash)
+   * @param key the key to delete
+   */
+  template <typename LookupKey,
+            typename = EnableIfLookupKey<KeyType, LookupKey>>
+  void Delete(const LookupKey &key);
+
+  /**
+   * Gets the runtime statistics of the hash table (see TableStats). Spinning
+   * on a segment owned by another writer counts as a lock wait
+   * @return a snapshot of the statistics
+   */
+  TableStats Stats();
+
+ private:
+  // Outcomes of the operations performed under resize_lock_
+  enum WriteResult {
+    INSERTED,   // the key took a free bucket
+    UPDATED,    // the key was updated or deleted
+    NOT_FOUND,  // the key to delete or update is absent
+    NO_SLOT,    // no free bucket could be moved into the neighborhood
+  };
+
+  /**
+   * Calculates the home bucket of a key
+   * @param table the table to index
+   * @param key the key to calculate index from
+   * @return the index of the home bucket
+   */
+  template <typename LookupKey>
+  static size_t HomeBucket(const Table *table, const LookupKey &key) {
+    return MaskIndex::Index(KeyHash<KeyType>{}(key), table->num_buckets_);
+  }
+
+  /**
+   * Finds the bucket holding a key by following the hop bitmap of its home
+   * bucket. The caller validates the result if it does not own the segments
+   * of the neighborhood
+   * @param table the table to probe
+   * @param home the home bucket of the key
+   * @param key the key to search
+   * @param[out] slot the index of the key's bucket if it is found
+   * @return true if the key is found; otherwise, false
+   */
+  template <typename LookupKey>
+  static bool ScanNeighborhood(const Table *table, size_t home,
+                               const LookupKey &key, size_t *slot);
+
+  /**
+   * Reads a stable (even) version of a segment
+   * @param segment the segment to read
+   * @return the version of the segment
+   */
+  static uint64_t ReadBegin(const Segment &segment);
+
+  /**
+   * Checks that a segment did not change since ReadBegin
+   * @param segment the segment that was read
+   * @param version the version returned by ReadBegin
+   * @return true if the read is consistent; otherwise, false
+   */
+  static bool ReadValidate(const Segment &segment, uint64_t version);
+
+  /**
+   * Takes ownership of a segment, making its version odd
+   * @param segment the segment to lock
+   */
+  void LockSegment(Segment &segment) const;
+
+  /**
+   * Releases the segments [first, last], publishing their changes
+   * @param table the table owning the segments
+   * @param first the index of the first segment
+   * @param last the index of the last segment
+   */
+  static void UnlockSegments(Table *table, size_t first, size_t last);
+
+  /**
+   * Looks a key up without taking any lock
+   * @param table the table to probe
+   * @param key the key to search
+   * @param[out] value the value of the key, if not nullptr
+   * @return true if the key is found; otherwise, false
+   */
+  template <typename LookupKey>
+  bool FindOptimistic(const Table *table, const LookupKey &key,
+                      ValueType *value) const;
+
+  /**
+   * Moves the free bucket closer to the front: some key stored before it,
+   * whose neighborhood also covers it, is moved into it. The caller owns
+   * the segments of every bucket in (`*free` - NEIGHBORHOOD, `*free`]
+   * @param table the table to modify
+   * @param[in,out] free the free bucket, then the bucket that was freed
+   * @return true if a key was moved; otherwise, false
+   */
+  static bool HopBack(Table *table, size_t *free);
+
+  /**
+   * Runs a write on the value of a key, rebuilding the table if it gets
+   * full. Every write operation but Delete goes through here
+   * @param key the key to write
+   * @param insert whether to insert the key, with a value-initialized value,
+   * if it does not exist
+   * @param fn called as fn(value, found) with a reference to the value of the
+   * key and whether it existed; not called if the key is absent and not
+   * inserted
+   * @return true if the key existed; otherwise, false
+   */
+  template <typename Fn>
+  bool Upsert(const KeyType &key, bool insert, Fn fn);
+
+  /**
+   * Inserts or updates a key-value pair, the caller holding resize_lock_
+   * @param table the table to insert into
+   * @param key the key to write
+   * @param insert whether to insert the key if it does not exist
+   * @param fn called as fn(value, found), see Upsert
+   * @return the outcome of the write
+   */
+  template <typename Fn>
+  WriteResult UpsertSlot(Table *table, const KeyType &key, bool insert,
+                         Fn &fn);
+
+  /**
+   * Deletes a key, the caller holding resize_lock_ in read mode
+   * @param table the table to delete from
+   * @param key the key to delete
+   * @return the outcome of the deletion
+   */
+  template <typename LookupKey>
+  WriteResult DeleteSlot(Table *table, const LookupKey &key);
+
+  /**
+   * Doubles the number of buckets, unless another thread already replaced
+   * `table`
+   * @param table the table that got too full
+   */
+  void Rebuild(Table *table);
+
+  // Default hash table value
+  static constexpr size_t DEFAULT_CAPACITY{128};
+  static constexpr float DEFAULT_LOAD_FACTOR{0.9};
+  // Farthest bucket from home that an insert looks at for a free one
+  static constexpr size_t MAX_PROBE{4096};
+
+  float max_load_factor_;
+  std::atomic<Table *> table_;   // current array of buckets
+  ShardedCounter size_;          // number of key-value pairs
+  // Held in read mode by Insert/Delete and in write mode by Rebuild
+  ReaderWriterLock resize_lock_;
+  StatsCounters stats_;  // event counters, empty without TABLE_STATS
+};
+
+#include "hopscotch_hash_table.cpp"
+
+#endif  // HOPSCOTCH_HASH_TABLE_H_
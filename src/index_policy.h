@@ -0,0 +1,70 @@
+#ifndef INDEX_POLICY_H_
+#define INDEX_POLICY_H_
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Mixes the bits of a hash (the MurmurHash3 finalizer), so that every output
+ * bit depends on every input bit. std::hash is the identity for integers,
+ * which would otherwise put runs of consecutive keys into runs of
+ * consecutive buckets or slots
+ * @param hash the hash to mix
+ * @return the mixed hash
+ */
+inline uint64_t MixHash(uint64_t hash) {
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33;
+  hash *= 0xc4ceb9fe1a85ec53ULL;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+/**
+ * Maps a hash to a bucket with a modulo, for any number of buckets. An
+ * integer division on every operation, and sequential integer keys only
+ * spread well because they land in consecutive buckets
+ */
+struct ModuloIndex {
+  /**
+   * Adjusts a requested number of buckets to one the policy supports
+   * @param capacity the requested number of buckets
+   * @return the number of buckets to allocate
+   */
+  static size_t RoundCapacity(size_t capacity) {
+    return capacity > 0 ? capacity : 1;
+  }
+
+  /**
+   * Calculates the bucket of a hash
+   * @param hash the hash of a key
+   * @param capacity the number of buckets
+   * @return the index of the bucket
+   */
+  static size_t Index(size_t hash, size_t capacity) { return hash % capacity; }
+};
+
+/**
+ * Maps a hash to a bucket by mixing it and masking off the low bits, which
+ * requires a power-of-two number of buckets. Doubling the capacity still
+ * sends bucket `i` to buckets `i` and `i + capacity`, as with ModuloIndex.
+ * Mixing costs less than the division, but scatters sequential keys that
+ * ModuloIndex keeps in consecutive buckets, so it pays off for keys without
+ * such locality (see the index benchmark of the fine-grained table)
+ */
+struct MaskIndex {
+  static size_t RoundCapacity(size_t capacity) {
+    size_t rounded = 1;
+    while (rounded < capacity) {
+      rounded <<= 1;
+    }
+    return rounded;
+  }
+
+  static size_t Index(size_t hash, size_t capacity) {
+    return MixHash(hash) & (capacity - 1);
+  }
+};
+
+#endif  // INDEX_POLICY_H_
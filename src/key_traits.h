@@ -0,0 +1,124 @@
+#ifndef KEY_TRAITS_H_
+#define KEY_TRAITS_H_
+
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+/**
+ * Hash of the keys of every table. Defaults to std::hash, and is customized
+ * the same way: by specializing it (together with KeyEqual) for a key type.
+ *
+ * A specialization that declares `is_transparent` also accepts other types
+ * of lookup keys, which Get, Contains and Delete then take as they are. It
+ * must hash such a key exactly like the equal KeyType.
+ *
+ * The std::string specialization is transparent: it hashes through
+ * std::string_view, which hashes like std::string, so a lookup by a
+ * std::string_view or a C string does not build a std::string.
+ */
+template <typename KeyType>
+struct KeyHash : std::hash<KeyType> {};
+
+template <>
+struct KeyHash<std::string> {
+  using is_transparent = void;
+
+  size_t operator()(std::string_view key) const {
+    return std::hash<std::string_view>{}(key);
+  }
+};
+
+/**
+ * Equality of the keys of every table, see KeyHash
+ */
+template <typename KeyType>
+struct KeyEqual : std::equal_to<KeyType> {};
+
+template <>
+struct KeyEqual<std::string> {
+  using is_transparent = void;
+
+  bool operator()(std::string_view lhs, std::string_view rhs) const {
+    return lhs == rhs;
+  }
+};
+
+/**
+ * Whether the chaining tables (CoarseHashTable, FineHashTable) store the hash
+ * of each key next to it. A stored hash rejects most non-matching entries of
+ * a chain without comparing keys, and lets a resize place entries without
+ * hashing them again, at the cost of a word per entry. Defaults to true
+ * except for scalar keys, whose hash and comparison are already cheap;
+ * specialize it to choose otherwise.
+ */
+template <typename KeyType>
+struct CacheKeyHash : std::bool_constant<!std::is_scalar_v<KeyType>> {};
+
+/**
+ * Base of the entries of a chaining table: holds the hash of the entry's key
+ * if CacheKeyHash is set for the key type, and is empty otherwise
+ */
+template <typename KeyType, bool CACHED = CacheKeyHash<KeyType>::value>
+struct CachedHash {
+  CachedHash() = default;
+  explicit CachedHash(size_t) {}
+
+  /**
+   * Checks whether the entry may hold a key of a given hash, before the keys
+   * are compared
+   * @param hash the hash of the key searched for
+   * @return false if the entry cannot hold that key; otherwise, true
+   */
+  bool MayMatch(size_t) const { return true; }
+
+  /**
+   * Gets the hash of the entry's key
+   * @param key the key of the entry
+   * @return the hash of that key
+   */
+  size_t Hash(const KeyType &key) const { return KeyHash<KeyType>{}(key); }
+};
+
+template <typename KeyType>
+struct CachedHash<KeyType, true> {
+  size_t hash_{0};  // the hash of the entry's key
+
+  CachedHash() = default;
+  explicit CachedHash(size_t hash) : hash_(hash) {}
+
+  bool MayMatch(size_t hash) const { return hash_ == hash; }
+
+  size_t Hash(const KeyType &) const { return hash_; }
+};
+
+/**
+ * Checks whether a table with keys of type KeyType can be searched with a key
+ * of type LookupKey: KeyType itself, or any type that KeyHash and KeyEqual
+ * accept when both are transparent
+ */
+template <typename KeyType, typename LookupKey, typename = void>
+struct IsLookupKey : std::is_same<KeyType, LookupKey> {};
+
+template <typename KeyType, typename LookupKey>
+struct IsLookupKey<KeyType, LookupKey,
+                   std::void_t<typename KeyHash<KeyType>::is_transparent,
+                               typename KeyEqual<KeyType>::is_transparent>>
+    : std::bool_constant<
+          std::is_same_v<KeyType, LookupKey> ||
+          (std::is_invocable_r_v<size_t, KeyHash<KeyType>,
+                                 const LookupKey &> &&
+           std::is_invocable_r_v<bool, KeyEqual<KeyType>, const KeyType &,
+                                 const LookupKey &>)> {};
+
+/**
+ * Enables the lookup overloads of a table for the keys IsLookupKey accepts
+ */
+template <typename KeyType, typename LookupKey>
+using EnableIfLookupKey =
+    std::enable_if_t<IsLookupKey<KeyType, LookupKey>::value>;
+
+#endif  // KEY_TRAITS_H_
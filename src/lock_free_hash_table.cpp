@@ -1,38 +1,333 @@
 #include "lock_free_hash_table.h"
 
-template<typename KeyType, typename ValueType>
-LockFreeHashTable<KeyType, ValueType>::~LockFreeHashTable() {
-  lock_.WriteLock();
-  delete []table_;
-  lock_.WriteUnlock();
+template <typename KeyType, typename ValueType, typename NodeAllocator>
+LockFreeHashTable<KeyType, ValueType, NodeAllocator>::LockFreeHashTable(
+    size_t capacity, float max_load_factor)
+    : first_segment_size_(1),
+      first_segment_shift_(0),
+      max_load_factor_(max_load_factor) {
+  while (first_segment_size_ < capacity) {
+    first_segment_size_ <<= 1;
+    ++first_segment_shift_;
+  }
+  capacity_ = first_segment_size_;
+  // The sentinel of bucket 0 is the first node of the list
+  Node *sentinel = NodeAllocator::template New<Node>();
+  list_.InsertSentinel(list_.GetHead(), sentinel);
+  LocateBucket(0).sentinel_.store(sentinel, std::memory_order_release);
+}
+
+template <typename KeyType, typename ValueType, typename NodeAllocator>
+LockFreeHashTable<KeyType, ValueType, NodeAllocator>::~LockFreeHashTable() {
+  // The list frees the key-value nodes; the sentinels belong to the buckets
+  list_.Clear();
+  for (size_t idx = 0; idx < MAX_SEGMENTS; ++idx) {
+    Bucket *segment = segments_[idx].load();
+    if (segment == nullptr) {
+      continue;
+    }
+    size_t segment_size =
+        idx == 0 ? first_segment_size_ : first_segment_size_ << (idx - 1);
+    for (size_t offset = 0; offset < segment_size; ++offset) {
+      Node *sentinel = segment[offset].sentinel_.load();
+      if (sentinel != nullptr) {
+        NodeAllocator::Delete(sentinel);
+      }
+    }
+    delete[] segment;
+  }
 }
 
 
-template <typename KeyType, typename ValueType>
-ValueType LockFreeHashTable<KeyType, ValueType>::Get(const KeyType &key) {
-  size_t idx = KeyToIndex(key);
-  ValueType value = table_[idx].Search(key);
+template <typename KeyType, typename ValueType, typename NodeAllocator>
+template <typename LookupKey, typename>
+ValueType LockFreeHashTable<KeyType, ValueType, NodeAllocator>::Get(
+    const LookupKey &key) {
+  size_t hash = Hash(key);
+  MarkPtrType *bucket = GetBucket(hash & (capacity_ - 1));
+  ValueType value = list_.Search(bucket, RegularOrderKey(hash), key);
+  return value;
+}
+
+template <typename KeyType, typename ValueType, typename NodeAllocator>
+template <typename LookupKey, typename>
+std::optional<ValueType>
+LockFreeHashTable<KeyType, ValueType, NodeAllocator>::TryGet(
+    const LookupKey &key) {
+  size_t hash = Hash(key);
+  MarkPtrType *bucket = GetBucket(hash & (capacity_ - 1));
+  ValueType value{};
+  if (!list_.Find(bucket, RegularOrderKey(hash), key, &value)) {
+    return std::nullopt;
+  }
   return value;
 }
 
-template <typename KeyType, typename ValueType>
-void LockFreeHashTable<KeyType, ValueType>::Insert(const KeyType &key, const ValueType &value) {
-  size_t idx = KeyToIndex(key);
-  if (table_[idx].Insert(key, value)) {
-    ++size_;
+template <typename KeyType, typename ValueType, typename NodeAllocator>
+template <typename LookupKey, typename Fn, typename>
+bool LockFreeHashTable<KeyType, ValueType, NodeAllocator>::Find(
+    const LookupKey &key, Fn fn) {
+  size_t hash = Hash(key);
+  MarkPtrType *bucket = GetBucket(hash & (capacity_ - 1));
+  return list_.Visit(bucket, RegularOrderKey(hash), key, fn);
+}
+
+template <typename KeyType, typename ValueType, typename NodeAllocator>
+bool LockFreeHashTable<KeyType, ValueType, NodeAllocator>::InsertOrAssign(
+    const KeyType &key, const ValueType &value) {
+  return !Upsert(key, true,
+                 [&value](ValueType &current, bool) { current = value; });
+}
+
+template <typename KeyType, typename ValueType, typename NodeAllocator>
+bool LockFreeHashTable<KeyType, ValueType, NodeAllocator>::TryEmplace(
+    const KeyType &key, const ValueType &value, ValueType *existing) {
+  return EmplaceNode(existing, key, value);
+}
+
+template <typename KeyType, typename ValueType, typename NodeAllocator>
+bool LockFreeHashTable<KeyType, ValueType, NodeAllocator>::TryEmplace(
+    KeyType key, ValueType &&value, ValueType *existing) {
+  return EmplaceNode(existing, std::move(key), std::move(value));
+}
+
+template <typename KeyType, typename ValueType, typename NodeAllocator>
+template <typename... Args>
+bool LockFreeHashTable<KeyType, ValueType, NodeAllocator>::Emplace(
+    KeyType key, Args &&...args) {
+  return EmplaceNode(nullptr, std::move(key), std::forward<Args>(args)...);
+}
+
+template <typename KeyType, typename ValueType, typename NodeAllocator>
+template <typename Fn>
+bool LockFreeHashTable<KeyType, ValueType, NodeAllocator>::Update(
+    const KeyType &key, Fn fn) {
+  return Upsert(key, false, [&fn](ValueType &current, bool) { fn(current); });
+}
+
+template <typename KeyType, typename ValueType, typename NodeAllocator>
+template <typename Fn>
+ValueType LockFreeHashTable<KeyType, ValueType, NodeAllocator>::Compute(
+    const KeyType &key, Fn fn) {
+  ValueType result{};
+  Upsert(key, true, [&](ValueType &current, bool) {
+    fn(current);
+    result = current;
+  });
+  return result;
+}
+
+template <typename KeyType, typename ValueType, typename NodeAllocator>
+ValueType LockFreeHashTable<KeyType, ValueType, NodeAllocator>::FetchAdd(
+    const KeyType &key, ValueType delta) {
+  static_assert(std::is_arithmetic_v<ValueType>,
+                "FetchAdd needs an arithmetic value type");
+  ValueType previous{};
+  Upsert(key, true, typename List::AddValue{delta, &previous});
+  return previous;
+}
+
+template <typename KeyType, typename ValueType, typename NodeAllocator>
+template <typename LookupKey, typename>
+void LockFreeHashTable<KeyType, ValueType, NodeAllocator>::Delete(
+    const LookupKey &key) {
+  size_t hash = Hash(key);
+  MarkPtrType *bucket = GetBucket(hash & (capacity_ - 1));
+  if (list_.Delete(bucket, RegularOrderKey(hash), key)) {
+    size_.Decrement();
+  }
+}
+
+template <typename KeyType, typename ValueType, typename NodeAllocator>
+template <typename LookupKey, typename>
+bool LockFreeHashTable<KeyType, ValueType, NodeAllocator>::Contains(
+    const LookupKey &key) {
+  size_t hash = Hash(key);
+  MarkPtrType *bucket = GetBucket(hash & (capacity_ - 1));
+  return list_.Find(bucket, RegularOrderKey(hash), key);
+}
+
+template <typename KeyType, typename ValueType, typename NodeAllocator>
+void LockFreeHashTable<KeyType, ValueType, NodeAllocator>::MultiGet(
+    const KeyType *keys, size_t num_keys, ValueType *values) {
+  size_t hashes[PREFETCH_BATCH];
+  MarkPtrType *buckets[PREFETCH_BATCH];
+  for (size_t start = 0; start < num_keys; start += PREFETCH_BATCH) {
+    size_t count = std::min(PREFETCH_BATCH, num_keys - start);
+    // One epoch for the whole group makes the guards of the list operations
+    // nest for free
+    EpochManager::Guard guard;
+    PrefetchBuckets(keys + start, count, hashes, buckets);
+    for (size_t i = 0; i < count; ++i) {
+      values[start + i] = list_.Search(buckets[i], RegularOrderKey(hashes[i]),
+                                       keys[start + i]);
+    }
+  }
+}
+
+template <typename KeyType, typename ValueType, typename NodeAllocator>
+void LockFreeHashTable<KeyType, ValueType, NodeAllocator>::MultiContains(
+    const KeyType *keys, size_t num_keys, bool *found) {
+  size_t hashes[PREFETCH_BATCH];
+  MarkPtrType *buckets[PREFETCH_BATCH];
+  for (size_t start = 0; start < num_keys; start += PREFETCH_BATCH) {
+    size_t count = std::min(PREFETCH_BATCH, num_keys - start);
+    EpochManager::Guard guard;
+    PrefetchBuckets(keys + start, count, hashes, buckets);
+    for (size_t i = 0; i < count; ++i) {
+      found[start + i] = list_.Find(buckets[i], RegularOrderKey(hashes[i]),
+                                    keys[start + i]);
+    }
+  }
+}
+
+template <typename KeyType, typename ValueType, typename NodeAllocator>
+void LockFreeHashTable<KeyType, ValueType, NodeAllocator>::MultiInsert(
+    const KeyType *keys, const ValueType *values, size_t num_keys) {
+  size_t hashes[PREFETCH_BATCH];
+  MarkPtrType *buckets[PREFETCH_BATCH];
+  for (size_t start = 0; start < num_keys; start += PREFETCH_BATCH) {
+    size_t count = std::min(PREFETCH_BATCH, num_keys - start);
+    EpochManager::Guard guard;
+    PrefetchBuckets(keys + start, count, hashes, buckets);
+    for (size_t i = 0; i < count; ++i) {
+      if (list_.Insert(buckets[i], RegularOrderKey(hashes[i]), keys[start + i],
+                       values[start + i])) {
+        size_.Increment();
+        MaybeGrow();
+      }
+    }
+  }
+}
+
+template <typename KeyType, typename ValueType, typename NodeAllocator>
+template <typename Fn>
+bool LockFreeHashTable<KeyType, ValueType, NodeAllocator>::Upsert(
+    const KeyType &key, bool insert, Fn fn) {
+  size_t hash = Hash(key);
+  MarkPtrType *bucket = GetBucket(hash & (capacity_ - 1));
+  bool found = list_.Upsert(bucket, RegularOrderKey(hash), key, insert, fn);
+  if (!found && insert) {
+    size_.Increment();
+    MaybeGrow();
+  }
+  return found;
+}
+
+template <typename KeyType, typename ValueType, typename NodeAllocator>
+template <typename KeyArg, typename... Args>
+bool LockFreeHashTable<KeyType, ValueType, NodeAllocator>::EmplaceNode(
+    ValueType *existing, KeyArg &&key, Args &&...args) {
+  size_t hash = Hash(key);
+  MarkPtrType *bucket = GetBucket(hash & (capacity_ - 1));
+  if (!list_.Emplace(bucket, RegularOrderKey(hash), existing,
+                     std::forward<KeyArg>(key), std::forward<Args>(args)...)) {
+    return false;
+  }
+  size_.Increment();
+  MaybeGrow();
+  return true;
+}
+
+template <typename KeyType, typename ValueType, typename NodeAllocator>
+void LockFreeHashTable<KeyType, ValueType, NodeAllocator>::PrefetchBuckets(
+    const KeyType *keys, size_t num_keys, size_t *hashes,
+    MarkPtrType **buckets) {
+  size_t mask = capacity_.load() - 1;
+  Bucket *slots[PREFETCH_BATCH];
+  for (size_t i = 0; i < num_keys; ++i) {
+    hashes[i] = Hash(keys[i]);
+    slots[i] = &LocateBucket(hashes[i] & mask);
+    __builtin_prefetch(slots[i]);
+  }
+  for (size_t i = 0; i < num_keys; ++i) {
+    Node *sentinel = slots[i]->sentinel_.load(std::memory_order_acquire);
+    if (sentinel != nullptr) {
+      buckets[i] = &sentinel->ptr_;
+    } else {
+      buckets[i] = InitializeBucket(hashes[i] & mask);
+    }
+    __builtin_prefetch(buckets[i]);
+  }
+  for (size_t i = 0; i < num_keys; ++i) {
+    // Even a stale pointer is harmless to prefetch
+    __builtin_prefetch(MarkPtrType::Load(buckets[i]).GetNextPtr());
+  }
+}
+
+template <typename KeyType, typename ValueType, typename NodeAllocator>
+typename LockFreeHashTable<KeyType, ValueType, NodeAllocator>::MarkPtrType *
+LockFreeHashTable<KeyType, ValueType, NodeAllocator>::GetBucket(size_t bucket) {
+  Node *sentinel =
+      LocateBucket(bucket).sentinel_.load(std::memory_order_acquire);
+  if (sentinel == nullptr) {
+    return InitializeBucket(bucket);
   }
+  return &sentinel->ptr_;
 }
 
-template <typename KeyType, typename ValueType>
-void LockFreeHashTable<KeyType, ValueType>::Delete(const KeyType &key) {
-  size_t idx = KeyToIndex(key);
-  if (table_[idx].Delete(key)) {
-    --size_;
+template <typename KeyType, typename ValueType, typename NodeAllocator>
+typename LockFreeHashTable<KeyType, ValueType, NodeAllocator>::MarkPtrType *
+LockFreeHashTable<KeyType, ValueType, NodeAllocator>::InitializeBucket(size_t bucket) {
+  size_t parent = bucket & ~(size_t{1} << (63 - __builtin_clzll(bucket)));
+  MarkPtrType *parent_sentinel = GetBucket(parent);
+  Bucket &b = LocateBucket(bucket);
+  // Only one sentinel per order key gets linked, and a sentinel is never
+  // unlinked, so every thread ends up publishing the same one
+  Node *sentinel = NodeAllocator::template New<Node>();
+  sentinel->order_key_ = SentinelOrderKey(bucket);
+  Node *linked = list_.InsertSentinel(parent_sentinel, sentinel);
+  if (linked != sentinel) {
+    // Never linked, so no other thread can have seen it
+    NodeAllocator::Delete(sentinel);
   }
+  b.sentinel_.store(linked, std::memory_order_release);
+  return &linked->ptr_;
 }
 
-template<typename KeyType, typename ValueType>
-bool LockFreeHashTable<KeyType, ValueType>::Contains(const KeyType &key) {
-  size_t idx = KeyToIndex(key);
-  return table_[idx].Find(key);
+template <typename KeyType, typename ValueType, typename NodeAllocator>
+typename LockFreeHashTable<KeyType, ValueType, NodeAllocator>::Bucket &
+LockFreeHashTable<KeyType, ValueType, NodeAllocator>::LocateBucket(size_t bucket) {
+  size_t segment_idx = 0;
+  size_t offset = bucket;
+  size_t segment_size = first_segment_size_;
+  if (bucket >= first_segment_size_) {
+    segment_idx = 64 - __builtin_clzll(bucket >> first_segment_shift_);
+    segment_size = first_segment_size_ << (segment_idx - 1);
+    offset = bucket - segment_size;
+  }
+
+  Bucket *segment = segments_[segment_idx].load(std::memory_order_acquire);
+  if (segment == nullptr) {
+    auto new_segment = new Bucket[segment_size];
+    if (segments_[segment_idx].compare_exchange_strong(segment, new_segment)) {
+      segment = new_segment;
+    } else {
+      // Another thread allocated the segment first
+      delete[] new_segment;
+    }
+  }
+  return segment[offset];
 }
+
+template <typename KeyType, typename ValueType, typename NodeAllocator>
+void LockFreeHashTable<KeyType, ValueType, NodeAllocator>::MaybeGrow() {
+  size_t capacity = capacity_.load();
+  if (size_.Exceeds(capacity * max_load_factor_) &&
+      capacity < (size_t{1} << 62)) {
+    uint64_t start = StatsCounters::Now();
+    // Losing the race means another thread already doubled the capacity
+    if (capacity_.compare_exchange_strong(capacity, capacity * 2)) {
+      list_.GetStatsCounters().AddResize(start);
+    }
+  }
+}
+
+template <typename KeyType, typename ValueType, typename NodeAllocator>
+TableStats LockFreeHashTable<KeyType, ValueType, NodeAllocator>::Stats() {
+  TableStats stats;
+  list_.GetStatsCounters().Collect(&stats);
+  stats.size_ = size_.Load();
+  stats.capacity_ = capacity_.load();
+  return stats;
+}
\ No newline at end of file
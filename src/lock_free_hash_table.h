@@ -2,11 +2,51 @@
 #define LOCK_FREE_HASH_TABLE_H_
 
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
 #include "atomic_linked_list.h"
-#include "rwlock.h"
+#include "key_traits.h"
+#include "sharded_counter.h"
+#include "table_stats.h"
 
-template <typename KeyType, typename ValueType>
+/**
+ * Lock-free hash table based on split-ordered lists (Shalev and Shavit).
+ *
+ * All key-value pairs live in a single AtomicLinkedList sorted by the
+ * bit-reversed hash of their keys. A bucket is just a sentinel node inside
+ * that list, so doubling the number of buckets never moves a node: a new
+ * bucket is initialized lazily by splicing its sentinel into the list right
+ * after the sentinel of its parent bucket. Threads that initialize a bucket
+ * at the same time each try to link a sentinel of their own, and all adopt
+ * whichever got linked, so no thread ever waits for another. Buckets live in
+ * segments that are
+ * allocated on first use, so a small table only pays for the buckets it
+ * touches.
+ *
+ * Nodes, sentinels included, come from `NodeAllocator`, per-thread pools by
+ * default.
+ */
+template <typename KeyType, typename ValueType,
+          typename NodeAllocator = PoolAllocator>
 class LockFreeHashTable {
+ private:
+  using List = AtomicLinkedList<KeyType, ValueType, NodeAllocator>;
+  using MarkPtrType = typename List::MarkPtrType;
+  using Node = typename List::Node;
+
+  /**
+   * A bucket points to its sentinel once the sentinel is linked into the list
+   */
+  struct Bucket {
+    std::atomic<Node *> sentinel_{nullptr};  // the first node of the bucket
+  };
+
  public:
   /**
    * Default constructor
@@ -16,14 +56,12 @@ class LockFreeHashTable {
 
   /**
    * Creates a new LockFreeHashTable instance
-   * @param capacity the maximum bucket in the hash table
+   * @param capacity the initial number of buckets (rounded up to a power of
+   * two)
    * @param max_load_factor the maximum load factor (the average number of
    * elements per bucket)
    */
-  LockFreeHashTable(size_t capacity, float max_load_factor)
-      : capacity_(capacity),
-        max_load_factor_(max_load_factor),
-        table_(new AtomicLinkedList<int, int>[capacity_]) {}
+  LockFreeHashTable(size_t capacity, float max_load_factor);
 
   /**
    * Disallows copy
@@ -36,54 +74,357 @@ class LockFreeHashTable {
    */
   ~LockFreeHashTable();
 
+  size_t size() const { return size_.Load(); }
+
   /**
    * Gets the value of a key-value pair
    * @param key the key of the key-value pair
    * @return the value of that key
    */
-  ValueType Get(const KeyType &key);
+  ValueType Get(const KeyType &key) { return Get<KeyType>(key); }
+
+  /**
+   * Gets the value of a key-value pair by a key of another type (see KeyHash)
+   * @param key the key of the key-value pair
+   * @return the value of that key
+   */
+  template <typename LookupKey,
+            typename = EnableIfLookupKey<KeyType, LookupKey>>
+  ValueType Get(const LookupKey &key);
+
+  /**
+   * Gets the value of a key-value pair, if the key exists
+   * @param key the key of the key-value pair
+   * @return the value of that key, or std::nullopt if the key does not exist
+   */
+  std::optional<ValueType> TryGet(const KeyType &key) {
+    return TryGet<KeyType>(key);
+  }
+
+  /**
+   * Gets the value of a key-value pair by a key of another type (see
+   * KeyHash), if the key exists
+   * @param key the key of the key-value pair
+   * @return the value of that key, or std::nullopt if the key does not exist
+   */
+  template <typename LookupKey,
+            typename = EnableIfLookupKey<KeyType, LookupKey>>
+  std::optional<ValueType> TryGet(const LookupKey &key);
+
+  /**
+   * Calls a function on the value of a key-value pair
+   * @param key the key of the key-value pair
+   * @param fn called with a const reference to the value, in place: the
+   * epoch keeps it alive until `fn` returns, even if the key is deleted
+   * meanwhile. Values that fit in an atomic word are passed as a copy, as
+   * Update may modify them in place
+   * @return true if the key exists; otherwise, false
+   */
+  template <typename Fn>
+  bool Find(const KeyType &key, Fn fn) {
+    return Find<KeyType, Fn>(key, fn);
+  }
+
+  /**
+   * Calls a function on the value of a key-value pair, found by a key of
+   * another type (see KeyHash)
+   * @param key the key of the key-value pair
+   * @param fn called with a const reference to the value, in place: the
+   * epoch keeps it alive until `fn` returns, even if the key is deleted
+   * meanwhile. Values that fit in an atomic word are passed as a copy, as
+   * Update may modify them in place
+   * @return true if the key exists; otherwise, false
+   */
+  template <typename LookupKey, typename Fn,
+            typename = EnableIfLookupKey<KeyType, LookupKey>>
+  bool Find(const LookupKey &key, Fn fn);
 
   /**
-   * Inserts a key-value pair into the hash table
+   * Inserts a key-value pair into the hash table. An existing key keeps its
+   * value (see InsertOrAssign)
    * @param key the key to insert
    * @param value the value to insert
    */
-  void Insert(const KeyType &key, const ValueType &value);
+  void Insert(const KeyType &key, const ValueType &value) {
+    TryEmplace(key, value);
+  }
+
+  /**
+   * Inserts a key-value pair into the hash table, moving the key and value
+   * in. An existing key keeps its value (see InsertOrAssign)
+   * @param key the key to insert
+   * @param value the value to insert
+   */
+  void Insert(KeyType key, ValueType &&value) {
+    TryEmplace(std::move(key), std::move(value));
+  }
+
+  /**
+   * Inserts a key-value pair, or assigns the value if the key exists. Values
+   * that do not fit in an atomic word are assigned by replacing their node
+   * (see AtomicLinkedList::Upsert)
+   * @param key the key to insert
+   * @param value the value to insert or assign
+   * @return true if the key was inserted; false if it existed
+   */
+  bool InsertOrAssign(const KeyType &key, const ValueType &value);
+
+  /**
+   * Inserts a key-value pair only if the key does not exist
+   * @param key the key to insert
+   * @param value the value to insert
+   * @param[out] existing the value of the key if it exists, if not nullptr
+   * @return true if the key was inserted; false if it existed
+   */
+  bool TryEmplace(const KeyType &key, const ValueType &value,
+                  ValueType *existing = nullptr);
+
+  /**
+   * Inserts a key-value pair only if the key does not exist, moving the key
+   * and value in. The value is left alone if the key exists, unless a
+   * concurrent insertion of the key wins after the node was built
+   * @param key the key to insert
+   * @param value the value to insert
+   * @param[out] existing the value of the key if it exists, if not nullptr
+   * @return true if the key was inserted; false if it existed
+   */
+  bool TryEmplace(KeyType key, ValueType &&value,
+                  ValueType *existing = nullptr);
+
+  /**
+   * Inserts a key with a value constructed in place in its node from some
+   * arguments, only if the key does not exist. The value is not constructed
+   * if the key is found, but may be constructed and discarded if a
+   * concurrent insertion of the key wins
+   * @param key the key to insert
+   * @param args the arguments of the value's constructor
+   * @return true if the key was inserted; false if it existed
+   */
+  template <typename... Args>
+  bool Emplace(KeyType key, Args &&...args);
+
+  /**
+   * Atomically modifies the value of a key if it exists. A value that fits
+   * in an atomic word is replaced in place with a compare-and-swap; any other
+   * value is modified on a copy in a new node that replaces the old one.
+   * Either way `fn` may run several times on copies of the value; it must not
+   * access the hash table
+   * @param key the key to update
+   * @param fn called with a reference to (a copy of) the value
+   * @return true if the key exists; otherwise, false
+   */
+  template <typename Fn>
+  bool Update(const KeyType &key, Fn fn);
+
+  /**
+   * Atomically modifies the value of a key, inserting the key with a
+   * value-initialized value first if it does not exist. See Update
+   * @param key the key to update
+   * @param fn called with a reference to (a copy of) the value
+   * @return the modified value
+   */
+  template <typename Fn>
+  ValueType Compute(const KeyType &key, Fn fn);
+
+  /**
+   * Atomically adds to the value of a key, inserting the key with a value of
+   * `delta` if it does not exist. Integral values are added to in place with
+   * a fetch-and-add, which never retries
+   * @param key the key to update
+   * @param delta the amount to add
+   * @return the value before the addition (0 if the key was inserted)
+   */
+  ValueType FetchAdd(const KeyType &key, ValueType delta);
 
   /**
    * Deletes a key-value pair from the hash table
    * @param key the key to delete
    */
-  void Delete(const KeyType &key);
+  void Delete(const KeyType &key) { Delete<KeyType>(key); }
+
+  /**
+   * Deletes a key-value pair from the hash table by a key of another type
+   * (see KeyHash)
+   * @param key the key to delete
+   */
+  template <typename LookupKey,
+            typename = EnableIfLookupKey<KeyType, LookupKey>>
+  void Delete(const LookupKey &key);
 
   /**
    * Checks if a key exists in the hash table
    * @param key the key to check
    * @return true if that key exists; otherwise, false
    */
-  bool Contains(const KeyType &key);
+  bool Contains(const KeyType &key) { return Contains<KeyType>(key); }
+
+  /**
+   * Checks if a key exists in the hash table, by a key of another type
+   * (see KeyHash)
+   * @param key the key to check
+   * @return true if that key exists; otherwise, false
+   */
+  template <typename LookupKey,
+            typename = EnableIfLookupKey<KeyType, LookupKey>>
+  bool Contains(const LookupKey &key);
+
+  /**
+   * Gets the values of several keys. The buckets of a group of keys and the
+   * first node after each of them are prefetched before any key is searched,
+   * so their cache misses overlap
+   * @param keys the keys to look up
+   * @param num_keys the number of keys
+   * @param[out] values the value of each key (a default value if absent)
+   */
+  void MultiGet(const KeyType *keys, size_t num_keys, ValueType *values);
+
+  /**
+   * Checks which of several keys exist in the hash table
+   * @param keys the keys to check
+   * @param num_keys the number of keys
+   * @param[out] found whether each key exists
+   */
+  void MultiContains(const KeyType *keys, size_t num_keys, bool *found);
+
+  /**
+   * Inserts several key-value pairs into the hash table
+   * @param keys the keys to insert
+   * @param values the value of each key
+   * @param num_keys the number of key-value pairs
+   */
+  void MultiInsert(const KeyType *keys, const ValueType *values,
+                   size_t num_keys);
+
+  /**
+   * Gets the runtime statistics of the hash table (see TableStats). Growing
+   * only doubles the bucket count, so resizes take next to no time; buckets
+   * share a single list, so there is no chain length
+   * @return a snapshot of the statistics
+   */
+  TableStats Stats();
 
  private:
   /**
-   * Calculates the index into the hash table given a key
-   * @param key the key to calculate index from
-   * @return the index into the hash table
+   * Calculates the hash of a key
+   * @param key the key to hash
+   * @return the hash of that key
+   */
+  template <typename LookupKey>
+  size_t Hash(const LookupKey &key) const {
+    return KeyHash<KeyType>{}(key);
+  }
+
+  /**
+   * Runs a write on the value of a key, see AtomicLinkedList::Upsert
+   * @param key the key to write
+   * @param insert whether to insert the key, with a value-initialized value,
+   * if it does not exist
+   * @param fn called as fn(value, found)
+   * @return true if the key existed; otherwise, false
+   */
+  template <typename Fn>
+  bool Upsert(const KeyType &key, bool insert, Fn fn);
+
+  /**
+   * Links a new node for a key if it does not exist, see
+   * AtomicLinkedList::Emplace
+   * @param[out] existing the value of the key if it exists, if not nullptr
+   * @param key the key to insert, moved into the node if an rvalue
+   * @param args the arguments of the value's constructor
+   * @return true if the key was inserted; false if it existed
    */
-  size_t KeyToIndex(const KeyType &key) const {
-    return std::hash<KeyType>{}(key) % capacity_;
+  template <typename KeyArg, typename... Args>
+  bool EmplaceNode(ValueType *existing, KeyArg &&key, Args &&...args);
+
+  /**
+   * Calculates the order key of a key-value pair: the reversed hash with the
+   * lowest bit set, so that it sorts after the sentinel of its bucket
+   * @param hash the hash of the key
+   * @return the order key of the key-value pair
+   */
+  static size_t RegularOrderKey(size_t hash) {
+    return ReverseBits(hash) | 0x1;
   }
 
-  // Default size of the hash table
-  // Grow hash table needs a lock, so choose a default size for the hash table
-  // Costs memory but gets a very fast performance
-  static constexpr size_t DEFAULT_CAPACITY{100017};
+  /**
+   * Calculates the order key of the sentinel node of a bucket
+   * @param bucket the index of the bucket
+   * @return the order key of the sentinel
+   */
+  static size_t SentinelOrderKey(size_t bucket) { return ReverseBits(bucket); }
+
+  /**
+   * Reverses the bits of a 64-bit word
+   * @param x the word to reverse
+   * @return the reversed word
+   */
+  static uint64_t ReverseBits(uint64_t x) {
+    x = ((x >> 1) & 0x5555555555555555ULL) | ((x & 0x5555555555555555ULL) << 1);
+    x = ((x >> 2) & 0x3333333333333333ULL) | ((x & 0x3333333333333333ULL) << 2);
+    x = ((x >> 4) & 0x0f0f0f0f0f0f0f0fULL) | ((x & 0x0f0f0f0f0f0f0f0fULL) << 4);
+    return __builtin_bswap64(x);
+  }
+
+  /**
+   * Gets the sentinel of a bucket, initializing the bucket on first use
+   * @param bucket the index of the bucket
+   * @return the `next` pointer of the bucket's sentinel
+   */
+  MarkPtrType *GetBucket(size_t bucket);
+
+  /**
+   * Splices the sentinel of a bucket into the list after the sentinel of its
+   * parent bucket (the bucket index without its most significant bit), and
+   * publishes it in the bucket. Concurrent callers each try to link their own
+   * sentinel; the losers free theirs and publish the winner's
+   * @param bucket the index of the bucket
+   * @return the `next` pointer of the bucket's sentinel
+   */
+  MarkPtrType *InitializeBucket(size_t bucket);
+
+  /**
+   * Locates a bucket, allocating its segment on first use. Segment 0 holds
+   * the first `first_segment_size_` buckets and segment i > 0 holds the
+   * buckets [first_segment_size_ << (i - 1), first_segment_size_ << i)
+   * @param bucket the index of the bucket
+   * @return a reference to that bucket
+   */
+  Bucket &LocateBucket(size_t bucket);
+
+  /**
+   * Resolves the buckets of a group of keys in three passes, prefetching the
+   * bucket slots, then the sentinels, then the first node after each
+   * sentinel. A bucket
+   * stays a valid starting point after the table grows, since it precedes
+   * the buckets split from it
+   * @param keys the keys whose buckets to resolve
+   * @param num_keys the number of keys, at most PREFETCH_BATCH
+   * @param[out] hashes the hash of each key
+   * @param[out] buckets the sentinel `next` pointer of each key's bucket
+   */
+  void PrefetchBuckets(const KeyType *keys, size_t num_keys, size_t *hashes,
+                       MarkPtrType **buckets);
+
+  /**
+   * Doubles the number of buckets if the hash table got dense. No node is
+   * moved; the new buckets are initialized lazily
+   */
+  void MaybeGrow();
+
+  // Default hash table value
+  static constexpr size_t DEFAULT_CAPACITY{128};
   static constexpr float DEFAULT_LOAD_FACTOR{0.75};
+  static constexpr size_t MAX_SEGMENTS{64};
+  // Number of keys of a batch operation whose buckets are prefetched together
+  static constexpr size_t PREFETCH_BATCH{16};
 
-  size_t capacity_; // number of buckets
+  size_t first_segment_size_;      // number of buckets in segment 0
+  int first_segment_shift_;        // log2 of first_segment_size_
+  std::atomic<size_t> capacity_;   // number of buckets (a power of two)
   float max_load_factor_;
-  std::atomic<size_t> size_{0};  // current number of key-value pairs in the hash table
-  AtomicLinkedList<KeyType, ValueType> *table_; // array of buckets
-  ReaderWriterLock lock_; // global reader/writer lock
+  ShardedCounter size_;  // current number of key-value pairs in the hash table
+  List list_;  // split-ordered list holding every key-value pair
+  std::atomic<Bucket *> segments_[MAX_SEGMENTS]{};  // segments of buckets
 };
 
 #include "lock_free_hash_table.cpp"
@@ -0,0 +1,301 @@
+#ifndef NODE_POOL_H_
+#define NODE_POOL_H_
+
+#include <cstddef>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+/**
+ * Fixed-size block allocator for one size class.
+ *
+ * Every thread owns a cache holding a free list and the unused tail of a
+ * slab, so an allocation is a free-list pop or a pointer bump. Freed blocks go
+ * back to the free list of the freeing thread; once it holds more than two
+ * batches, one batch is handed to the global pool in a single locked step,
+ * where any thread that runs dry can pick it up. Slabs are aligned to cache
+ * lines and block sizes divide (or are multiples of) the cache line size, so a
+ * block never straddles two lines unnecessarily.
+ */
+template <size_t BlockSize>
+class SizeClassPool {
+  static_assert(BlockSize % 16 == 0, "block size must be a size class");
+
+ public:
+  /**
+   * Allocates a block of BlockSize bytes
+   * @return a pointer to the block
+   */
+  static void *Allocate() {
+    LocalCache *cache = GetLocalCache();
+    if (cache == nullptr) {
+      return Global().AllocateSlow();
+    }
+    if (cache->free_list_ == nullptr && cache->bump_ == cache->bump_end_) {
+      // Prefer blocks other threads gave back over a fresh slab
+      Global().Refill(cache);
+      if (cache->free_list_ == nullptr) {
+        cache->bump_ = Global().NewSlab();
+        cache->bump_end_ = cache->bump_ + BLOCKS_PER_SLAB * BlockSize;
+      }
+    }
+    if (cache->free_list_ != nullptr) {
+      FreeBlock *block = cache->free_list_;
+      cache->free_list_ = block->next_;
+      --cache->free_count_;
+      return block;
+    }
+    void *block = cache->bump_;
+    cache->bump_ += BlockSize;
+    return block;
+  }
+
+  /**
+   * Returns a block to the pool
+   * @param ptr a block obtained from Allocate()
+   */
+  static void Deallocate(void *ptr) {
+    auto block = static_cast<FreeBlock *>(ptr);
+    LocalCache *cache = GetLocalCache();
+    if (cache == nullptr) {
+      Global().Release(block, block, 1);
+      return;
+    }
+    block->next_ = cache->free_list_;
+    cache->free_list_ = block;
+    if (++cache->free_count_ > 2 * BATCH_SIZE) {
+      // Hand the oldest batch over to the global pool
+      FreeBlock *last = block;
+      for (size_t i = 1; i < BATCH_SIZE; ++i) {
+        last = last->next_;
+      }
+      FreeBlock *rest = last->next_;
+      last->next_ = nullptr;
+      Global().Release(rest, nullptr, cache->free_count_ - BATCH_SIZE);
+      cache->free_list_ = block;
+      cache->free_count_ = BATCH_SIZE;
+    }
+  }
+
+ private:
+  struct FreeBlock {
+    FreeBlock *next_;
+  };
+
+  /**
+   * Per-thread cache, only touched by its owner
+   */
+  struct LocalCache {
+    FreeBlock *free_list_{nullptr};  // recycled blocks
+    size_t free_count_{0};           // length of free_list_
+    char *bump_{nullptr};            // next unused byte of the current slab
+    char *bump_end_{nullptr};        // end of the current slab
+
+    ~LocalCache() {
+      if (free_list_ != nullptr) {
+        Global().Release(free_list_, nullptr, free_count_);
+      }
+    }
+  };
+
+  /**
+   * Shared pool of free batches and owner of every slab
+   */
+  struct GlobalPool {
+    std::mutex mutex_;
+    // Chains of free blocks and their lengths
+    std::vector<std::pair<FreeBlock *, size_t>> batches_;
+    std::vector<void *> slabs_;  // every slab ever allocated
+
+    /**
+     * Moves one batch from the global pool into a thread cache
+     * @param cache the cache to refill
+     */
+    void Refill(LocalCache *cache) {
+      std::lock_guard<std::mutex> guard(mutex_);
+      if (batches_.empty()) {
+        return;
+      }
+      cache->free_list_ = batches_.back().first;
+      cache->free_count_ = batches_.back().second;
+      batches_.pop_back();
+    }
+
+    /**
+     * Returns a chain of free blocks to the global pool
+     * @param head the first block of the chain
+     * @param tail the last block of the chain, or nullptr if the chain is
+     * already terminated
+     * @param count the number of blocks in the chain
+     */
+    void Release(FreeBlock *head, FreeBlock *tail, size_t count) {
+      if (tail != nullptr) {
+        tail->next_ = nullptr;
+      }
+      std::lock_guard<std::mutex> guard(mutex_);
+      batches_.emplace_back(head, count);
+    }
+
+    /**
+     * Allocates a cache-line-aligned slab
+     * @return a pointer to the slab
+     */
+    char *NewSlab() {
+      void *slab = std::aligned_alloc(CACHE_LINE_SIZE, SLAB_SIZE);
+      if (slab == nullptr) {
+        throw std::bad_alloc();
+      }
+      std::lock_guard<std::mutex> guard(mutex_);
+      slabs_.push_back(slab);
+      return static_cast<char *>(slab);
+    }
+
+    /**
+     * Allocates a block for a thread whose cache is already destroyed
+     * @return a pointer to the block
+     */
+    void *AllocateSlow() {
+      {
+        std::lock_guard<std::mutex> guard(mutex_);
+        if (!batches_.empty()) {
+          auto &batch = batches_.back();
+          FreeBlock *block = batch.first;
+          batch.first = block->next_;
+          if (--batch.second == 0) {
+            batches_.pop_back();
+          }
+          return block;
+        }
+      }
+      // Give the rest of the slab back as one batch
+      char *slab = NewSlab();
+      size_t count = BLOCKS_PER_SLAB - 1;
+      for (size_t i = 1; i < count; ++i) {
+        reinterpret_cast<FreeBlock *>(slab + i * BlockSize)->next_ =
+            reinterpret_cast<FreeBlock *>(slab + (i + 1) * BlockSize);
+      }
+      Release(reinterpret_cast<FreeBlock *>(slab + BlockSize),
+              reinterpret_cast<FreeBlock *>(slab + count * BlockSize), count);
+      return slab;
+    }
+  };
+
+  /**
+   * Owns the cache of a thread and flushes it when the thread exits
+   */
+  struct CacheHolder {
+    LocalCache cache_;
+
+    CacheHolder() { local_cache_ = &cache_; }
+    ~CacheHolder() {
+      local_cache_ = nullptr;
+      cache_destroyed_ = true;
+    }
+  };
+
+  /**
+   * Gets the cache of the calling thread
+   * @return the cache, or nullptr once the thread is tearing down
+   */
+  static LocalCache *GetLocalCache() {
+    if (local_cache_ == nullptr && !cache_destroyed_) {
+      static thread_local CacheHolder holder;
+    }
+    return local_cache_;
+  }
+
+  /**
+   * Gets the global pool. It is intentionally never destroyed, since blocks
+   * may still be freed by the epoch manager during static destruction
+   * @return a reference to the global pool
+   */
+  static GlobalPool &Global() {
+    static GlobalPool *pool = new GlobalPool();
+    return *pool;
+  }
+
+  static constexpr size_t CACHE_LINE_SIZE{64};
+  static constexpr size_t SLAB_SIZE{64 * 1024};
+  static constexpr size_t BATCH_SIZE{256};
+  static constexpr size_t BLOCKS_PER_SLAB{SLAB_SIZE / BlockSize};
+  static_assert(BLOCKS_PER_SLAB >= 2, "block size is too large for a slab");
+
+  static inline thread_local LocalCache *local_cache_{nullptr};
+  static inline thread_local bool cache_destroyed_{false};
+};
+
+/**
+ * Node allocator that uses plain new/delete
+ */
+struct HeapAllocator {
+  template <typename T, typename... Args>
+  static T *New(Args &&...args) {
+    return new T(std::forward<Args>(args)...);
+  }
+
+  template <typename T>
+  static void Delete(T *ptr) {
+    delete ptr;
+  }
+};
+
+/**
+ * Node allocator backed by per-thread size-class pools. Objects larger than
+ * MAX_POOLED_SIZE fall back to the heap
+ */
+struct PoolAllocator {
+  static constexpr size_t MAX_POOLED_SIZE{4096};
+
+  /**
+   * Rounds an object size up to its size class: 16, 32 or 64 bytes, or a
+   * multiple of the cache line size
+   * @param size the size of the object
+   * @return the block size of the size class
+   */
+  static constexpr size_t SizeClass(size_t size) {
+    if (size <= 16) {
+      return 16;
+    }
+    if (size <= 32) {
+      return 32;
+    }
+    return (size + 63) / 64 * 64;
+  }
+
+  template <typename T, typename... Args>
+  static T *New(Args &&...args) {
+    if constexpr (IsPooled<T>()) {
+      void *block = SizeClassPool<SizeClass(sizeof(T))>::Allocate();
+      return new (block) T(std::forward<Args>(args)...);
+    } else {
+      return HeapAllocator::New<T>(std::forward<Args>(args)...);
+    }
+  }
+
+  template <typename T>
+  static void Delete(T *ptr) {
+    if constexpr (IsPooled<T>()) {
+      ptr->~T();
+      SizeClassPool<SizeClass(sizeof(T))>::Deallocate(ptr);
+    } else {
+      HeapAllocator::Delete(ptr);
+    }
+  }
+
+ private:
+  /**
+   * Checks whether objects of a type are served from a pool: they must be
+   * small and pool blocks must satisfy their alignment
+   * @return true if the type is pooled; otherwise, false
+   */
+  template <typename T>
+  static constexpr bool IsPooled() {
+    return SizeClass(sizeof(T)) <= MAX_POOLED_SIZE &&
+           (alignof(T) <= 16 || SizeClass(sizeof(T)) % alignof(T) == 0) &&
+           alignof(T) <= 64;
+  }
+};
+
+#endif  // NODE_POOL_H_
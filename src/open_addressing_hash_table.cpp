@@ -0,0 +1,438 @@
+#include "open_addressing_hash_table.h"
+
+template <typename KeyType, typename ValueType>
+OpenAddressingHashTable<KeyType, ValueType>::OpenAddressingHashTable(
+    size_t capacity, float max_load_factor)
+    : max_load_factor_(max_load_factor) {
+  size_t num_slots = 2;
+  while (num_slots < capacity) {
+    num_slots <<= 1;
+  }
+  table_ = new Table(num_slots);
+}
+
+template <typename KeyType, typename ValueType>
+OpenAddressingHashTable<KeyType, ValueType>::~OpenAddressingHashTable() {
+  // Every migration is finished by the operation that started it
+  delete table_.load();
+}
+
+template <typename KeyType, typename ValueType>
+template <typename LookupKey, typename>
+ValueType OpenAddressingHashTable<KeyType, ValueType>::Get(
+    const LookupKey &key) {
+  // The epoch keeps a table replaced by a migration alive while we probe it
+  EpochManager::Guard guard;
+  Slot *slot = FindSlot(table_.load(std::memory_order_acquire), key);
+  if (slot == nullptr) {
+    return ValueType{};
+  }
+  return FromWord(LoadWord(*slot));
+}
+
+template <typename KeyType, typename ValueType>
+template <typename LookupKey, typename>
+std::optional<ValueType> OpenAddressingHashTable<KeyType, ValueType>::TryGet(
+    const LookupKey &key) {
+  EpochManager::Guard guard;
+  Slot *slot = FindSlot(table_.load(std::memory_order_acquire), key);
+  if (slot == nullptr) {
+    return std::nullopt;
+  }
+  return FromWord(LoadWord(*slot));
+}
+
+template <typename KeyType, typename ValueType>
+template <typename LookupKey, typename Fn, typename>
+bool OpenAddressingHashTable<KeyType, ValueType>::Find(
+    const LookupKey &key, Fn fn) {
+  // A value shares its word with the slot state and is only read as a copy
+  std::optional<ValueType> value = TryGet<LookupKey>(key);
+  if (value.has_value()) {
+    fn(std::as_const(*value));
+  }
+  return value.has_value();
+}
+
+template <typename KeyType, typename ValueType>
+template <typename LookupKey, typename>
+bool OpenAddressingHashTable<KeyType, ValueType>::Contains(
+    const LookupKey &key) {
+  EpochManager::Guard guard;
+  return FindSlot(table_.load(std::memory_order_acquire), key) != nullptr;
+}
+
+template <typename KeyType, typename ValueType>
+bool OpenAddressingHashTable<KeyType, ValueType>::InsertOrAssign(
+    const KeyType &key, const ValueType &value) {
+  return !Upsert(key, true,
+                 [&value](ValueType &current, bool) { current = value; });
+}
+
+template <typename KeyType, typename ValueType>
+bool OpenAddressingHashTable<KeyType, ValueType>::TryEmplace(
+    const KeyType &key, const ValueType &value, ValueType *existing) {
+  return !Upsert(key, true, [&](ValueType &current, bool found) {
+    if (!found) {
+      current = value;
+    } else if (existing != nullptr) {
+      *existing = current;
+    }
+  });
+}
+
+template <typename KeyType, typename ValueType>
+template <typename Fn>
+bool OpenAddressingHashTable<KeyType, ValueType>::Update(
+    const KeyType &key, Fn fn) {
+  return Upsert(key, false, [&fn](ValueType &current, bool) { fn(current); });
+}
+
+template <typename KeyType, typename ValueType>
+template <typename Fn>
+ValueType OpenAddressingHashTable<KeyType, ValueType>::Compute(
+    const KeyType &key, Fn fn) {
+  ValueType result{};
+  Upsert(key, true, [&](ValueType &current, bool) {
+    fn(current);
+    result = current;
+  });
+  return result;
+}
+
+template <typename KeyType, typename ValueType>
+template <typename LookupKey, typename>
+void OpenAddressingHashTable<KeyType, ValueType>::Delete(const LookupKey &key) {
+  EpochManager::Guard guard;
+  while (true) {
+    Table *table = CurrentTable();
+    if (DeleteSlot(table, key) != MIGRATING) {
+      return;
+    }
+    HelpMigrate(table);
+  }
+}
+
+template <typename KeyType, typename ValueType>
+template <typename LookupKey>
+typename OpenAddressingHashTable<KeyType, ValueType>::Slot *
+OpenAddressingHashTable<KeyType, ValueType>::FindSlot(
+    const Table *table, const LookupKey &key) const {
+  size_t mask = table->capacity_ - 1;
+  size_t idx = KeyToIndex(table, key);
+  for (size_t n = 0; n < table->capacity_; ++n, idx = (idx + 1) & mask) {
+    Slot &slot = table->slots_[idx];
+    uint64_t state = StateOf(LoadState(slot));
+    // A MOVED slot was EMPTY, or not published yet, when it was frozen
+    if (state == EMPTY || state == MOVED) {
+      return nullptr;
+    }
+    // A BUSY slot belongs to an insertion that has not taken effect yet, and
+    // a tombstone for the key may be followed by a newer copy of it. A FROZEN
+    // slot still holds the latest value of its key
+    if ((state == FULL || state == FROZEN) &&
+        KeyEqual<KeyType>{}(slot.key_, key)) {
+      return &slot;
+    }
+  }
+  return nullptr;
+}
+
+template <typename KeyType, typename ValueType>
+uint64_t OpenAddressingHashTable<KeyType, ValueType>::WaitForSlot(
+    const Slot &slot) const {
+  uint64_t start = StatsCounters::Now();
+  uint64_t state;
+  while ((state = StateOf(LoadState(slot))) == BUSY) {
+    std::this_thread::yield();
+  }
+  stats_.AddLockWait(start);
+  return state;
+}
+
+template <typename KeyType, typename ValueType>
+template <typename Fn>
+bool OpenAddressingHashTable<KeyType, ValueType>::Upsert(
+    const KeyType &key, bool insert, Fn fn) {
+  // The epoch keeps a migrated table alive while we probe it
+  EpochManager::Guard guard;
+  while (true) {
+    Table *table = CurrentTable();
+    WriteResult result = UpsertSlot(table, key, insert, fn);
+    if (result == MIGRATING) {
+      HelpMigrate(table);
+      continue;
+    }
+    if (result == NO_SLOT) {
+      StartMigration(table);
+      continue;
+    }
+    if (result == INSERTED &&
+        table->used_.Exceeds(table->capacity_ * max_load_factor_)) {
+      StartMigration(table);
+    }
+    return result == UPDATED;
+  }
+}
+
+template <typename KeyType, typename ValueType>
+template <typename Fn>
+typename OpenAddressingHashTable<KeyType, ValueType>::WriteResult
+OpenAddressingHashTable<KeyType, ValueType>::UpsertSlot(
+    Table *table, const KeyType &key, bool insert, Fn &fn) {
+  size_t mask = table->capacity_ - 1;
+  size_t idx = KeyToIndex(table, key);
+  ValueType value{};
+  bool made = false;
+  for (size_t n = 0; n < table->capacity_; ++n, idx = (idx + 1) & mask) {
+    Slot &slot = table->slots_[idx];
+    uint64_t state = StateOf(LoadState(slot));
+    if (state == EMPTY) {
+      if (!insert) {
+        return NOT_FOUND;
+      }
+      // The value is made before the slot is claimed, so that writers that
+      // wait for the claim only wait for the key to be copied
+      if (!made) {
+        fn(value, false);
+        made = true;
+      }
+      if (CompareAndSwap(slot, EMPTY, 0, BUSY, 0)) {
+        slot.key_ = key;
+        // A migration that got to the slot first has closed it
+        if (!CompareAndSwap(slot, BUSY, 0, FULL, ToWord(value))) {
+          return MIGRATING;
+        }
+        table->used_.Increment();
+        size_.Increment();
+        return INSERTED;
+      }
+      // Lost the slot
+      state = StateOf(LoadState(slot));
+    }
+    if (state == BUSY) {
+      // Another insertion of the same key may own this slot
+      state = WaitForSlot(slot);
+    }
+    if (state == FROZEN || state == MOVED) {
+      return MIGRATING;
+    }
+    if (state == FULL && KeyEqual<KeyType>{}(slot.key_, key)) {
+      uint64_t expected = LoadWord(slot);
+      while (true) {
+        ValueType desired = FromWord(expected);
+        fn(desired, true);
+        uint64_t word = ToWord(desired);
+        if (word == expected ||
+            CompareAndSwap(slot, FULL, expected, FULL, word)) {
+          return UPDATED;
+        }
+        state = StateOf(LoadState(slot));
+        if (state != FULL) {
+          break;
+        }
+        expected = LoadWord(slot);
+      }
+      // If the key was deleted meanwhile, insert it again further down
+      if (state != DELETED) {
+        return MIGRATING;
+      }
+    }
+  }
+  return insert ? NO_SLOT : NOT_FOUND;
+}
+
+template <typename KeyType, typename ValueType>
+template <typename LookupKey>
+typename OpenAddressingHashTable<KeyType, ValueType>::WriteResult
+OpenAddressingHashTable<KeyType, ValueType>::DeleteSlot(
+    Table *table, const LookupKey &key) {
+  size_t mask = table->capacity_ - 1;
+  size_t idx = KeyToIndex(table, key);
+  for (size_t n = 0; n < table->capacity_; ++n, idx = (idx + 1) & mask) {
+    Slot &slot = table->slots_[idx];
+    uint64_t state = StateOf(LoadState(slot));
+    if (state == EMPTY) {
+      return NOT_FOUND;
+    }
+    if (state == BUSY) {
+      state = WaitForSlot(slot);
+    }
+    if (state == FROZEN || state == MOVED) {
+      return MIGRATING;
+    }
+    if (state == FULL && KeyEqual<KeyType>{}(slot.key_, key)) {
+      while (state == FULL) {
+        uint64_t word = LoadWord(slot);
+        if (CompareAndSwap(slot, FULL, word, DELETED, word)) {
+          size_.Decrement();
+          return REMOVED;
+        }
+        state = StateOf(LoadState(slot));
+      }
+      // A concurrent Delete won; the key may have been inserted again further
+      // down the probe sequence
+      if (state != DELETED) {
+        return MIGRATING;
+      }
+    }
+  }
+  return NOT_FOUND;
+}
+
+template <typename KeyType, typename ValueType>
+typename OpenAddressingHashTable<KeyType, ValueType>::Table *
+OpenAddressingHashTable<KeyType, ValueType>::CurrentTable() {
+  Table *table = table_.load(std::memory_order_acquire);
+  while (table->next_.load(std::memory_order_acquire) != nullptr) {
+    HelpMigrate(table);
+    table = table_.load(std::memory_order_acquire);
+  }
+  return table;
+}
+
+template <typename KeyType, typename ValueType>
+void OpenAddressingHashTable<KeyType, ValueType>::StartMigration(
+    Table *table) {
+  if (table->next_.load(std::memory_order_acquire) == nullptr) {
+    uint64_t start = StatsCounters::Now();
+    size_t size = size_.Load();
+    size_t capacity = table->capacity_;
+    while (size >= capacity * max_load_factor_ / 2) {
+      capacity *= 2;
+    }
+    // The new table is never smaller, so every frozen pair finds a slot
+    auto new_table = new Table(capacity);
+    new_table->resize_start_ = start;
+    Table *expected = nullptr;
+    if (!table->next_.compare_exchange_strong(expected, new_table,
+                                              std::memory_order_acq_rel)) {
+      // Another thread started the migration first
+      delete new_table;
+    }
+  }
+  HelpMigrate(table);
+}
+
+template <typename KeyType, typename ValueType>
+void OpenAddressingHashTable<KeyType, ValueType>::HelpMigrate(Table *table) {
+  size_t num_chunks = table->NumChunks();
+  size_t chunk;
+  while ((chunk = table->next_chunk_.fetch_add(
+              1, std::memory_order_relaxed)) < num_chunks) {
+    MigrateChunk(table, chunk);
+  }
+  // Rather than wait for a helper that claimed a chunk, migrate it again
+  for (chunk = 0; chunk < num_chunks; ++chunk) {
+    if (!table->chunk_done_[chunk].load(std::memory_order_acquire)) {
+      MigrateChunk(table, chunk);
+    }
+  }
+
+  Table *new_table = table->next_.load(std::memory_order_acquire);
+  Table *expected = table;
+  if (table_.compare_exchange_strong(expected, new_table,
+                                     std::memory_order_acq_rel)) {
+    // Readers may still probe the old table; it is freed once they are done
+    EpochManager::Instance().Retire(table);
+    stats_.AddResize(new_table->resize_start_);
+  }
+}
+
+template <typename KeyType, typename ValueType>
+void OpenAddressingHashTable<KeyType, ValueType>::MigrateChunk(Table *table,
+                                                               size_t chunk) {
+  size_t end = std::min(table->capacity_, (chunk + 1) * MIGRATION_CHUNK);
+  for (size_t idx = chunk * MIGRATION_CHUNK; idx < end; ++idx) {
+    MigrateSlot(table, idx);
+  }
+  table->chunk_done_[chunk].store(true, std::memory_order_release);
+}
+
+template <typename KeyType, typename ValueType>
+void OpenAddressingHashTable<KeyType, ValueType>::MigrateSlot(Table *table,
+                                                              size_t idx) {
+  Slot &slot = table->slots_[idx];
+  while (true) {
+    uint64_t state = StateOf(LoadState(slot));
+    uint64_t word = LoadWord(slot);
+    if (state == EMPTY || state == BUSY) {
+      // An insertion that has not published its slot retries in the new
+      // table
+      if (CompareAndSwap(slot, state, 0, MOVED, 0)) {
+        return;
+      }
+    } else if (state == FULL) {
+      if (CompareAndSwap(slot, FULL, word, FROZEN, word)) {
+        CopySlot(table, idx, word);
+        return;
+      }
+    } else if (state == FROZEN) {
+      CopySlot(table, idx, word);
+      return;
+    } else {
+      // Nothing to copy from a tombstone or a closed slot
+      return;
+    }
+  }
+}
+
+template <typename KeyType, typename ValueType>
+void OpenAddressingHashTable<KeyType, ValueType>::CopySlot(Table *table,
+                                                           size_t origin,
+                                                           uint64_t word) {
+  Table *new_table = table->next_.load(std::memory_order_acquire);
+  const KeyType &key = table->slots_[origin].key_;
+  uint64_t copying = COPYING | (uint64_t{origin} << STATE_BITS);
+  size_t mask = new_table->capacity_ - 1;
+  size_t idx = KeyToIndex(new_table, key);
+  for (size_t n = 0; n < new_table->capacity_; ++n, idx = (idx + 1) & mask) {
+    Slot &slot = new_table->slots_[idx];
+    uint64_t state = LoadState(slot);
+    if (state == EMPTY) {
+      if (CompareAndSwap(slot, EMPTY, 0, copying, word)) {
+        new_table->used_.Increment();
+        FinishCopy(table, slot, copying, word);
+        return;
+      }
+      // Another copy claimed the slot
+      state = LoadState(slot);
+    }
+    if (StateOf(state) == COPYING) {
+      FinishCopy(table, slot, state, LoadWord(slot));
+      if (state == copying) {
+        return;
+      }
+      // The copy of another key
+      continue;
+    }
+    // The key was copied already, and may have been updated or deleted since
+    // then. New tables only see BUSY and MOVED slots once promoted, when
+    // every copy is done
+    if ((state == FULL || state == DELETED || state == FROZEN) &&
+        KeyEqual<KeyType>{}(slot.key_, key)) {
+      return;
+    }
+  }
+}
+
+template <typename KeyType, typename ValueType>
+void OpenAddressingHashTable<KeyType, ValueType>::FinishCopy(Table *table,
+                                                             Slot &slot,
+                                                             uint64_t state,
+                                                             uint64_t word) {
+  // Racing helpers write the same bytes, so the key reads the same to
+  // everyone once the slot is FULL
+  slot.key_ = table->slots_[state >> STATE_BITS].key_;
+  CompareAndSwap(slot, state, word, FULL, word);
+}
+
+template <typename KeyType, typename ValueType>
+TableStats OpenAddressingHashTable<KeyType, ValueType>::Stats() {
+  EpochManager::Guard guard;
+  TableStats stats;
+  stats_.Collect(&stats);
+  stats.size_ = size_.Load();
+  stats.capacity_ = table_.load(std::memory_order_acquire)->capacity_;
+  return stats;
+}
\ No newline at end of file
@@ -0,0 +1,509 @@
+#ifndef OPEN_ADDRESSING_HASH_TABLE_H_
+#define OPEN_ADDRESSING_HASH_TABLE_H_
+
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include "epoch_manager.h"
+#include "index_policy.h"
+#include "key_traits.h"
+#include "sharded_counter.h"
+#include "table_stats.h"
+
+/**
+ * Open-addressing hash table with linear probing for trivially copyable keys
+ * and values of up to 8 bytes.
+ *
+ * Key-value pairs are stored inline in a flat array of slots, so a lookup
+ * reads consecutive slots instead of chasing node pointers. The state and the
+ * value of a slot share 16 bytes that are updated together with a
+ * double-width CAS. A slot moves through the states EMPTY -> BUSY -> FULL ->
+ * DELETED and never goes back, so a key stays immutable once its slot is FULL
+ * and every operation on a key probes through the same slots:
+ * - Get/Contains never block and never write shared memory
+ * - Insert claims an EMPTY slot with a CAS and publishes it as FULL, together
+ *   with the value, once the key is written
+ * - Delete turns a FULL slot into a tombstone (DELETED) with a CAS
+ * - Update/Compute replace the value of a FULL slot with a CAS
+ *
+ * Writes are not lock-free, though: a write that probes past a claimed
+ * (BUSY) slot cannot tell whether the slot is about to hold its key, so it
+ * waits until the slot is published. The value is made before the claim, so
+ * the window only spans copying the key, unless the inserting thread is
+ * preempted inside it; then writes probing through that slot wait for it to
+ * run again. Readers skip BUSY slots, and migrations close them (see below).
+ *
+ * Growing the table, or purging its tombstones, takes no lock and never waits
+ * for a claimed slot. The writer that finds the table too dense links a new
+ * table to it, and every writer that comes across the link helps migrate chunks
+ * of slots before it goes on in the new table. Migrating a slot freezes it with
+ * a CAS: FULL becomes FROZEN, which no write can change any more, and EMPTY (or
+ * a BUSY slot not yet published) becomes MOVED, which no insertion can claim; a
+ * write that loses to the freeze retries in the new table. A frozen pair is
+ * then copied with a CAS that any helper can finish, so a stalled helper never
+ * holds the migration up. Once every slot is migrated, the new table replaces
+ * the old one, which readers may keep probing (FROZEN reads as FULL and MOVED
+ * as EMPTY) until the epoch manager frees it.
+ */
+template <typename KeyType, typename ValueType>
+class OpenAddressingHashTable {
+  static_assert(std::is_trivially_copyable_v<KeyType> &&
+                    std::is_trivially_copyable_v<ValueType>,
+                "keys and values are stored inline and must be trivially "
+                "copyable");
+  static_assert(sizeof(ValueType) <= sizeof(uint64_t),
+                "values share a double-width CAS with the slot state and "
+                "must fit in 8 bytes");
+
+ private:
+  // Slot states, in the low STATE_BITS of the state word
+  static constexpr uint64_t EMPTY{0};    // never used
+  static constexpr uint64_t BUSY{1};     // claimed, key being written
+  static constexpr uint64_t FULL{2};     // holds a key-value pair
+  static constexpr uint64_t DELETED{3};  // tombstone
+  static constexpr uint64_t FROZEN{4};   // FULL, being copied by a migration
+  static constexpr uint64_t MOVED{5};    // EMPTY or BUSY, closed by a migration
+  // A copy into a new table whose key is not written yet; the rest of the
+  // state word is the index of the frozen slot the copy comes from
+  static constexpr uint64_t COPYING{6};
+  static constexpr int STATE_BITS{8};
+
+  struct alignas(16) Slot {
+    // The state word and the bytes of the value, updated together
+    uint64_t cell_[2]{EMPTY, 0};
+    KeyType key_;
+  };
+
+  /**
+   * An array of slots together with its size, and the state of its migration
+   * into a new table once it gets too dense
+   */
+  struct Table {
+    size_t capacity_;  // number of slots (a power of two)
+    Slot *slots_;      // array of slots
+    ShardedCounter used_;  // number of non-EMPTY slots
+    std::atomic<Table *> next_{nullptr};  // the table being migrated into
+    std::atomic<size_t> next_chunk_{0};   // the next chunk to migrate
+    std::unique_ptr<std::atomic<bool>[]> chunk_done_;  // migrated chunks
+    uint64_t resize_start_{0};  // when the migration into this table began
+
+    explicit Table(size_t capacity)
+        : capacity_(capacity),
+          slots_(new Slot[capacity]),
+          chunk_done_(new std::atomic<bool>[NumChunks()]()) {}
+    ~Table() { delete[] slots_; }
+
+    size_t NumChunks() const {
+      return (capacity_ + MIGRATION_CHUNK - 1) / MIGRATION_CHUNK;
+    }
+  };
+
+ public:
+  /**
+   * Default constructor
+   */
+  OpenAddressingHashTable()
+      : OpenAddressingHashTable(DEFAULT_CAPACITY, DEFAULT_LOAD_FACTOR) {}
+
+  /**
+   * Creates a new OpenAddressingHashTable instance
+   * @param capacity the initial number of slots (rounded up to a power of two)
+   * @param max_load_factor the maximum fraction of used slots (live entries
+   * and tombstones) before the table is migrated
+   */
+  OpenAddressingHashTable(size_t capacity, float max_load_factor);
+
+  /**
+   * Disallows copy
+   */
+  OpenAddressingHashTable(const OpenAddressingHashTable &other) = delete;
+  OpenAddressingHashTable &operator=(const OpenAddressingHashTable &other) =
+      delete;
+
+  /**
+   * Destroys an existing OpenAddressingHashTable instance
+   */
+  ~OpenAddressingHashTable();
+
+  size_t size() const { return size_.Load(); }
+
+  /**
+   * Gets the value of a key-value pair
+   * @param key the key of the key-value pair
+   * @return the value of that key
+   */
+  ValueType Get(const KeyType &key) { return Get<KeyType>(key); }
+
+  /**
+   * Gets the value of a key-value pair by a key of another type (see KeyHash)
+   * @param key the key of the key-value pair
+   * @return the value of that key
+   */
+  template <typename LookupKey,
+            typename = EnableIfLookupKey<KeyType, LookupKey>>
+  ValueType Get(const LookupKey &key);
+
+  /**
+   * Gets the value of a key-value pair, if the key exists
+   * @param key the key of the key-value pair
+   * @return the value of that key, or std::nullopt if the key does not exist
+   */
+  std::optional<ValueType> TryGet(const KeyType &key) {
+    return TryGet<KeyType>(key);
+  }
+
+  /**
+   * Gets the value of a key-value pair by a key of another type (see
+   * KeyHash), if the key exists
+   * @param key the key of the key-value pair
+   * @return the value of that key, or std::nullopt if the key does not exist
+   */
+  template <typename LookupKey,
+            typename = EnableIfLookupKey<KeyType, LookupKey>>
+  std::optional<ValueType> TryGet(const LookupKey &key);
+
+  /**
+   * Calls a function on the value of a key-value pair
+   * @param key the key of the key-value pair
+   * @param fn called with a const reference to a copy of the value, which
+   * fits in a word
+   * @return true if the key exists; otherwise, false
+   */
+  template <typename Fn>
+  bool Find(const KeyType &key, Fn fn) {
+    return Find<KeyType, Fn>(key, fn);
+  }
+
+  /**
+   * Calls a function on the value of a key-value pair, found by a key of
+   * another type (see KeyHash)
+   * @param key the key of the key-value pair
+   * @param fn called with a const reference to a copy of the value, which
+   * fits in a word
+   * @return true if the key exists; otherwise, false
+   */
+  template <typename LookupKey, typename Fn,
+            typename = EnableIfLookupKey<KeyType, LookupKey>>
+  bool Find(const LookupKey &key, Fn fn);
+
+  /**
+   * Inserts a key-value pair into the hash table
+   * @param key the key to insert
+   * @param value the value to insert
+   */
+  void Insert(const KeyType &key, const ValueType &value) {
+    InsertOrAssign(key, value);
+  }
+
+  /**
+   * Inserts a key-value pair, or assigns the value if the key exists
+   * @param key the key to insert
+   * @param value the value to insert or assign
+   * @return true if the key was inserted; false if it existed
+   */
+  bool InsertOrAssign(const KeyType &key, const ValueType &value);
+
+  /**
+   * Inserts a key-value pair only if the key does not exist
+   * @param key the key to insert
+   * @param value the value to insert
+   * @param[out] existing the value of the key if it exists, if not nullptr
+   * @return true if the key was inserted; false if it existed
+   */
+  bool TryEmplace(const KeyType &key, const ValueType &value,
+                  ValueType *existing = nullptr);
+
+  /**
+   * Inserts a key with a value constructed from some arguments, only if the
+   * key does not exist. Values are trivially copyable, so the value is built
+   * up front and copied into its slot like TryEmplace's
+   * @param key the key to insert
+   * @param args the arguments of the value's constructor
+   * @return true if the key was inserted; false if it existed
+   */
+  template <typename... Args>
+  bool Emplace(const KeyType &key, Args &&...args) {
+    return TryEmplace(key, ValueType(std::forward<Args>(args)...));
+  }
+
+  /**
+   * Atomically modifies the value of a key if it exists. The value is
+   * replaced with a compare-and-swap, so `fn` may run several times on
+   * copies of it; it must not access the hash table
+   * @param key the key to update
+   * @param fn called with a reference to (a copy of) the value
+   * @return true if the key exists; otherwise, false
+   */
+  template <typename Fn>
+  bool Update(const KeyType &key, Fn fn);
+
+  /**
+   * Atomically modifies the value of a key, inserting the key with a
+   * value-initialized value first if it does not exist. See Update
+   * @param key the key to update
+   * @param fn called with a reference to (a copy of) the value
+   * @return the modified value
+   */
+  template <typename Fn>
+  ValueType Compute(const KeyType &key, Fn fn);
+
+  /**
+   * Deletes a key-value pair from the hash table
+   * @param key the key to delete
+   */
+  void Delete(const KeyType &key) { Delete<KeyType>(key); }
+
+  /**
+   * Deletes a key-value pair from the hash table by a key of another type
+   * (see KeyHash)
+   * @param key the key to delete
+   */
+  template <typename LookupKey,
+            typename = EnableIfLookupKey<KeyType, LookupKey>>
+  void Delete(const LookupKey &key);
+
+  /**
+   * Checks if a key exists in the hash table
+   * @param key the key to check
+   * @return true if that key exists; otherwise, false
+   */
+  bool Contains(const KeyType &key) { return Contains<KeyType>(key); }
+
+  /**
+   * Checks if a key exists in the hash table, by a key of another type
+   * (see KeyHash)
+   * @param key the key to check
+   * @return true if that key exists; otherwise, false
+   */
+  template <typename LookupKey,
+            typename = EnableIfLookupKey<KeyType, LookupKey>>
+  bool Contains(const LookupKey &key);
+
+  /**
+   * Gets the runtime statistics of the hash table (see TableStats). Waiting
+   * for a claimed slot to be published counts as a lock wait
+   * @return a snapshot of the statistics
+   */
+  TableStats Stats();
+
+ private:
+  /**
+   * Calculates the home slot of a key. The hash is mixed before masking, as
+   * runs of consecutive integer keys would otherwise form one long probe
+   * cluster
+   * @param table the table to probe
+   * @param key the key to calculate index from
+   * @return the index of the first slot to probe
+   */
+  template <typename LookupKey>
+  size_t KeyToIndex(const Table *table, const LookupKey &key) const {
+    return MaskIndex::Index(KeyHash<KeyType>{}(key), table->capacity_);
+  }
+
+  /**
+   * Finds the slot holding a key
+   * @param table the table to probe
+   * @param key the key to search
+   * @return the slot holding that key, or nullptr if the key is absent
+   */
+  template <typename LookupKey>
+  Slot *FindSlot(const Table *table, const LookupKey &key) const;
+
+  /**
+   * Waits until a claimed slot is published. This is the only place where
+   * writes block, for as long as the claiming thread takes to copy its key
+   * @param slot the slot to wait for
+   * @return the state of the slot after publication
+   */
+  uint64_t WaitForSlot(const Slot &slot) const;
+
+  // Outcomes of UpsertSlot and DeleteSlot
+  enum WriteResult {
+    INSERTED,   // the key took a new slot
+    UPDATED,    // the value of an existing key was replaced
+    REMOVED,    // the key was deleted
+    NOT_FOUND,  // the key is absent and was not to be inserted
+    NO_SLOT,    // every slot on the probe sequence is used
+    MIGRATING,  // the table is being migrated; retry in the new one
+  };
+
+  /**
+   * Runs a write on the value of a key, migrating the table if it gets
+   * dense. Every write operation but Delete goes through here
+   * @param key the key to write
+   * @param insert whether to insert the key, with a value-initialized value,
+   * if it does not exist
+   * @param fn called as fn(value, found) with a reference to the value of the
+   * key (a copy, if it existed) and whether it existed; not called if the key
+   * is absent and not inserted
+   * @return true if the key existed; otherwise, false
+   */
+  template <typename Fn>
+  bool Upsert(const KeyType &key, bool insert, Fn fn);
+
+  /**
+   * Inserts or updates a key-value pair in one table. An existing value is
+   * replaced with a compare-and-swap, which is skipped if `fn` leaves the
+   * value unchanged. An update racing with a Delete of the same key may land
+   * on the tombstone and be lost
+   * @param table the table to insert into
+   * @param key the key to write
+   * @param insert whether to insert the key if it does not exist
+   * @param fn called as fn(value, found), see Upsert
+   * @return the outcome of the write
+   */
+  template <typename Fn>
+  WriteResult UpsertSlot(Table *table, const KeyType &key, bool insert,
+                         Fn &fn);
+
+  /**
+   * Deletes a key-value pair from one table
+   * @param table the table to delete from
+   * @param key the key to delete
+   * @return the outcome of the write
+   */
+  template <typename LookupKey>
+  WriteResult DeleteSlot(Table *table, const LookupKey &key);
+
+  /**
+   * Gets the table to write into, first helping to finish any migration
+   * @return the current table, which is not being migrated
+   */
+  Table *CurrentTable();
+
+  /**
+   * Links a new table to a table that got too dense, unless another thread
+   * did, and helps migrate into it. The new table doubles the capacity if
+   * the live entries alone exceed half of the load factor; otherwise the
+   * migration only purges the tombstones
+   * @param table the table to migrate
+   */
+  void StartMigration(Table *table);
+
+  /**
+   * Migrates the chunks of a table that no other thread has claimed, then
+   * those claimed but not finished yet, and promotes the new table
+   * @param table the table being migrated
+   */
+  void HelpMigrate(Table *table);
+
+  /**
+   * Migrates a chunk of slots and marks it as done
+   * @param table the table being migrated
+   * @param chunk the index of the chunk
+   */
+  void MigrateChunk(Table *table, size_t chunk);
+
+  /**
+   * Freezes a slot and copies its key-value pair into the new table. Safe to
+   * run any number of times, by any number of threads
+   * @param table the table being migrated
+   * @param idx the index of the slot
+   */
+  void MigrateSlot(Table *table, size_t idx);
+
+  /**
+   * Copies a frozen key-value pair into the new table, unless it is there
+   * already. A slot keeps its key once written, so the first copy is found
+   * on the probe sequence of the key even after it was deleted again
+   * @param table the table being migrated
+   * @param origin the index of the frozen slot
+   * @param word the bytes of the frozen value
+   */
+  void CopySlot(Table *table, size_t origin, uint64_t word);
+
+  /**
+   * Publishes a COPYING slot of the new table: writes its key and makes it
+   * FULL. Any thread may do so, since the key is in the frozen slot the copy
+   * comes from, and they all write the same bytes
+   * @param table the table being migrated
+   * @param slot the COPYING slot of the new table
+   * @param state the state word of that slot
+   * @param word the bytes of the value of that slot
+   */
+  void FinishCopy(Table *table, Slot &slot, uint64_t state, uint64_t word);
+
+  /**
+   * Loads the state word of a slot
+   * @param slot the slot to read
+   * @return the state word
+   */
+  static uint64_t LoadState(const Slot &slot) {
+    return __atomic_load_n(&slot.cell_[0], __ATOMIC_ACQUIRE);
+  }
+
+  /**
+   * Loads the bytes of the value of a slot
+   * @param slot the slot to read
+   * @return the bytes of the value
+   */
+  static uint64_t LoadWord(const Slot &slot) {
+    return __atomic_load_n(&slot.cell_[1], __ATOMIC_ACQUIRE);
+  }
+
+  /**
+   * Replaces the state and the value of a slot together, if the slot still
+   * holds the expected pair
+   * @param slot the slot to write
+   * @param state the expected state word
+   * @param word the expected bytes of the value
+   * @param new_state the new state word
+   * @param new_word the new bytes of the value
+   * @return true if the slot was replaced; otherwise, false
+   */
+  static bool CompareAndSwap(Slot &slot, uint64_t state, uint64_t word,
+                             uint64_t new_state, uint64_t new_word) {
+    // The state word is the low half on a little-endian machine
+    using Pair = unsigned __int128;
+    return __sync_bool_compare_and_swap(
+        reinterpret_cast<Pair *>(slot.cell_),
+        (static_cast<Pair>(word) << 64) | state,
+        (static_cast<Pair>(new_word) << 64) | new_state);
+  }
+
+  /**
+   * Gets the state of a slot from its state word
+   * @param state the state word
+   * @return the state
+   */
+  static uint64_t StateOf(uint64_t state) {
+    return state & ((uint64_t{1} << STATE_BITS) - 1);
+  }
+
+  static uint64_t ToWord(const ValueType &value) {
+    uint64_t word = 0;
+    std::memcpy(&word, &value, sizeof(ValueType));
+    return word;
+  }
+
+  static ValueType FromWord(uint64_t word) {
+    ValueType value;
+    std::memcpy(static_cast<void *>(&value), &word, sizeof(ValueType));
+    return value;
+  }
+
+  // Default hash table value
+  static constexpr size_t DEFAULT_CAPACITY{128};
+  // Linear probing degrades quickly above one half
+  static constexpr float DEFAULT_LOAD_FACTOR{0.5};
+  // Number of slots a helper migrates at a time
+  static constexpr size_t MIGRATION_CHUNK{1024};
+
+  float max_load_factor_;
+  std::atomic<Table *> table_;   // current array of slots
+  ShardedCounter size_;          // number of key-value pairs
+  StatsCounters stats_;  // event counters, empty without TABLE_STATS
+};
+
+#include "open_addressing_hash_table.cpp"
+
+#endif  // OPEN_ADDRESSING_HASH_TABLE_H_
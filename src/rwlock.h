@@ -2,7 +2,11 @@
 #define RWLOCK_H_
 
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <shared_mutex>
+#include <thread>
 
 class ReaderWriterLock {
  public:
@@ -13,6 +17,14 @@ class ReaderWriterLock {
     mutex_.lock_shared();
   }
 
+  /**
+   * Acquire a read lock if no writer holds it
+   * @return true if the lock was acquired; otherwise, false
+   */
+  bool TryReadLock() {
+    return mutex_.try_lock_shared();
+  }
+
   /**
    * Release a read lock
    */
@@ -27,6 +39,14 @@ class ReaderWriterLock {
     mutex_.lock();
   }
 
+  /**
+   * Acquire a write lock if nobody holds it
+   * @return true if the lock was acquired; otherwise, false
+   */
+  bool TryWriteLock() {
+    return mutex_.try_lock();
+  }
+
   /**
    * Release a write lock
    */
@@ -39,4 +59,186 @@ class ReaderWriterLock {
   std::shared_mutex mutex_;
 };
 
-#endif // RWLOCK_H_
\ No newline at end of file
+/**
+ * Reader-biased reader/writer lock (BRAVO, Dice and Kogan) with the same
+ * interface as ReaderWriterLock.
+ *
+ * While the lock is biased towards readers, a reader does not touch the
+ * lock at all: it publishes the address of the lock in its own visible-reader
+ * slot, a cache line that only it writes, and the underlying lock is left
+ * alone. A writer takes the underlying lock, revokes the bias and waits until
+ * no slot holds the lock any more. Since revocation scans every slot, the
+ * bias stays off for a while afterwards (REVOCATION_PENALTY times the time
+ * the revocation took); meanwhile readers use the underlying lock.
+ *
+ * The slots are shared by all BravoReaderWriterLock instances, so many
+ * locks (e.g. the stripes of FineHashTable) cost no more memory than one.
+ * A thread has a single slot: a thread already holding a biased read lock
+ * takes any further read lock the slow way.
+ */
+class BravoReaderWriterLock {
+ public:
+  /**
+   * Acquire a read lock
+   */
+  void ReadLock() {
+    if (TryFastReadLock()) {
+      return;
+    }
+    mutex_.lock_shared();
+    RestoreBias();
+  }
+
+  /**
+   * Acquire a read lock if no writer holds it
+   * @return true if the lock was acquired; otherwise, false
+   */
+  bool TryReadLock() {
+    if (TryFastReadLock()) {
+      return true;
+    }
+    if (!mutex_.try_lock_shared()) {
+      return false;
+    }
+    RestoreBias();
+    return true;
+  }
+
+  /**
+   * Release a read lock
+   */
+  void ReadUnlock() {
+    if (fast_lock_ == this) {
+      fast_lock_ = nullptr;
+      LocalSlot().lock_.store(nullptr, std::memory_order_release);
+      return;
+    }
+    mutex_.unlock_shared();
+  }
+
+  /**
+   * Acquire a write lock
+   */
+  void WriteLock() {
+    mutex_.lock();
+    RevokeBias();
+  }
+
+  /**
+   * Acquire a write lock if no writer holds it, then wait for the readers
+   * @return true if the lock was acquired; otherwise, false
+   */
+  bool TryWriteLock() {
+    if (!mutex_.try_lock()) {
+      return false;
+    }
+    RevokeBias();
+    return true;
+  }
+
+  /**
+   * Release a write lock
+   */
+  void WriteUnlock() {
+    mutex_.unlock();
+  }
+
+ private:
+  struct alignas(64) ReaderSlot {
+    // The lock the owning thread holds in read mode, nullptr if none
+    std::atomic<const BravoReaderWriterLock *> lock_{nullptr};
+  };
+
+  static constexpr size_t NUM_SLOTS{256};
+  // How many times the duration of a revocation the bias stays off
+  static constexpr int64_t REVOCATION_PENALTY{9};
+
+  /**
+   * Takes a read lock through the slot of the calling thread, if biased
+   * @return true if the lock was acquired; otherwise, false
+   */
+  bool TryFastReadLock() {
+    if (read_bias_.load(std::memory_order_relaxed)) {
+      ReaderSlot &slot = LocalSlot();
+      const BravoReaderWriterLock *expected = nullptr;
+      // The slot is only shared by threads that wrapped around NUM_SLOTS
+      if (slot.lock_.compare_exchange_strong(expected, this)) {
+        // Pairs with the revocation in RevokeBias (store-load ordering)
+        if (read_bias_.load()) {
+          fast_lock_ = this;
+          return true;
+        }
+        slot.lock_.store(nullptr, std::memory_order_release);
+      }
+    }
+    return false;
+  }
+
+  /**
+   * Turns the bias back on once allowed; the caller holds the underlying
+   * read lock, so no writer can be revoking now
+   */
+  void RestoreBias() {
+    if (!read_bias_.load(std::memory_order_relaxed) &&
+        Now() >= inhibit_until_.load(std::memory_order_relaxed)) {
+      read_bias_.store(true);
+    }
+  }
+
+  /**
+   * Turns the bias off and waits for the readers holding the lock through
+   * their slots; the caller holds the underlying write lock
+   */
+  void RevokeBias() {
+    if (read_bias_.load(std::memory_order_relaxed)) {
+      read_bias_.store(false);
+      int64_t start = Now();
+      for (ReaderSlot &slot : Slots()) {
+        while (slot.lock_.load() == this) {
+          std::this_thread::yield();
+        }
+      }
+      int64_t end = Now();
+      inhibit_until_.store(end + (end - start) * REVOCATION_PENALTY,
+                           std::memory_order_relaxed);
+    }
+  }
+
+  /**
+   * Gets the visible-reader slots shared by all locks
+   * @return the array of slots
+   */
+  static ReaderSlot (&Slots())[NUM_SLOTS] {
+    static ReaderSlot slots[NUM_SLOTS];
+    return slots;
+  }
+
+  /**
+   * Gets the slot of the calling thread, assigned round-robin on first use
+   * @return the slot of the calling thread
+   */
+  static ReaderSlot &LocalSlot() {
+    static std::atomic<size_t> next_slot{0};
+    static thread_local size_t slot = next_slot.fetch_add(1) % NUM_SLOTS;
+    return Slots()[slot];
+  }
+
+  /**
+   * Gets a monotonic timestamp
+   * @return the current time in nanoseconds
+   */
+  static int64_t Now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  // The lock whose read lock the calling thread holds through its slot
+  static inline thread_local const BravoReaderWriterLock *fast_lock_{nullptr};
+
+  std::atomic<bool> read_bias_{true};     // whether readers may use the slots
+  std::atomic<int64_t> inhibit_until_{0}; // time before which bias stays off
+  std::shared_mutex mutex_;               // underlying lock
+};
+
+#endif // RWLOCK_H_
@@ -0,0 +1,177 @@
+#ifndef SHARDED_COUNTER_H_
+#define SHARDED_COUNTER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+/**
+ * Counter split into cache-line-sized cells so that concurrent updates do not
+ * fight over a single cache line.
+ *
+ * A thread always updates the same cell (threads are spread over the cells
+ * round-robin), so in the common case an update is an uncontended atomic add
+ * on a line the thread already owns. The exact value is the sum of all cells
+ * and costs one read per cell. For frequent checks such as resize triggers,
+ * every cell also publishes its changes to a shared approximate total once
+ * they add up to BATCH, which keeps the shared line cold; the approximation
+ * is off by at most MaxError().
+ *
+ * That error would swamp small thresholds: a table sized for a hundred keys
+ * could never tell from the approximation that it is below its resize
+ * trigger, and would sum every cell on each insert. So until the counter
+ * first reaches SHARDING_CUTOFF times MaxError(), updates go straight to the
+ * shared total, which is then exact, like a plain atomic counter.
+ */
+class ShardedCounter {
+ public:
+  ShardedCounter() : num_cells_(NumCells()), cells_(new Cell[num_cells_]) {}
+
+  ShardedCounter(const ShardedCounter &other) = delete;
+  ShardedCounter &operator=(const ShardedCounter &other) = delete;
+
+  /**
+   * Adds a (possibly negative) amount to the counter
+   * @param delta the amount to add
+   */
+  void Add(int64_t delta) {
+    if (!sharded_.load(std::memory_order_relaxed)) {
+      int64_t total = approx_.fetch_add(delta, std::memory_order_relaxed) +
+                      delta;
+      if (total >= static_cast<int64_t>(SHARDING_CUTOFF * MaxError())) {
+        sharded_.store(true, std::memory_order_relaxed);
+      }
+      return;
+    }
+    Cell &cell = cells_[ThreadIndex() & (num_cells_ - 1)];
+    int64_t value = cell.value_.fetch_add(delta, std::memory_order_relaxed) +
+                    delta;
+    int64_t published = cell.published_.load(std::memory_order_relaxed);
+    int64_t pending = value - published;
+    // Losing the CAS means a thread sharing the cell published it meanwhile
+    if ((pending >= BATCH || pending <= -BATCH) &&
+        cell.published_.compare_exchange_strong(published, value,
+                                                std::memory_order_relaxed)) {
+      approx_.fetch_add(pending, std::memory_order_relaxed);
+    }
+  }
+
+  void Increment() { Add(1); }
+  void Decrement() { Add(-1); }
+
+  /**
+   * Gets the exact value of the counter (exact once concurrent updates
+   * have completed)
+   * @return the shared total plus the unpublished part of every cell
+   */
+  size_t Load() const {
+    int64_t sum = approx_.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < num_cells_; ++i) {
+      sum += cells_[i].value_.load(std::memory_order_relaxed) -
+             cells_[i].published_.load(std::memory_order_relaxed);
+    }
+    return sum > 0 ? sum : 0;
+  }
+
+  /**
+   * Gets the value of the counter without reading every cell
+   * @return a value within MaxError() of the exact value, and exact until the
+   * counter is sharded
+   */
+  size_t LoadApprox() const {
+    int64_t approx = approx_.load(std::memory_order_relaxed);
+    return approx > 0 ? approx : 0;
+  }
+
+  /**
+   * Checks whether the counter exceeds a threshold, only reading every cell
+   * when the approximation is too close to the threshold to tell. Once the
+   * counter is sharded, thresholds are at least the cutoff in practice (a
+   * table resizes before its size passes them), so that band is a small part
+   * of the range
+   * @param threshold the threshold to compare with
+   * @return true if the counter is greater than the threshold; otherwise,
+   * false
+   */
+  bool Exceeds(size_t threshold) const {
+    size_t approx = LoadApprox();
+    if (!sharded_.load(std::memory_order_relaxed)) {
+      return approx > threshold;
+    }
+    if (approx > threshold + MaxError()) {
+      return true;
+    }
+    if (approx + MaxError() <= threshold) {
+      return false;
+    }
+    return Load() > threshold;
+  }
+
+  /**
+   * Overwrites the value of the counter. Must not run concurrently with any
+   * other update
+   * @param value the new value
+   */
+  void Store(size_t value) {
+    for (size_t i = 0; i < num_cells_; ++i) {
+      cells_[i].value_.store(0, std::memory_order_relaxed);
+      cells_[i].published_.store(0, std::memory_order_relaxed);
+    }
+    approx_.store(value, std::memory_order_relaxed);
+    sharded_.store(value >= SHARDING_CUTOFF * MaxError(),
+                   std::memory_order_relaxed);
+  }
+
+  /**
+   * Gets the maximum distance between LoadApprox() and Load()
+   * @return the error bound of the approximation
+   */
+  size_t MaxError() const { return num_cells_ * BATCH; }
+
+ private:
+  struct alignas(64) Cell {
+    std::atomic<int64_t> value_{0};      // sum of the updates to this cell
+    std::atomic<int64_t> published_{0};  // part of value_ added to approx_
+  };
+
+  /**
+   * Gets the number of cells: one per hardware thread, rounded up to a power
+   * of two and capped at MAX_CELLS
+   * @return the number of cells
+   */
+  static size_t NumCells() {
+    size_t num_cells = 1;
+    while (num_cells < std::thread::hardware_concurrency() &&
+           num_cells < MAX_CELLS) {
+      num_cells <<= 1;
+    }
+    return num_cells;
+  }
+
+  /**
+   * Gets a small number identifying the calling thread, assigned on first use
+   * @return the index of the calling thread
+   */
+  static size_t ThreadIndex() {
+    static std::atomic<size_t> next_index{0};
+    static thread_local size_t index = next_index.fetch_add(1);
+    return index;
+  }
+
+  // Unpublished amount at which a cell updates the approximate total
+  static constexpr int64_t BATCH{16};
+  static constexpr size_t MAX_CELLS{64};
+  // Multiple of MaxError() at which updates start going to the cells
+  static constexpr size_t SHARDING_CUTOFF{8};
+
+  size_t num_cells_;                // number of cells (a power of two)
+  std::unique_ptr<Cell[]> cells_;   // per-thread cells
+  // Whether updates go to the cells; kept off the line of approx_, as every
+  // update reads it
+  std::atomic<bool> sharded_{false};
+  // Published total, plus the updates made before the counter was sharded
+  alignas(64) std::atomic<int64_t> approx_{0};
+};
+
+#endif  // SHARDED_COUNTER_H_
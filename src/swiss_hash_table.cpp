@@ -0,0 +1,473 @@
+#include "swiss_hash_table.h"
+
+template <typename KeyType, typename ValueType>
+SwissHashTable<KeyType, ValueType>::SwissHashTable(size_t capacity,
+                                                   float max_load_factor)
+    : max_load_factor_(max_load_factor) {
+  size_t num_groups = 1;
+  while (num_groups * GROUP_SIZE < capacity) {
+    num_groups <<= 1;
+  }
+  table_ = new Table(num_groups);
+}
+
+template <typename KeyType, typename ValueType>
+SwissHashTable<KeyType, ValueType>::~SwissHashTable() {
+  resize_lock_.WriteLock();
+  delete table_.load();
+  resize_lock_.WriteUnlock();
+}
+
+template <typename KeyType, typename ValueType>
+template <typename LookupKey, typename>
+ValueType SwissHashTable<KeyType, ValueType>::Get(const LookupKey &key) {
+  // The epoch keeps a table replaced by Rebuild alive while we probe it
+  EpochManager::Guard guard;
+  ValueType value{};
+  FindOptimistic(table_.load(std::memory_order_acquire), Hash(key), key,
+                 &value);
+  return value;
+}
+
+template <typename KeyType, typename ValueType>
+template <typename LookupKey, typename>
+std::optional<ValueType> SwissHashTable<KeyType, ValueType>::TryGet(
+    const LookupKey &key) {
+  EpochManager::Guard guard;
+  ValueType value{};
+  if (!FindOptimistic(table_.load(std::memory_order_acquire), Hash(key), key,
+                      &value)) {
+    return std::nullopt;
+  }
+  return value;
+}
+
+template <typename KeyType, typename ValueType>
+template <typename LookupKey, typename Fn, typename>
+bool SwissHashTable<KeyType, ValueType>::Find(
+    const LookupKey &key, Fn fn) {
+  // Readers never lock, so the function gets a validated copy
+  std::optional<ValueType> value = TryGet<LookupKey>(key);
+  if (value.has_value()) {
+    fn(std::as_const(*value));
+  }
+  return value.has_value();
+}
+
+template <typename KeyType, typename ValueType>
+template <typename LookupKey, typename>
+bool SwissHashTable<KeyType, ValueType>::Contains(const LookupKey &key) {
+  EpochManager::Guard guard;
+  return FindOptimistic(table_.load(std::memory_order_acquire), Hash(key),
+                        key, nullptr);
+}
+
+template <typename KeyType, typename ValueType>
+bool SwissHashTable<KeyType, ValueType>::InsertOrAssign(
+    const KeyType &key, const ValueType &value) {
+  return !Upsert(key, true,
+                 [&value](ValueType &current, bool) { current = value; });
+}
+
+template <typename KeyType, typename ValueType>
+bool SwissHashTable<KeyType, ValueType>::TryEmplace(
+    const KeyType &key, const ValueType &value, ValueType *existing) {
+  return !Upsert(key, true, [&](ValueType &current, bool found) {
+    if (!found) {
+      current = value;
+    } else if (existing != nullptr) {
+      *existing = current;
+    }
+  });
+}
+
+template <typename KeyType, typename ValueType>
+template <typename Fn>
+bool SwissHashTable<KeyType, ValueType>::Update(
+    const KeyType &key, Fn fn) {
+  return Upsert(key, false, [&fn](ValueType &current, bool) { fn(current); });
+}
+
+template <typename KeyType, typename ValueType>
+template <typename Fn>
+ValueType SwissHashTable<KeyType, ValueType>::Compute(
+    const KeyType &key, Fn fn) {
+  ValueType result{};
+  Upsert(key, true, [&](ValueType &current, bool) {
+    fn(current);
+    result = current;
+  });
+  return result;
+}
+
+template <typename KeyType, typename ValueType>
+template <typename Fn>
+bool SwissHashTable<KeyType, ValueType>::Upsert(
+    const KeyType &key, bool insert, Fn fn) {
+  uint64_t hash = Hash(key);
+  while (true) {
+    stats_.ReadLock(resize_lock_);
+    Table *table = table_.load(std::memory_order_acquire);
+    WriteResult result = UpsertSlot(table, hash, key, insert, fn);
+    bool rebuild =
+        result == NO_SLOT ||
+        (result == INSERTED &&
+         used_.Exceeds(table->num_groups_ * GROUP_SIZE * max_load_factor_));
+    resize_lock_.ReadUnlock();
+
+    if (rebuild) {
+      Rebuild();
+    }
+    if (result == INSERTED || result == UPDATED || result == NOT_FOUND) {
+      return result == UPDATED;
+    }
+    if (result == RETRY) {
+      std::this_thread::yield();
+    }
+  }
+}
+
+template <typename KeyType, typename ValueType>
+template <typename LookupKey, typename>
+void SwissHashTable<KeyType, ValueType>::Delete(const LookupKey &key) {
+  uint64_t hash = Hash(key);
+  while (true) {
+    stats_.ReadLock(resize_lock_);
+    WriteResult result =
+        DeleteSlot(table_.load(std::memory_order_acquire), hash, key);
+    resize_lock_.ReadUnlock();
+    if (result != RETRY) {
+      return;
+    }
+    std::this_thread::yield();
+  }
+}
+
+template <typename KeyType, typename ValueType>
+uint32_t SwissHashTable<KeyType, ValueType>::Match(const uint8_t *ctrl,
+                                                   uint8_t byte) {
+#ifdef __SSE2__
+  __m128i group = _mm_load_si128(reinterpret_cast<const __m128i *>(ctrl));
+  return _mm_movemask_epi8(
+      _mm_cmpeq_epi8(group, _mm_set1_epi8(static_cast<char>(byte))));
+#else
+  uint32_t mask = 0;
+  for (size_t i = 0; i < GROUP_SIZE; ++i) {
+    mask |= static_cast<uint32_t>(ctrl[i] == byte) << i;
+  }
+  return mask;
+#endif
+}
+
+template <typename KeyType, typename ValueType>
+uint32_t SwissHashTable<KeyType, ValueType>::MatchFree(const uint8_t *ctrl) {
+  // EMPTY and DELETED are the only control bytes with the high bit set
+#ifdef __SSE2__
+  return _mm_movemask_epi8(
+      _mm_load_si128(reinterpret_cast<const __m128i *>(ctrl)));
+#else
+  uint32_t mask = 0;
+  for (size_t i = 0; i < GROUP_SIZE; ++i) {
+    mask |= static_cast<uint32_t>(ctrl[i] >> 7) << i;
+  }
+  return mask;
+#endif
+}
+
+template <typename KeyType, typename ValueType>
+template <typename LookupKey>
+bool SwissHashTable<KeyType, ValueType>::ScanGroup(const Group &group,
+                                                   uint8_t fingerprint,
+                                                   const LookupKey &key,
+                                                   size_t *slot,
+                                                   bool *has_empty) {
+  for (uint32_t match = Match(group.ctrl_, fingerprint); match != 0;
+       match &= match - 1) {
+    size_t idx = __builtin_ctz(match);
+    if (KeyEqual<KeyType>{}(group.slots_[idx].key_, key)) {
+      *slot = idx;
+      return true;
+    }
+  }
+  *has_empty = Match(group.ctrl_, EMPTY) != 0;
+  return false;
+}
+
+template <typename KeyType, typename ValueType>
+uint64_t SwissHashTable<KeyType, ValueType>::ReadBegin(const Group &group) {
+  uint64_t version;
+  while ((version = group.version_.load(std::memory_order_acquire)) & 1) {
+    std::this_thread::yield();
+  }
+  return version;
+}
+
+template <typename KeyType, typename ValueType>
+bool SwissHashTable<KeyType, ValueType>::ReadValidate(const Group &group,
+                                                      uint64_t version) {
+  // Orders the plain reads of the group before the second version read
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return group.version_.load(std::memory_order_relaxed) == version;
+}
+
+template <typename KeyType, typename ValueType>
+void SwissHashTable<KeyType, ValueType>::LockGroup(Group &group) const {
+  if (TryLockGroup(group)) {
+    return;
+  }
+  uint64_t start = StatsCounters::Now();
+  while (!TryLockGroup(group)) {
+    std::this_thread::yield();
+  }
+  stats_.AddLockWait(start);
+}
+
+template <typename KeyType, typename ValueType>
+bool SwissHashTable<KeyType, ValueType>::TryLockGroup(Group &group) {
+  uint64_t version = group.version_.load(std::memory_order_relaxed);
+  if ((version & 1) ||
+      !group.version_.compare_exchange_strong(version, version + 1,
+                                              std::memory_order_acquire)) {
+    return false;
+  }
+  // Keeps the writes to the group from becoming visible before the odd version
+  std::atomic_thread_fence(std::memory_order_release);
+  return true;
+}
+
+template <typename KeyType, typename ValueType>
+void SwissHashTable<KeyType, ValueType>::UnlockGroup(Group &group) {
+  group.version_.fetch_add(1, std::memory_order_release);
+}
+
+template <typename KeyType, typename ValueType>
+template <typename LookupKey>
+bool SwissHashTable<KeyType, ValueType>::FindOptimistic(
+    const Table *table, uint64_t hash, const LookupKey &key,
+    ValueType *value) const {
+  uint8_t fingerprint = Fingerprint(hash);
+  size_t idx = HomeGroup(table, hash);
+  for (size_t step = 1; step <= table->num_groups_;
+       idx = NextGroup(table, idx, step++)) {
+    const Group &group = table->groups_[idx];
+    while (true) {
+      uint64_t version = ReadBegin(group);
+      size_t slot;
+      bool has_empty = false;
+      bool found = ScanGroup(group, fingerprint, key, &slot, &has_empty);
+      ValueType copy{};
+      if (found && value != nullptr) {
+        copy = group.slots_[slot].value_;
+      }
+      if (!ReadValidate(group, version)) {
+        stats_.Add(StatsCounters::READ_RETRIES);
+        continue;
+      }
+      if (found) {
+        if (value != nullptr) {
+          *value = copy;
+        }
+        return true;
+      }
+      // Keys never skip a group with an EMPTY slot
+      if (has_empty) {
+        return false;
+      }
+      break;
+    }
+  }
+  return false;
+}
+
+template <typename KeyType, typename ValueType>
+template <typename LookupKey>
+bool SwissHashTable<KeyType, ValueType>::FindLocked(const Table *table,
+                                                    uint64_t hash,
+                                                    const LookupKey &key,
+                                                    size_t *group_idx,
+                                                    size_t *slot) const {
+  uint8_t fingerprint = Fingerprint(hash);
+  size_t home = HomeGroup(table, hash);
+  size_t idx = home;
+  for (size_t step = 1; step <= table->num_groups_;
+       idx = NextGroup(table, idx, step++)) {
+    const Group &group = table->groups_[idx];
+    bool has_empty = false;
+    bool found;
+    if (idx == home) {
+      found = ScanGroup(group, fingerprint, key, slot, &has_empty);
+    } else {
+      // Other writers may be filling this group with their own keys, but the
+      // key itself can only be added or removed under the home group's lock
+      uint64_t version;
+      do {
+        version = ReadBegin(group);
+        has_empty = false;
+        found = ScanGroup(group, fingerprint, key, slot, &has_empty);
+      } while (!ReadValidate(group, version));
+    }
+    if (found) {
+      *group_idx = idx;
+      return true;
+    }
+    if (has_empty) {
+      return false;
+    }
+  }
+  return false;
+}
+
+template <typename KeyType, typename ValueType>
+template <typename Fn>
+typename SwissHashTable<KeyType, ValueType>::WriteResult
+SwissHashTable<KeyType, ValueType>::UpsertSlot(Table *table, uint64_t hash,
+                                               const KeyType &key, bool insert,
+                                               Fn &fn) {
+  size_t home = HomeGroup(table, hash);
+  Group &home_group = table->groups_[home];
+  LockGroup(home_group);
+
+  size_t idx;
+  size_t slot;
+  if (FindLocked(table, hash, key, &idx, &slot)) {
+    Group &group = table->groups_[idx];
+    if (idx != home && !TryLockGroup(group)) {
+      UnlockGroup(home_group);
+      return RETRY;
+    }
+    fn(group.slots_[slot].value_, true);
+    if (idx != home) {
+      UnlockGroup(group);
+    }
+    UnlockGroup(home_group);
+    return UPDATED;
+  }
+  if (!insert) {
+    UnlockGroup(home_group);
+    return NOT_FOUND;
+  }
+
+  // The key goes to the first group of its probe sequence with a free slot
+  idx = home;
+  for (size_t step = 1; step <= table->num_groups_;
+       idx = NextGroup(table, idx, step++)) {
+    Group &group = table->groups_[idx];
+    if (idx != home && !TryLockGroup(group)) {
+      UnlockGroup(home_group);
+      return RETRY;
+    }
+    uint32_t free = MatchFree(group.ctrl_);
+    if (free != 0) {
+      slot = __builtin_ctz(free);
+      bool was_empty = group.ctrl_[slot] == EMPTY;
+      group.slots_[slot].key_ = key;
+      group.slots_[slot].value_ = ValueType{};
+      fn(group.slots_[slot].value_, false);
+      group.ctrl_[slot] = Fingerprint(hash);
+      if (idx != home) {
+        UnlockGroup(group);
+      }
+      UnlockGroup(home_group);
+      if (was_empty) {
+        used_.Increment();
+      }
+      size_.Increment();
+      return INSERTED;
+    }
+    if (idx != home) {
+      UnlockGroup(group);
+    }
+  }
+  UnlockGroup(home_group);
+  return NO_SLOT;
+}
+
+template <typename KeyType, typename ValueType>
+template <typename LookupKey>
+typename SwissHashTable<KeyType, ValueType>::WriteResult
+SwissHashTable<KeyType, ValueType>::DeleteSlot(Table *table, uint64_t hash,
+                                               const LookupKey &key) {
+  size_t home = HomeGroup(table, hash);
+  Group &home_group = table->groups_[home];
+  LockGroup(home_group);
+
+  size_t idx;
+  size_t slot;
+  if (!FindLocked(table, hash, key, &idx, &slot)) {
+    UnlockGroup(home_group);
+    return NOT_FOUND;
+  }
+  Group &group = table->groups_[idx];
+  if (idx != home && !TryLockGroup(group)) {
+    UnlockGroup(home_group);
+    return RETRY;
+  }
+  // A tombstone keeps probe sequences that run through this group intact
+  group.ctrl_[slot] = DELETED;
+  if (idx != home) {
+    UnlockGroup(group);
+  }
+  UnlockGroup(home_group);
+  size_.Decrement();
+  return UPDATED;
+}
+
+template <typename KeyType, typename ValueType>
+void SwissHashTable<KeyType, ValueType>::Rebuild() {
+  stats_.WriteLock(resize_lock_);
+  Table *old_table = table_.load();
+  size_t old_capacity = old_table->num_groups_ * GROUP_SIZE;
+  // Another thread already rebuilt the table (writers are blocked, so the
+  // counters are exact)
+  size_t used = used_.Load();
+  if (used <= old_capacity * max_load_factor_ && used < old_capacity) {
+    resize_lock_.WriteUnlock();
+    return;
+  }
+
+  uint64_t start = StatsCounters::Now();
+  size_t size = size_.Load();
+  size_t num_groups = old_table->num_groups_;
+  while (size >= num_groups * GROUP_SIZE * max_load_factor_ / 2) {
+    num_groups *= 2;
+  }
+  auto new_table = new Table(num_groups);
+  for (size_t i = 0; i < old_table->num_groups_; ++i) {
+    Group &old_group = old_table->groups_[i];
+    for (size_t j = 0; j < GROUP_SIZE; ++j) {
+      if (old_group.ctrl_[j] & EMPTY) {
+        continue;
+      }
+      const KeyType &key = old_group.slots_[j].key_;
+      uint64_t hash = Hash(key);
+      size_t idx = HomeGroup(new_table, hash);
+      uint32_t free;
+      for (size_t step = 1;
+           (free = MatchFree(new_table->groups_[idx].ctrl_)) == 0; ++step) {
+        idx = NextGroup(new_table, idx, step);
+      }
+      Group &group = new_table->groups_[idx];
+      size_t slot = __builtin_ctz(free);
+      group.slots_[slot] = old_group.slots_[j];
+      group.ctrl_[slot] = Fingerprint(hash);
+    }
+  }
+  used_.Store(size);
+
+  // Readers may still probe the old table; it is freed once they are done
+  table_.store(new_table, std::memory_order_release);
+  EpochManager::Instance().Retire(old_table);
+  stats_.AddResize(start);
+  resize_lock_.WriteUnlock();
+}
+
+template <typename KeyType, typename ValueType>
+TableStats SwissHashTable<KeyType, ValueType>::Stats() {
+  EpochManager::Guard guard;
+  TableStats stats;
+  stats_.Collect(&stats);
+  stats.size_ = size_.Load();
+  stats.capacity_ =
+      table_.load(std::memory_order_acquire)->num_groups_ * GROUP_SIZE;
+  return stats;
+}
@@ -0,0 +1,466 @@
+#ifndef SWISS_HASH_TABLE_H_
+#define SWISS_HASH_TABLE_H_
+
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "epoch_manager.h"
+#include "index_policy.h"
+#include "key_traits.h"
+#include "rwlock.h"
+#include "sharded_counter.h"
+#include "table_stats.h"
+
+/**
+ * Concurrent Swiss-table style hash table for trivially copyable keys and
+ * values.
+ *
+ * Slots are organized in groups of 16. Each group keeps one control byte per
+ * slot holding either EMPTY, DELETED or a 7-bit fingerprint of the key's hash,
+ * so a probe compares the fingerprint against all 16 control bytes with one
+ * SSE2 compare and only looks at the keys whose fingerprint matched.
+ *
+ * Every group carries a version counter that doubles as its lock: an odd
+ * version means a writer owns the group. Readers never write shared memory:
+ * they copy what they need and retry if the version changed meanwhile.
+ * Insert/Delete serialize on the home group of their key, so two operations
+ * on the same key never race, and only try-lock any other group they touch,
+ * which rules out deadlocks. Growing the table is exclusive: writers hold a
+ * shared lock against it, readers keep probing the frozen old table until the
+ * epoch manager frees it.
+ */
+template <typename KeyType, typename ValueType>
+class SwissHashTable {
+  static_assert(std::is_trivially_copyable_v<KeyType> &&
+                    std::is_trivially_copyable_v<ValueType>,
+                "optimistic reads copy keys and values that may be written "
+                "concurrently, so they must be trivially copyable");
+
+ private:
+  static constexpr size_t GROUP_SIZE{16};
+
+  // Control bytes; a full slot stores the 7-bit fingerprint of its key
+  static constexpr uint8_t EMPTY{0x80};
+  static constexpr uint8_t DELETED{0xfe};
+
+  struct Slot {
+    KeyType key_;
+    ValueType value_;
+  };
+
+  struct alignas(64) Group {
+    std::atomic<uint64_t> version_{0};  // odd while a writer owns the group
+    alignas(16) uint8_t ctrl_[GROUP_SIZE];
+    Slot slots_[GROUP_SIZE];
+
+    Group() { std::memset(ctrl_, EMPTY, sizeof(ctrl_)); }
+  };
+
+  /**
+   * An array of groups together with its size, swapped as a whole on growth
+   */
+  struct Table {
+    size_t num_groups_;  // number of groups (a power of two)
+    Group *groups_;      // array of groups
+
+    explicit Table(size_t num_groups)
+        : num_groups_(num_groups), groups_(new Group[num_groups]) {}
+    ~Table() { delete[] groups_; }
+  };
+
+ public:
+  /**
+   * Default constructor
+   */
+  SwissHashTable() : SwissHashTable(DEFAULT_CAPACITY, DEFAULT_LOAD_FACTOR) {}
+
+  /**
+   * Creates a new SwissHashTable instance
+   * @param capacity the initial number of slots (rounded up to a power-of-two
+   * number of groups)
+   * @param max_load_factor the maximum fraction of used slots (live entries
+   * and tombstones) before the table grows
+   */
+  SwissHashTable(size_t capacity, float max_load_factor);
+
+  /**
+   * Disallows copy
+   */
+  SwissHashTable(const SwissHashTable &other) = delete;
+  SwissHashTable &operator=(const SwissHashTable &other) = delete;
+
+  /**
+   * Destroys an existing SwissHashTable instance
+   */
+  ~SwissHashTable();
+
+  size_t size() const { return size_.Load(); }
+
+  /**
+   * Gets the value of a key-value pair
+   * @param key the key of the key-value pair
+   * @return the value of that key
+   */
+  ValueType Get(const KeyType &key) { return Get<KeyType>(key); }
+
+  /**
+   * Gets the value of a key-value pair by a key of another type (see KeyHash)
+   * @param key the key of the key-value pair
+   * @return the value of that key
+   */
+  template <typename LookupKey,
+            typename = EnableIfLookupKey<KeyType, LookupKey>>
+  ValueType Get(const LookupKey &key);
+
+  /**
+   * Gets the value of a key-value pair, if the key exists
+   * @param key the key of the key-value pair
+   * @return the value of that key, or std::nullopt if the key does not exist
+   */
+  std::optional<ValueType> TryGet(const KeyType &key) {
+    return TryGet<KeyType>(key);
+  }
+
+  /**
+   * Gets the value of a key-value pair by a key of another type (see
+   * KeyHash), if the key exists
+   * @param key the key of the key-value pair
+   * @return the value of that key, or std::nullopt if the key does not exist
+   */
+  template <typename LookupKey,
+            typename = EnableIfLookupKey<KeyType, LookupKey>>
+  std::optional<ValueType> TryGet(const LookupKey &key);
+
+  /**
+   * Calls a function on the value of a key-value pair
+   * @param key the key of the key-value pair
+   * @param fn called with a const reference to a copy of the value. Readers
+   * never lock, so the copy is validated against concurrent writers first
+   * @return true if the key exists; otherwise, false
+   */
+  template <typename Fn>
+  bool Find(const KeyType &key, Fn fn) {
+    return Find<KeyType, Fn>(key, fn);
+  }
+
+  /**
+   * Calls a function on the value of a key-value pair, found by a key of
+   * another type (see KeyHash)
+   * @param key the key of the key-value pair
+   * @param fn called with a const reference to a copy of the value. Readers
+   * never lock, so the copy is validated against concurrent writers first
+   * @return true if the key exists; otherwise, false
+   */
+  template <typename LookupKey, typename Fn,
+            typename = EnableIfLookupKey<KeyType, LookupKey>>
+  bool Find(const LookupKey &key, Fn fn);
+
+  /**
+   * Checks if a key exists in the hash table
+   * @param key the key to check
+   * @return true if that key exists; otherwise, false
+   */
+  bool Contains(const KeyType &key) { return Contains<KeyType>(key); }
+
+  /**
+   * Checks if a key exists in the hash table, by a key of another type
+   * (see KeyHash)
+   * @param key the key to check
+   * @return true if that key exists; otherwise, false
+   */
+  template <typename LookupKey,
+            typename = EnableIfLookupKey<KeyType, LookupKey>>
+  bool Contains(const LookupKey &key);
+
+  /**
+   * Inserts a key-value pair into the hash table
+   * @param key the key to insert
+   * @param value the value to insert
+   */
+  void Insert(const KeyType &key, const ValueType &value) {
+    InsertOrAssign(key, value);
+  }
+
+  /**
+   * Inserts a key-value pair, or assigns the value if the key exists
+   * @param key the key to insert
+   * @param value the value to insert or assign
+   * @return true if the key was inserted; false if it existed
+   */
+  bool InsertOrAssign(const KeyType &key, const ValueType &value);
+
+  /**
+   * Inserts a key-value pair only if the key does not exist
+   * @param key the key to insert
+   * @param value the value to insert
+   * @param[out] existing the value of the key if it exists, if not nullptr
+   * @return true if the key was inserted; false if it existed
+   */
+  bool TryEmplace(const KeyType &key, const ValueType &value,
+                  ValueType *existing = nullptr);
+
+  /**
+   * Inserts a key with a value constructed from some arguments, only if the
+   * key does not exist. Values are trivially copyable, so the value is built
+   * up front and copied into its slot like TryEmplace's
+   * @param key the key to insert
+   * @param args the arguments of the value's constructor
+   * @return true if the key was inserted; false if it existed
+   */
+  template <typename... Args>
+  bool Emplace(const KeyType &key, Args &&...args) {
+    return TryEmplace(key, ValueType(std::forward<Args>(args)...));
+  }
+
+  /**
+   * Atomically modifies the value of a key if it exists
+   * @param key the key to update
+   * @param fn called with a reference to the value, with the groups of the
+   * key locked; it must not access the hash table
+   * @return true if the key exists; otherwise, false
+   */
+  template <typename Fn>
+  bool Update(const KeyType &key, Fn fn);
+
+  /**
+   * Atomically modifies the value of a key, inserting the key with a
+   * value-initialized value first if it does not exist
+   * @param key the key to update
+   * @param fn called with a reference to the value, with the groups of the
+   * key locked; it must not access the hash table
+   * @return the modified value
+   */
+  template <typename Fn>
+  ValueType Compute(const KeyType &key, Fn fn);
+
+  /**
+   * Deletes a key-value pair from the hash table
+   * @param key the key to delete
+   */
+  void Delete(const KeyType &key) { Delete<KeyType>(key); }
+
+  /**
+   * Deletes a key-value pair from the hash table by a key of another type
+   * (see KeyHash)
+   * @param key the key to delete
+   */
+  template <typename LookupKey,
+            typename = EnableIfLookupKey<KeyType, LookupKey>>
+  void Delete(const LookupKey &key);
+
+  /**
+   * Gets the runtime statistics of the hash table (see TableStats). Spinning
+   * on a group owned by another writer counts as a lock wait
+   * @return a snapshot of the statistics
+   */
+  TableStats Stats();
+
+ private:
+  // Outcomes of the operations performed under resize_lock_
+  enum WriteResult {
+    INSERTED,   // the key took a new slot
+    UPDATED,    // the key was updated or deleted
+    NOT_FOUND,  // the key to delete or update is absent
+    NO_SLOT,    // every group on the probe sequence is full
+    RETRY,      // another writer owns a group we need
+  };
+
+  /**
+   * Calculates the hash of a key, mixed so that both the group index (high
+   * bits) and the fingerprint (low 7 bits) are well distributed
+   * @param key the key to hash
+   * @return the hash of that key
+   */
+  template <typename LookupKey>
+  static uint64_t Hash(const LookupKey &key) {
+    return MixHash(KeyHash<KeyType>{}(key));
+  }
+
+  /**
+   * Gets the fingerprint stored in the control byte of a key
+   * @param hash the hash of the key
+   * @return the fingerprint
+   */
+  static uint8_t Fingerprint(uint64_t hash) { return hash & 0x7f; }
+
+  /**
+   * Gets the index of the group where the probe sequence of a key starts
+   * @param table the table to probe
+   * @param hash the hash of the key
+   * @return the index of the home group
+   */
+  static size_t HomeGroup(const Table *table, uint64_t hash) {
+    return (hash >> 7) & (table->num_groups_ - 1);
+  }
+
+  /**
+   * Gets the next group of a probe sequence. Triangular steps visit every
+   * group of a power-of-two table exactly once
+   * @param table the table to probe
+   * @param idx the current group
+   * @param step the number of groups probed so far (starting from 1)
+   * @return the index of the next group
+   */
+  static size_t NextGroup(const Table *table, size_t idx, size_t step) {
+    return (idx + step) & (table->num_groups_ - 1);
+  }
+
+  /**
+   * Compares every control byte of a group with a byte
+   * @param ctrl the control bytes of the group
+   * @param byte the byte to look for
+   * @return a bit mask of the matching slots
+   */
+  static uint32_t Match(const uint8_t *ctrl, uint8_t byte);
+
+  /**
+   * Finds the slots of a group that can take a new key
+   * @param ctrl the control bytes of the group
+   * @return a bit mask of the EMPTY and DELETED slots
+   */
+  static uint32_t MatchFree(const uint8_t *ctrl);
+
+  /**
+   * Scans one group for a key. The caller validates the result if it does
+   * not own the group
+   * @param group the group to scan
+   * @param fingerprint the fingerprint of the key
+   * @param key the key to search
+   * @param[out] slot the index of the key's slot if it is found
+   * @param[out] has_empty whether the group has an EMPTY slot
+   * @return true if the key is found; otherwise, false
+   */
+  template <typename LookupKey>
+  static bool ScanGroup(const Group &group, uint8_t fingerprint,
+                        const LookupKey &key, size_t *slot, bool *has_empty);
+
+  /**
+   * Reads a stable (even) version of a group
+   * @param group the group to read
+   * @return the version of the group
+   */
+  static uint64_t ReadBegin(const Group &group);
+
+  /**
+   * Checks that a group did not change since ReadBegin
+   * @param group the group that was read
+   * @param version the version returned by ReadBegin
+   * @return true if the read is consistent; otherwise, false
+   */
+  static bool ReadValidate(const Group &group, uint64_t version);
+
+  /**
+   * Takes ownership of a group, making its version odd
+   * @param group the group to lock
+   */
+  void LockGroup(Group &group) const;
+
+  /**
+   * Takes ownership of a group if no other writer owns it
+   * @param group the group to lock
+   * @return true if the group is now owned by the caller; otherwise, false
+   */
+  static bool TryLockGroup(Group &group);
+
+  /**
+   * Releases a group, publishing its changes to readers
+   * @param group the group to unlock
+   */
+  static void UnlockGroup(Group &group);
+
+  /**
+   * Looks a key up without taking any lock
+   * @param table the table to probe
+   * @param hash the hash of the key
+   * @param key the key to search
+   * @param[out] value the value of the key, if not nullptr
+   * @return true if the key is found; otherwise, false
+   */
+  template <typename LookupKey>
+  bool FindOptimistic(const Table *table, uint64_t hash, const LookupKey &key,
+                      ValueType *value) const;
+
+  /**
+   * Finds a key while its home group is locked by the caller
+   * @param table the table to probe
+   * @param hash the hash of the key
+   * @param key the key to search
+   * @param[out] group_idx the group holding the key
+   * @param[out] slot the slot holding the key
+   * @return true if the key is found; otherwise, false
+   */
+  template <typename LookupKey>
+  bool FindLocked(const Table *table, uint64_t hash, const LookupKey &key,
+                  size_t *group_idx, size_t *slot) const;
+
+  /**
+   * Runs a write on the value of a key, rebuilding the table if it gets
+   * full. Every write operation but Delete goes through here
+   * @param key the key to write
+   * @param insert whether to insert the key, with a value-initialized value,
+   * if it does not exist
+   * @param fn called as fn(value, found) with a reference to the value of the
+   * key and whether it existed; not called if the key is absent and not
+   * inserted
+   * @return true if the key existed; otherwise, false
+   */
+  template <typename Fn>
+  bool Upsert(const KeyType &key, bool insert, Fn fn);
+
+  /**
+   * Inserts or updates a key-value pair, the caller holding resize_lock_ in
+   * read mode
+   * @param table the table to insert into
+   * @param hash the hash of the key
+   * @param key the key to write
+   * @param insert whether to insert the key if it does not exist
+   * @param fn called as fn(value, found), see Upsert
+   * @return the outcome of the write
+   */
+  template <typename Fn>
+  WriteResult UpsertSlot(Table *table, uint64_t hash, const KeyType &key,
+                         bool insert, Fn &fn);
+
+  /**
+   * Deletes a key, the caller holding resize_lock_ in read mode
+   * @param table the table to delete from
+   * @param hash the hash of the key
+   * @param key the key to delete
+   * @return the outcome of the deletion
+   */
+  template <typename LookupKey>
+  WriteResult DeleteSlot(Table *table, uint64_t hash, const LookupKey &key);
+
+  /**
+   * Rebuilds the table without tombstones, doubling the number of groups if
+   * the live entries alone exceed half of the load factor
+   */
+  void Rebuild();
+
+  // Default hash table value
+  static constexpr size_t DEFAULT_CAPACITY{128};
+  static constexpr float DEFAULT_LOAD_FACTOR{0.875};
+
+  float max_load_factor_;
+  std::atomic<Table *> table_;   // current array of groups
+  ShardedCounter size_;          // number of key-value pairs
+  ShardedCounter used_;          // number of non-EMPTY slots
+  // Held in read mode by Insert/Delete and in write mode by Rebuild
+  ReaderWriterLock resize_lock_;
+  StatsCounters stats_;  // event counters, empty without TABLE_STATS
+};
+
+#include "swiss_hash_table.cpp"
+
+#endif  // SWISS_HASH_TABLE_H_
@@ -0,0 +1,191 @@
+#ifndef TABLE_STATS_H_
+#define TABLE_STATS_H_
+
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include "sharded_counter.h"
+
+/**
+ * Snapshot of the runtime statistics of a hash table, returned by Stats().
+ *
+ * The size, capacity and chain length are computed on demand and always
+ * filled in. The event counters are only collected when the tables are built
+ * with TABLE_STATS defined (see the Makefile); otherwise they stay 0 and
+ * `enabled_` is false. Counters that do not apply to an engine stay 0 too.
+ */
+struct TableStats {
+  bool enabled_{false};         // whether the event counters were collected
+  size_t size_{0};              // number of key-value pairs
+  size_t capacity_{0};          // number of buckets (or slots)
+  size_t max_chain_length_{0};  // longest bucket chain (chaining tables)
+  uint64_t lock_waits_{0};      // lock acquisitions that had to wait
+  uint64_t lock_wait_ns_{0};    // total time spent in those waits
+  uint64_t read_retries_{0};    // optimistic reads that had to start over
+  uint64_t cas_failures_{0};    // failed CAS on the links of a lock-free list
+  uint64_t find_restarts_{0};   // list traversals restarted from the bucket
+  uint64_t resizes_{0};         // completed resizes
+  uint64_t resize_ns_{0};       // total time spent resizing
+  uint64_t max_resize_ns_{0};   // longest resize
+};
+
+#ifdef TABLE_STATS
+
+/**
+ * Event counters of a hash table. Each counter is a ShardedCounter, so
+ * recording an event is an uncontended add on a cache line of the calling
+ * thread; Collect sums the cells on demand.
+ */
+class StatsCounters {
+ public:
+  static constexpr bool ENABLED{true};
+
+  enum Counter {
+    LOCK_WAITS,
+    LOCK_WAIT_NS,
+    READ_RETRIES,
+    CAS_FAILURES,
+    FIND_RESTARTS,
+    RESIZES,
+    RESIZE_NS,
+    NUM_COUNTERS,
+  };
+
+  /**
+   * Gets a monotonic timestamp
+   * @return the current time in nanoseconds
+   */
+  static uint64_t Now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  /**
+   * Counts an event
+   * @param counter the counter of the event
+   * @param amount the number of events
+   */
+  void Add(Counter counter, uint64_t amount = 1) const {
+    counters_[counter].Add(amount);
+  }
+
+  /**
+   * Counts a lock acquisition that had to wait
+   * @param start the time the wait started, from Now()
+   */
+  void AddLockWait(uint64_t start) const {
+    counters_[LOCK_WAITS].Increment();
+    counters_[LOCK_WAIT_NS].Add(Now() - start);
+  }
+
+  /**
+   * Counts a completed resize
+   * @param start the time the resize started, from Now()
+   */
+  void AddResize(uint64_t start) {
+    uint64_t duration = Now() - start;
+    counters_[RESIZES].Increment();
+    counters_[RESIZE_NS].Add(duration);
+    uint64_t max = max_resize_ns_.load(std::memory_order_relaxed);
+    while (duration > max &&
+           !max_resize_ns_.compare_exchange_weak(max, duration,
+                                                 std::memory_order_relaxed)) {
+    }
+  }
+
+  /**
+   * Acquires a read lock, counting the wait if it is not free
+   * @param lock the lock to acquire
+   */
+  template <typename LockType>
+  void ReadLock(LockType &lock) const {
+    if (!lock.TryReadLock()) {
+      uint64_t start = Now();
+      lock.ReadLock();
+      AddLockWait(start);
+    }
+  }
+
+  /**
+   * Acquires a write lock, counting the wait if it is not free
+   * @param lock the lock to acquire
+   */
+  template <typename LockType>
+  void WriteLock(LockType &lock) const {
+    if (!lock.TryWriteLock()) {
+      uint64_t start = Now();
+      lock.WriteLock();
+      AddLockWait(start);
+    }
+  }
+
+  /**
+   * Copies the counters into a snapshot
+   * @param[out] stats the snapshot to fill in
+   */
+  void Collect(TableStats *stats) const {
+    stats->enabled_ = true;
+    stats->lock_waits_ = counters_[LOCK_WAITS].Load();
+    stats->lock_wait_ns_ = counters_[LOCK_WAIT_NS].Load();
+    stats->read_retries_ = counters_[READ_RETRIES].Load();
+    stats->cas_failures_ = counters_[CAS_FAILURES].Load();
+    stats->find_restarts_ = counters_[FIND_RESTARTS].Load();
+    stats->resizes_ = counters_[RESIZES].Load();
+    stats->resize_ns_ = counters_[RESIZE_NS].Load();
+    stats->max_resize_ns_ = max_resize_ns_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  // Counting does not change the logical state of the table
+  mutable ShardedCounter counters_[NUM_COUNTERS];
+  std::atomic<uint64_t> max_resize_ns_{0};
+};
+
+#else
+
+/**
+ * Stand-in for the event counters when TABLE_STATS is not defined: every
+ * method is an empty inline function, so the calls compile away
+ */
+class StatsCounters {
+ public:
+  static constexpr bool ENABLED{false};
+
+  enum Counter {
+    LOCK_WAITS,
+    LOCK_WAIT_NS,
+    READ_RETRIES,
+    CAS_FAILURES,
+    FIND_RESTARTS,
+    RESIZES,
+    RESIZE_NS,
+    NUM_COUNTERS,
+  };
+
+  static uint64_t Now() { return 0; }
+
+  void Add(Counter, uint64_t = 1) const {}
+
+  void AddLockWait(uint64_t) const {}
+
+  void AddResize(uint64_t) {}
+
+  template <typename LockType>
+  void ReadLock(LockType &lock) const {
+    lock.ReadLock();
+  }
+
+  template <typename LockType>
+  void WriteLock(LockType &lock) const {
+    lock.WriteLock();
+  }
+
+  void Collect(TableStats *) const {}
+};
+
+#endif  // TABLE_STATS
+
+#endif  // TABLE_STATS_H_
@@ -0,0 +1,676 @@
+#include "coarse_hash_table.h"
+#include "cuckoo_hash_table.h"
+#include "fine_hash_table.h"
+#include "hopscotch_hash_table.h"
+#include "lock_free_hash_table.h"
+#include "open_addressing_hash_table.h"
+#include "swiss_hash_table.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "histogram.h"
+#include "perf_counters.h"
+#include "workload.h"
+
+/**
+ * Benchmark driver shared by all hash table engines.
+ *
+ * Every worker thread runs the same random mix of operations until the run
+ * duration elapses, on keys from [0, key_range) picked by a distribution
+ * (see workload.h); the table is prefilled with `prefill` distinct keys
+ * beforehand. Except for the sequential distribution, the ranks drawn by the
+ * distribution are mapped to keys through a random permutation, so the hot
+ * keys are spread over the table, and the prefilled keys are the lowest
+ * ranks, so skewed reads mostly hit. Threads are created and seeded before
+ * the clock starts and released together, so only the operations themselves
+ * are timed. Throughput is printed as one CSV row (with a header) or one JSON
+ * object per run.
+ *
+ * With --latency=1, every operation is timed into per-thread histograms, one
+ * per kind of operation, that are merged after the run to report
+ * percentiles. --timeline=MS additionally buckets the operations into
+ * intervals of MS milliseconds and reports the throughput and worst latency
+ * of each, together with the size of the table sampled at the interval
+ * boundary; the size jumps show when the table grew, so latency spikes can
+ * be matched with resizes.
+ *
+ * With --counters=1, every thread counts hardware events (instructions,
+ * cycles, cache and branch misses) around its timed loop, and the sums are
+ * reported per operation next to the throughput. Events the machine does not
+ * expose, e.g. inside a container, are reported as empty (CSV) or null
+ * (JSON).
+ *
+ * The operations are Get (read), Insert of a new or existing key (insert),
+ * Delete (delete), InsertOrAssign of an existing key (update) and an atomic
+ * increment with Compute (rmw). Update and rmw go through InsertOrAssign and
+ * Compute because Insert keeps the existing value in the lock-free table.
+ * --workload=a|b|c|d|f presets the mix and the
+ * distribution of the YCSB core workload of that letter; options after it
+ * override the preset.
+ *
+ * Usage: benchmark [--engine=NAME] [--threads=N] [--workload=a|b|c|d|f]
+ *                  [--read=PCT] [--insert=PCT] [--delete=PCT] [--update=PCT]
+ *                  [--rmw=PCT] [--distribution=uniform|zipfian|hotspot|
+ *                  sequential|latest] [--theta=F] [--hot_fraction=F]
+ *                  [--hot_ops=F] [--key_range=N] [--prefill=N]
+ *                  [--occupancy=F] [--duration=SECONDS] [--seed=N]
+ *                  [--latency=0|1] [--timeline=MS] [--counters=0|1]
+ *                  [--format=csv|json]
+ *
+ * The benchmark target is built with optimizations and without the address
+ * sanitizer, unlike the correctness tests.
+ */
+
+enum Ops {
+  READ,
+  INSERT,
+  DELETE,
+  UPDATE,
+  READ_MODIFY_WRITE,
+};
+
+static constexpr int NUM_OP_TYPES{READ_MODIFY_WRITE + 1};
+static const char *const OP_NAMES[] = {"read", "insert", "delete", "update",
+                                       "rmw"};
+
+struct Options {
+  std::string engine_{"fine"};
+  int threads_{4};
+  std::string workload_{"custom"};
+  int read_{80};    // percentage of Get
+  int insert_{10};  // percentage of Insert
+  int delete_{10};  // percentage of Delete
+  int update_{0};   // percentage of InsertOrAssign of an existing key
+  int rmw_{0};      // percentage of Compute
+  Distribution distribution_{UNIFORM};
+  double theta_{0.99};         // skew of ZIPFIAN and LATEST
+  double hot_fraction_{0.2};   // HOTSPOT: share of the keys that is hot
+  double hot_ops_{0.8};        // HOTSPOT: share of the operations on it
+  int key_range_{1 << 20};
+  int prefill_{1 << 19};
+  double occupancy_{-1};  // if set, prefill this fraction of the key range
+  double duration_{1.0};  // seconds
+  uint64_t seed_{42};
+  bool latency_{false};  // whether to time every operation
+  int timeline_{0};      // interval of the timeline in ms, 0 for none
+  bool counters_{false};  // whether to count hardware events
+  std::string format_{"csv"};
+};
+
+/**
+ * Presets the op mix and key distribution of a YCSB core workload
+ * @param name the letter of the workload
+ * @param[out] options the options to preset
+ * @return true if the workload is known; otherwise, false
+ */
+bool ApplyWorkload(const std::string &name, Options *options) {
+  // read, insert, delete, update, rmw
+  int mix[5];
+  Distribution distribution = ZIPFIAN;
+  if (name == "a") {  // update heavy
+    mix[0] = 50, mix[1] = 0, mix[2] = 0, mix[3] = 50, mix[4] = 0;
+  } else if (name == "b") {  // read mostly
+    mix[0] = 95, mix[1] = 0, mix[2] = 0, mix[3] = 5, mix[4] = 0;
+  } else if (name == "c") {  // read only
+    mix[0] = 100, mix[1] = 0, mix[2] = 0, mix[3] = 0, mix[4] = 0;
+  } else if (name == "d") {  // read latest
+    mix[0] = 95, mix[1] = 5, mix[2] = 0, mix[3] = 0, mix[4] = 0;
+    distribution = LATEST;
+  } else if (name == "f") {  // read-modify-write
+    mix[0] = 50, mix[1] = 0, mix[2] = 0, mix[3] = 0, mix[4] = 50;
+  } else {
+    return false;
+  }
+  options->workload_ = name;
+  options->read_ = mix[0];
+  options->insert_ = mix[1];
+  options->delete_ = mix[2];
+  options->update_ = mix[3];
+  options->rmw_ = mix[4];
+  options->distribution_ = distribution;
+  // YCSB loads every record before the run
+  options->occupancy_ = 1;
+  return true;
+}
+
+/**
+ * Baseline engine: std::unordered_map behind a single mutex
+ */
+template <typename KeyType, typename ValueType>
+class LockedUnorderedMap {
+ public:
+  ValueType Get(const KeyType &key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = map_.find(key);
+    return it == map_.end() ? ValueType{} : it->second;
+  }
+
+  bool Contains(const KeyType &key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return map_.count(key) != 0;
+  }
+
+  void Insert(const KeyType &key, const ValueType &value) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    map_[key] = value;
+  }
+
+  bool InsertOrAssign(const KeyType &key, const ValueType &value) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return map_.insert_or_assign(key, value).second;
+  }
+
+  template <typename Fn>
+  ValueType Compute(const KeyType &key, Fn fn) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ValueType &value = map_[key];
+    fn(value);
+    return value;
+  }
+
+  void Delete(const KeyType &key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    map_.erase(key);
+  }
+
+ private:
+  std::mutex mutex_;
+  std::unordered_map<KeyType, ValueType> map_;
+};
+
+/**
+ * Operations completed during one interval of the timeline
+ */
+struct TimelineSample {
+  uint64_t ops_{0};
+  uint64_t max_latency_{0};  // in ns
+  int64_t size_{-1};         // table size at the end, -1 if unknown
+};
+
+// Padded so that threads do not false-share their results
+struct alignas(64) ThreadResult {
+  uint64_t ops_{0};
+  std::vector<LatencyHistogram> histograms_;  // one per kind of operation
+  std::vector<TimelineSample> timeline_;
+  uint64_t counters_[PerfCounters::NUM_EVENTS]{};
+  bool has_counter_[PerfCounters::NUM_EVENTS]{};
+};
+
+/**
+ * Outcome of a run, merged over the threads
+ */
+struct RunResult {
+  uint64_t ops_{0};
+  double elapsed_{0};  // in seconds
+  std::vector<LatencyHistogram> histograms_;  // one per kind of operation
+  std::vector<TimelineSample> timeline_;
+  uint64_t counters_[PerfCounters::NUM_EVENTS]{};
+  // Whether every thread could count the event
+  bool has_counter_[PerfCounters::NUM_EVENTS]{};
+};
+
+/**
+ * Gets the number of entries of a table, for the engines that count them
+ * @return the size, or -1 if the table does not expose it
+ */
+template <typename HashTable>
+auto TableSize(const HashTable &hash_table, int)
+    -> decltype(static_cast<int64_t>(hash_table.size())) {
+  return hash_table.size();
+}
+
+template <typename HashTable>
+int64_t TableSize(const HashTable &, long) {
+  return -1;
+}
+
+/**
+ * Runs one measurement on a fresh table
+ * @param options the benchmark parameters
+ * @param[out] run the throughput and, if requested, latencies of the run
+ */
+template <typename HashTable>
+void Run(const Options &options, RunResult *run) {
+  HashTable hash_table;
+
+  // Maps ranks to keys; the prefilled keys are the lowest ranks
+  std::vector<int> keys(options.key_range_);
+  for (int i = 0; i < options.key_range_; ++i) {
+    keys[i] = i;
+  }
+  if (options.distribution_ != SEQUENTIAL) {
+    std::shuffle(keys.begin(), keys.end(), std::mt19937_64(options.seed_));
+  }
+  for (int i = 0; i < options.prefill_; ++i) {
+    hash_table.Insert(keys[i], keys[i]);
+  }
+
+  std::unique_ptr<ZipfianGenerator> zipfian;
+  if (options.distribution_ == ZIPFIAN || options.distribution_ == LATEST) {
+    zipfian = std::make_unique<ZipfianGenerator>(options.key_range_,
+                                                 options.theta_);
+  }
+  std::atomic<uint64_t> num_inserted{static_cast<uint64_t>(options.prefill_)};
+  KeySpace space;
+  space.distribution_ = options.distribution_;
+  space.key_range_ = options.key_range_;
+  space.zipfian_ = zipfian.get();
+  space.hot_fraction_ = options.hot_fraction_;
+  space.hot_ops_ = options.hot_ops_;
+  space.num_inserted_ = &num_inserted;
+
+  Ops op_mix[100];
+  const int percentages[] = {options.read_, options.insert_, options.delete_,
+                             options.update_, options.rmw_};
+  for (int op = READ, i = 0; op <= READ_MODIFY_WRITE; ++op) {
+    for (int j = 0; j < percentages[op]; ++j) {
+      op_mix[i++] = static_cast<Ops>(op);
+    }
+  }
+
+  std::vector<ThreadResult> results(options.threads_);
+  using Clock = std::chrono::steady_clock;
+  bool timed = options.latency_ || options.timeline_ > 0;
+  auto interval = std::chrono::milliseconds(options.timeline_);
+  size_t num_intervals =
+      options.timeline_ > 0
+          ? static_cast<size_t>(options.duration_ * 1000 / options.timeline_) +
+                2
+          : 0;
+  std::atomic<int> num_ready{0};
+  std::atomic<bool> start{false};
+  std::atomic<bool> stop{false};
+  Clock::time_point begin;
+  std::vector<std::thread> threads;
+  for (int id = 0; id < options.threads_; ++id) {
+    threads.emplace_back([&, id] {
+      KeyChooser chooser(space, options.seed_ + id + 1, id, options.threads_);
+      ThreadResult &result = results[id];
+      if (timed) {
+        result.histograms_.resize(NUM_OP_TYPES);
+        result.timeline_.resize(num_intervals);
+      }
+      std::unique_ptr<PerfCounters> counters;
+      if (options.counters_) {
+        counters = std::make_unique<PerfCounters>();
+      }
+      uint64_t ops = 0;
+      num_ready.fetch_add(1);
+      while (!start.load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+      }
+      if (counters) {
+        counters->Start();
+      }
+      while (!stop.load(std::memory_order_relaxed)) {
+        Ops op = op_mix[chooser.random().Uniform(100)];
+        int key = keys[op == INSERT ? chooser.NextInsert() : chooser.Next()];
+        Clock::time_point op_start;
+        if (timed) {
+          op_start = Clock::now();
+        }
+        switch (op) {
+          case READ:
+            hash_table.Get(key);
+            break;
+          case INSERT:
+            hash_table.Insert(key, key);
+            break;
+          case UPDATE:
+            hash_table.InsertOrAssign(key, key);
+            break;
+          case DELETE:
+            hash_table.Delete(key);
+            break;
+          case READ_MODIFY_WRITE:
+            hash_table.Compute(key, [](int &value) { ++value; });
+            break;
+        }
+        if (timed) {
+          Clock::time_point op_end = Clock::now();
+          uint64_t latency = std::chrono::duration_cast<
+              std::chrono::nanoseconds>(op_end - op_start).count();
+          result.histograms_[op].Record(latency);
+          if (num_intervals > 0) {
+            size_t i = std::min<size_t>((op_end - begin) / interval,
+                                        num_intervals - 1);
+            ++result.timeline_[i].ops_;
+            result.timeline_[i].max_latency_ =
+                std::max(result.timeline_[i].max_latency_, latency);
+          }
+        }
+        ++ops;
+      }
+      if (counters) {
+        counters->Stop();
+        for (int event = 0; event < PerfCounters::NUM_EVENTS; ++event) {
+          result.has_counter_[event] = counters->Read(
+              static_cast<PerfCounters::Event>(event),
+              &result.counters_[event]);
+        }
+      }
+      result.ops_ = ops;
+    });
+  }
+
+  // Barrier: the clock starts once every thread is waiting
+  while (num_ready.load() != options.threads_) {
+    std::this_thread::yield();
+  }
+  begin = Clock::now();
+  start.store(true, std::memory_order_release);
+  auto deadline =
+      begin + std::chrono::duration_cast<Clock::duration>(
+                  std::chrono::duration<double>(options.duration_));
+  std::vector<int64_t> sizes(num_intervals, -1);
+  for (size_t i = 0; i + 1 < num_intervals && Clock::now() < deadline; ++i) {
+    auto boundary = begin + static_cast<int64_t>(i + 1) * interval;
+    std::this_thread::sleep_until(std::min(boundary, deadline));
+    sizes[i] = TableSize(hash_table, 0);
+  }
+  std::this_thread::sleep_until(deadline);
+  stop.store(true, std::memory_order_relaxed);
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  auto end = Clock::now();
+  run->elapsed_ = std::chrono::duration<double>(end - begin).count();
+  int64_t final_size = TableSize(hash_table, 0);
+
+  run->ops_ = 0;
+  run->histograms_.assign(timed ? NUM_OP_TYPES : 0, LatencyHistogram());
+  run->timeline_.assign(num_intervals, TimelineSample());
+  for (int event = 0; event < PerfCounters::NUM_EVENTS; ++event) {
+    run->counters_[event] = 0;
+    run->has_counter_[event] = options.counters_;
+  }
+  for (const auto &result : results) {
+    run->ops_ += result.ops_;
+    for (int event = 0; event < PerfCounters::NUM_EVENTS; ++event) {
+      run->counters_[event] += result.counters_[event];
+      run->has_counter_[event] &= result.has_counter_[event];
+    }
+    for (size_t op = 0; op < result.histograms_.size(); ++op) {
+      run->histograms_[op].Merge(result.histograms_[op]);
+    }
+    for (size_t i = 0; i < result.timeline_.size(); ++i) {
+      run->timeline_[i].ops_ += result.timeline_[i].ops_;
+      run->timeline_[i].max_latency_ = std::max(
+          run->timeline_[i].max_latency_, result.timeline_[i].max_latency_);
+    }
+  }
+  // Drops the intervals after the end of the run
+  while (!run->timeline_.empty() && run->timeline_.back().ops_ == 0) {
+    run->timeline_.pop_back();
+  }
+  for (size_t i = 0; i < run->timeline_.size(); ++i) {
+    run->timeline_[i].size_ = sizes[i];
+  }
+  // The operations still running at the deadline land in the last interval,
+  // which thus ends when the threads stop
+  if (!run->timeline_.empty()) {
+    run->timeline_.back().size_ = final_size;
+  }
+}
+
+/**
+ * Prints the outcome of a run in the requested format
+ */
+void Report(const Options &options, const RunResult &run) {
+  static const double PERCENTILES[] = {50, 90, 99, 99.9};
+  double mops = run.ops_ / run.elapsed_ / 1e6;
+  if (options.format_ == "json") {
+    std::cout << "{\"engine\": \"" << options.engine_
+              << "\", \"threads\": " << options.threads_
+              << ", \"workload\": \"" << options.workload_
+              << "\", \"read\": " << options.read_
+              << ", \"insert\": " << options.insert_
+              << ", \"delete\": " << options.delete_
+              << ", \"update\": " << options.update_
+              << ", \"rmw\": " << options.rmw_ << ", \"distribution\": \""
+              << DistributionName(options.distribution_)
+              << "\", \"theta\": " << options.theta_
+              << ", \"key_range\": " << options.key_range_
+              << ", \"prefill\": " << options.prefill_
+              << ", \"duration\": " << run.elapsed_ << ", \"ops\": " << run.ops_
+              << ", \"mops_per_sec\": " << mops;
+    if (options.counters_) {
+      std::cout << ", \"counters_per_op\": {";
+      for (int event = 0; event < PerfCounters::NUM_EVENTS; ++event) {
+        std::cout << (event == 0 ? "" : ", ") << '"'
+                  << PerfCounters::Name(static_cast<PerfCounters::Event>(event))
+                  << "\": ";
+        if (run.has_counter_[event]) {
+          std::cout << static_cast<double>(run.counters_[event]) / run.ops_;
+        } else {
+          std::cout << "null";
+        }
+      }
+      std::cout << '}';
+    }
+    if (options.latency_) {
+      std::cout << ", \"latency_ns\": {";
+      const char *separator = "";
+      for (int op = 0; op < NUM_OP_TYPES; ++op) {
+        const LatencyHistogram &histogram = run.histograms_[op];
+        if (histogram.Count() == 0) {
+          continue;
+        }
+        std::cout << separator << '"' << OP_NAMES[op]
+                  << "\": {\"count\": " << histogram.Count()
+                  << ", \"p50\": " << histogram.Percentile(50)
+                  << ", \"p90\": " << histogram.Percentile(90)
+                  << ", \"p99\": " << histogram.Percentile(99)
+                  << ", \"p99.9\": " << histogram.Percentile(99.9)
+                  << ", \"max\": " << histogram.Max() << '}';
+        separator = ", ";
+      }
+      std::cout << '}';
+    }
+    if (options.timeline_ > 0) {
+      std::cout << ", \"timeline\": [";
+      for (size_t i = 0; i < run.timeline_.size(); ++i) {
+        const TimelineSample &sample = run.timeline_[i];
+        std::cout << (i == 0 ? "" : ", ")
+                  << "{\"time_ms\": " << i * options.timeline_
+                  << ", \"ops\": " << sample.ops_
+                  << ", \"max_latency_ns\": " << sample.max_latency_
+                  << ", \"size\": " << sample.size_ << '}';
+      }
+      std::cout << ']';
+    }
+    std::cout << "}\n";
+  } else {
+    std::cout << "engine,threads,workload,read,insert,delete,update,rmw,"
+                 "distribution,theta,key_range,prefill,duration,ops,"
+                 "mops_per_sec";
+    if (options.counters_) {
+      for (int event = 0; event < PerfCounters::NUM_EVENTS; ++event) {
+        std::cout << ','
+                  << PerfCounters::Name(static_cast<PerfCounters::Event>(event))
+                  << "_per_op";
+      }
+    }
+    std::cout << '\n'
+              << options.engine_ << ',' << options.threads_ << ','
+              << options.workload_ << ',' << options.read_ << ','
+              << options.insert_ << ',' << options.delete_ << ','
+              << options.update_ << ',' << options.rmw_ << ','
+              << DistributionName(options.distribution_) << ','
+              << options.theta_ << ',' << options.key_range_ << ','
+              << options.prefill_ << ',' << run.elapsed_ << ',' << run.ops_
+              << ',' << mops;
+    if (options.counters_) {
+      for (int event = 0; event < PerfCounters::NUM_EVENTS; ++event) {
+        std::cout << ',';
+        if (run.has_counter_[event]) {
+          std::cout << static_cast<double>(run.counters_[event]) / run.ops_;
+        }
+      }
+    }
+    std::cout << '\n';
+    // Further tables follow after a blank line
+    if (options.latency_) {
+      std::cout << "\nop,count,p50_ns,p90_ns,p99_ns,p99.9_ns,max_ns\n";
+      for (int op = 0; op < NUM_OP_TYPES; ++op) {
+        const LatencyHistogram &histogram = run.histograms_[op];
+        if (histogram.Count() == 0) {
+          continue;
+        }
+        std::cout << OP_NAMES[op] << ',' << histogram.Count();
+        for (double percentile : PERCENTILES) {
+          std::cout << ',' << histogram.Percentile(percentile);
+        }
+        std::cout << ',' << histogram.Max() << '\n';
+      }
+    }
+    if (options.timeline_ > 0) {
+      std::cout << "\ntime_ms,ops,max_latency_ns,size\n";
+      for (size_t i = 0; i < run.timeline_.size(); ++i) {
+        const TimelineSample &sample = run.timeline_[i];
+        std::cout << i * options.timeline_ << ',' << sample.ops_ << ','
+                  << sample.max_latency_ << ',' << sample.size_ << '\n';
+      }
+    }
+  }
+}
+
+/**
+ * Parses `--name=value` arguments into the options
+ * @return false if an argument is unknown or malformed
+ */
+bool ParseOptions(int argc, char **argv, Options *options) {
+  for (int i = 1; i < argc; ++i) {
+    const char *arg = argv[i];
+    const char *eq = std::strchr(arg, '=');
+    if (std::strncmp(arg, "--", 2) != 0 || eq == nullptr) {
+      return false;
+    }
+    std::string name(arg + 2, eq);
+    const char *value = eq + 1;
+    if (name == "engine") {
+      options->engine_ = value;
+    } else if (name == "threads") {
+      options->threads_ = std::atoi(value);
+    } else if (name == "workload") {
+      if (!ApplyWorkload(value, options)) {
+        return false;
+      }
+    } else if (name == "read") {
+      options->read_ = std::atoi(value);
+    } else if (name == "insert") {
+      options->insert_ = std::atoi(value);
+    } else if (name == "delete") {
+      options->delete_ = std::atoi(value);
+    } else if (name == "update") {
+      options->update_ = std::atoi(value);
+    } else if (name == "rmw") {
+      options->rmw_ = std::atoi(value);
+    } else if (name == "distribution") {
+      if (!ParseDistribution(value, &options->distribution_)) {
+        return false;
+      }
+    } else if (name == "theta") {
+      options->theta_ = std::atof(value);
+    } else if (name == "hot_fraction") {
+      options->hot_fraction_ = std::atof(value);
+    } else if (name == "hot_ops") {
+      options->hot_ops_ = std::atof(value);
+    } else if (name == "key_range") {
+      options->key_range_ = std::atoi(value);
+    } else if (name == "prefill") {
+      options->prefill_ = std::atoi(value);
+      options->occupancy_ = -1;
+    } else if (name == "occupancy") {
+      options->occupancy_ = std::atof(value);
+    } else if (name == "duration") {
+      options->duration_ = std::atof(value);
+    } else if (name == "seed") {
+      options->seed_ = std::strtoull(value, nullptr, 10);
+    } else if (name == "latency") {
+      options->latency_ = std::atoi(value) != 0;
+    } else if (name == "timeline") {
+      options->timeline_ = std::atoi(value);
+    } else if (name == "counters") {
+      options->counters_ = std::atoi(value) != 0;
+    } else if (name == "format") {
+      options->format_ = value;
+    } else {
+      return false;
+    }
+  }
+  if (options->occupancy_ >= 0) {
+    options->prefill_ =
+        static_cast<int>(options->occupancy_ * options->key_range_);
+  }
+  return options->threads_ > 0 && options->key_range_ > 0 &&
+         options->prefill_ >= 0 && options->prefill_ <= options->key_range_ &&
+         options->read_ >= 0 && options->insert_ >= 0 &&
+         options->delete_ >= 0 && options->update_ >= 0 &&
+         options->rmw_ >= 0 &&
+         options->read_ + options->insert_ + options->delete_ +
+                 options->update_ + options->rmw_ ==
+             100 &&
+         options->theta_ > 0 && options->theta_ < 1 &&
+         options->hot_fraction_ > 0 && options->hot_fraction_ <= 1 &&
+         options->hot_ops_ >= 0 && options->hot_ops_ <= 1 &&
+         options->timeline_ >= 0 &&
+         (options->format_ == "csv" || options->format_ == "json");
+}
+
+int main(int argc, char **argv) {
+  Options options;
+  if (!ParseOptions(argc, argv, &options)) {
+    std::cerr << "usage: " << argv[0]
+              << " [--engine=coarse|fine|lock_free|open_addressing|swiss|"
+                 "cuckoo|hopscotch|unordered_map] [--threads=N] "
+                 "[--workload=a|b|c|d|f] [--read=PCT] [--insert=PCT] "
+                 "[--delete=PCT] [--update=PCT] [--rmw=PCT] "
+                 "[--distribution=uniform|zipfian|hotspot|sequential|latest] "
+                 "[--theta=F] [--hot_fraction=F] [--hot_ops=F] "
+                 "[--key_range=N] [--prefill=N] [--occupancy=F] "
+                 "[--duration=SECONDS] [--seed=N] [--latency=0|1] "
+                 "[--timeline=MS] [--counters=0|1] [--format=csv|json]\n"
+                 "read + insert + delete + update + rmw must be 100\n";
+    return 1;
+  }
+
+  RunResult run;
+  const std::string &engine = options.engine_;
+  if (engine == "coarse") {
+    Run<CoarseHashTable<int, int>>(options, &run);
+  } else if (engine == "fine") {
+    Run<FineHashTable<int, int>>(options, &run);
+  } else if (engine == "lock_free") {
+    Run<LockFreeHashTable<int, int>>(options, &run);
+  } else if (engine == "open_addressing") {
+    Run<OpenAddressingHashTable<int, int>>(options, &run);
+  } else if (engine == "swiss") {
+    Run<SwissHashTable<int, int>>(options, &run);
+  } else if (engine == "cuckoo") {
+    Run<CuckooHashTable<int, int>>(options, &run);
+  } else if (engine == "hopscotch") {
+    Run<HopscotchHashTable<int, int>>(options, &run);
+  } else if (engine == "unordered_map") {
+    Run<LockedUnorderedMap<int, int>>(options, &run);
+  } else {
+    std::cerr << "unknown engine: " << engine << '\n';
+    return 1;
+  }
+  Report(options, run);
+
+  return 0;
+}
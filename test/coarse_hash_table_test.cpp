@@ -1,12 +1,21 @@
 #include "coarse_hash_table.h"
 
+#include <atomic>
 #include <cassert>
 #include <chrono>
 #include <functional>
 #include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
 #include <thread>
 #include <utility>
 
+#include "counted_value.h"
+#include "find_test.h"
+#include "stats_test.h"
+#include "upsert_test.h"
+
 static int NUM_THREADS = 4;
 static constexpr int NUM_OPS = 1000000;
 enum Ops {
@@ -15,6 +24,27 @@ enum Ops {
   DELETE,
 };
 
+/**
+ * Key that counts how often it is hashed
+ */
+struct CountedKey {
+  int value_;
+
+  bool operator==(const CountedKey &other) const {
+    return value_ == other.value_;
+  }
+};
+
+static std::atomic<int> num_hashes{0};
+
+template <>
+struct KeyHash<CountedKey> {
+  size_t operator()(const CountedKey &key) const {
+    num_hashes.fetch_add(1, std::memory_order_relaxed);
+    return std::hash<int>{}(key.value_);
+  }
+};
+
 /**
  * Correctness Test for the coarse-grained hash table
  */
@@ -50,8 +80,8 @@ void CorrectnessTest2() {
   std::cout << "Correctness Test 2 passed\n";
 }
 
-void ConcurrentSearchInsertDelete(int id,
-                                  CoarseHashTable<int, int> &hash_table) {
+template <typename HashTable>
+void ConcurrentSearchInsertDelete(int id, HashTable &hash_table) {
   int stride = NUM_OPS / NUM_THREADS;
   int start = id * stride;
   for (int i = start; i < start + stride; ++i) {
@@ -92,8 +122,9 @@ void CorrectnessTest3() {
   CoarseHashTable<int, int> hash_table;
   std::vector<std::thread> threads;
   for (int i = 0; i < NUM_THREADS; ++i) {
-    threads.push_back(
-        std::thread(ConcurrentSearchInsertDelete, i, std::ref(hash_table)));
+    threads.push_back(std::thread(
+        ConcurrentSearchInsertDelete<CoarseHashTable<int, int>>, i,
+        std::ref(hash_table)));
   }
 
   for (auto &thread : threads) {
@@ -103,6 +134,91 @@ void CorrectnessTest3() {
   std::cout << "Correctness Test 3 passed\n";
 }
 
+void CorrectnessTest4() {
+  std::cout << "----------Correctness Test 4----------\n";
+  // Writers keep revoking the reader bias while readers hold the lock
+  using BravoTable =
+      CoarseHashTable<int, int, ModuloIndex, BravoReaderWriterLock>;
+  BravoTable hash_table;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < NUM_THREADS; ++i) {
+    threads.push_back(std::thread(ConcurrentSearchInsertDelete<BravoTable>, i,
+                                  std::ref(hash_table)));
+  }
+
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  std::cout << "Correctness Test 4 passed\n";
+}
+
+void CorrectnessTest5() {
+  std::cout << "----------Correctness Test 5----------\n";
+  TableStats stats = StatsTest<CoarseHashTable<int, int>>();
+  assert(stats.max_chain_length_ >= 1);
+  // The table started at 4 slots, so it must have grown
+  assert(!stats.enabled_ || stats.resizes_ > 0);
+  std::cout << "Correctness Test 5 passed\n";
+}
+
+void CorrectnessTest6() {
+  std::cout << "----------Correctness Test 6----------\n";
+  CoarseHashTable<std::string, int> hash_table(4, 0.75);
+  for (int i = 0; i < 100; ++i) {
+    std::string key = "key" + std::to_string(i);
+    hash_table.Insert(key, i);
+  }
+  // Lookups by std::string_view or C string do not build a std::string
+  for (int i = 0; i < 100; i += 2) {
+    std::string key = "key" + std::to_string(i);
+    hash_table.Delete(std::string_view(key));
+  }
+  assert(hash_table.Get(std::string_view("key1")) == 1);
+  assert(hash_table.Contains("key99"));
+  assert(!hash_table.Contains(std::string_view("key42")));
+  assert(hash_table.Get(std::string("key7")) == 7);
+  std::cout << "Correctness Test 6 passed\n";
+}
+
+void CorrectnessTest7() {
+  std::cout << "----------Correctness Test 7----------\n";
+  // Entries keep the hash of their key, so growing never hashes again
+  CoarseHashTable<CountedKey, int> hash_table(4, 0.75);
+  num_hashes = 0;
+  for (int i = 0; i < 1000; ++i) {
+    hash_table.Insert(CountedKey{i}, i);
+  }
+  assert(num_hashes == 1000);
+  assert(hash_table.Get(CountedKey{500}) == 500);
+  std::cout << "Correctness Test 7 passed\n";
+}
+
+void CorrectnessTest8() {
+  std::cout << "----------Correctness Test 8----------\n";
+  UpsertTest<CoarseHashTable<int, int>>(NUM_THREADS);
+  std::cout << "Correctness Test 8 passed\n";
+}
+
+void CorrectnessTest9() {
+  std::cout << "----------Correctness Test 9----------\n";
+  TryGetFindTest<CoarseHashTable<int, int>>();
+  // Large values are read in place, also while they are replaced and deleted
+  InPlaceFindTest<CoarseHashTable<int, std::string>>();
+  std::cout << "Correctness Test 9 passed\n";
+}
+
+void CorrectnessTest10() {
+  std::cout << "----------Correctness Test 10----------\n";
+  CoarseHashTable<std::string, CountedValue> hash_table(4, 0.75);
+  MoveTest(hash_table);
+  // InsertOrAssign moves a value in over an existing one
+  CountedValue value(std::string("new"));
+  assert(!hash_table.InsertOrAssign("0", std::move(value)));
+  assert(hash_table.Get("0").data_ == "new");
+  std::cout << "Correctness Test 10 passed\n";
+}
+
 /**
  * Benchmark for the coarse-grained hash table.
  * Performs concurrent read, insert, and delete without checking for
@@ -125,7 +241,8 @@ std::vector<Ops> CreateWorkLoad(int num_read, int num_insert, int num_delete) {
   return op_mix;
 }
 
-void mixed_workload(int id, CoarseHashTable<int, int> &hash_table,
+template <typename HashTable>
+void mixed_workload(int id, HashTable &hash_table,
                     std::vector<Ops> &op_mix,
                     std::vector<std::pair<int, int>> &data) {
   int stride = NUM_OPS / NUM_THREADS;
@@ -143,16 +260,20 @@ void mixed_workload(int id, CoarseHashTable<int, int> &hash_table,
   }
 }
 
+template <typename LockType = ReaderWriterLock>
 void Benchmark(int num_read, int num_insert, int num_delete,
-               std::vector<std::pair<int, int>> &data) {
+               std::vector<std::pair<int, int>> &data,
+               const char *lock_name = "") {
+  using HashTable = CoarseHashTable<int, int, ModuloIndex, LockType>;
   std::vector<Ops> op_mix = CreateWorkLoad(num_read, num_insert, num_delete);
-  CoarseHashTable<int, int> hash_table;
+  HashTable hash_table;
   std::vector<std::thread> threads;
 
   auto start = std::chrono::steady_clock::now();
   for (int i = 0; i < NUM_THREADS; ++i) {
-    threads.push_back(std::thread(mixed_workload, i, std::ref(hash_table),
-                                  std::ref(op_mix), std::ref(data)));
+    threads.push_back(std::thread(mixed_workload<HashTable>, i,
+                                  std::ref(hash_table), std::ref(op_mix),
+                                  std::ref(data)));
   }
 
   for (auto &thread : threads) {
@@ -164,7 +285,7 @@ void Benchmark(int num_read, int num_insert, int num_delete,
   std::cout
       << NUM_OPS << " access (" << num_read << "% read, " << num_insert
       << "% insert, " << num_delete
-      << "% delete) on coarse-grained hash table: "
+      << "% delete) on coarse-grained hash table" << lock_name << ": "
       << std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count()
       << " ms \n";
 }
@@ -179,6 +300,13 @@ int main(int argc, char **argv) {
   // CorrectnessTest1();
   // CorrectnessTest2();
   // CorrectnessTest3();
+  // CorrectnessTest4();
+  // CorrectnessTest5();
+  // CorrectnessTest6();
+  // CorrectnessTest7();
+  // CorrectnessTest8();
+  // CorrectnessTest9();
+  // CorrectnessTest10();
 
   if (argc > 1) {
     NUM_THREADS = atoi(argv[1]);
@@ -186,6 +314,9 @@ int main(int argc, char **argv) {
   std::vector<std::pair<int, int>> data;
   GenerateKeyValue(data);
   Benchmark(80, 10, 10, data);
+  Benchmark<BravoReaderWriterLock>(80, 10, 10, data, " (BRAVO)");
+  Benchmark(98, 1, 1, data);
+  Benchmark<BravoReaderWriterLock>(98, 1, 1, data, " (BRAVO)");
 
   std::cout << "All test cases passed\n";
 
@@ -0,0 +1,92 @@
+#ifndef COUNTED_VALUE_H_
+#define COUNTED_VALUE_H_
+
+#include <atomic>
+#include <cassert>
+#include <string>
+#include <utility>
+
+inline std::atomic<int> num_copies{0};
+
+/**
+ * Value that counts how often it is copied
+ */
+struct CountedValue {
+  std::string data_;
+
+  CountedValue() = default;
+  explicit CountedValue(std::string data) : data_(std::move(data)) {}
+  CountedValue(const CountedValue &other) : data_(other.data_) {
+    num_copies.fetch_add(1, std::memory_order_relaxed);
+  }
+  CountedValue(CountedValue &&other) noexcept = default;
+  CountedValue &operator=(const CountedValue &other) {
+    data_ = other.data_;
+    num_copies.fetch_add(1, std::memory_order_relaxed);
+    return *this;
+  }
+  CountedValue &operator=(CountedValue &&other) noexcept = default;
+};
+
+/**
+ * Checks that moved-in and emplaced values are copied neither by the
+ * insertion nor by the resizes, and that inserting an existing key leaves
+ * both the stored value and the value passed in alone
+ * @param hash_table an empty table with a small capacity, so that it grows
+ */
+template <typename Table>
+void MoveTest(Table &hash_table) {
+  num_copies = 0;
+  for (int i = 0; i < 1000; ++i) {
+    hash_table.Insert(std::to_string(i),
+                      CountedValue(std::string(64, 'a' + i % 26)));
+  }
+  for (int i = 1000; i < 2000; ++i) {
+    assert(hash_table.Emplace(std::to_string(i),
+                              std::string(64, 'a' + i % 26)));
+  }
+  assert(num_copies == 0);
+  for (int i = 0; i < 2000; ++i) {
+    assert(hash_table.Get(std::to_string(i)).data_ ==
+           std::string(64, 'a' + i % 26));
+  }
+
+  CountedValue value(std::string("new"));
+  assert(!hash_table.TryEmplace("0", std::move(value)));
+  assert(value.data_ == "new");
+  assert(!hash_table.Emplace("0", "ignored"));
+  assert(hash_table.Get("0").data_ == std::string(64, 'a'));
+}
+
+/**
+ * Value without a single-argument constructor, to emplace in place
+ */
+struct Point {
+  int x_{0};
+  int y_{0};
+
+  Point() = default;
+  Point(int x, int y) : x_(x), y_(y) {}
+};
+
+/**
+ * Checks that Emplace constructs a Point from its arguments, leaves an
+ * existing key alone, and value-initializes the Point given no arguments
+ */
+template <typename Table>
+void EmplaceTest() {
+  Table hash_table(4, 0.75);
+  for (int i = 0; i < 100; ++i) {
+    assert(hash_table.Emplace(i, i, -i));
+  }
+  assert(!hash_table.Emplace(0, 1, 1));
+  assert(hash_table.Emplace(100));
+  for (int i = 0; i < 100; ++i) {
+    Point point = hash_table.Get(i);
+    assert(point.x_ == i && point.y_ == -i);
+  }
+  Point point = hash_table.Get(100);
+  assert(point.x_ == 0 && point.y_ == 0);
+}
+
+#endif  // COUNTED_VALUE_H_
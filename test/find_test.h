@@ -0,0 +1,66 @@
+#ifndef FIND_TEST_H_
+#define FIND_TEST_H_
+
+#include <atomic>
+#include <cassert>
+#include <optional>
+#include <string>
+#include <thread>
+
+/**
+ * Checks TryGet and Find on a table of integers: a stored 0 is told apart
+ * from a missing key, and Find calls its function only on existing keys
+ */
+template <typename Table>
+void TryGetFindTest() {
+  Table hash_table(4, 0.75);
+  for (int i = 0; i < 100; ++i) {
+    hash_table.Insert(i, i * 2);
+  }
+  assert(hash_table.TryGet(0) == std::optional<int>(0));
+  assert(!hash_table.TryGet(100).has_value());
+  assert(hash_table.TryGet(42) == std::optional<int>(84));
+  int sum = 0;
+  for (int i = 0; i < 100; ++i) {
+    assert(hash_table.Find(i, [&sum](const int &value) { sum += value; }));
+  }
+  assert(sum == 99 * 100);
+  assert(!hash_table.Find(100, [](const int &) { assert(false); }));
+}
+
+/**
+ * Checks that a table of std::string values passes Find the stored value
+ * rather than a copy, and that the value stays whole while another thread
+ * replaces and deletes keys
+ */
+template <typename Table>
+void InPlaceFindTest() {
+  constexpr size_t VALUE_SIZE = 4096;
+  Table hash_table(4, 0.75);
+  hash_table.Insert(0, std::string(VALUE_SIZE, 'a'));
+  const std::string *stored = nullptr;
+  hash_table.Find(0, [&stored](const std::string &value) { stored = &value; });
+  hash_table.Find(0, [stored](const std::string &value) {
+    assert(&value == stored);
+  });
+  std::atomic<bool> done{false};
+  std::thread writer([&hash_table, &done] {
+    for (int i = 0; i < 2000; ++i) {
+      int key = 1 + i % 8;
+      hash_table.Insert(key, std::string(VALUE_SIZE, 'a' + i % 26));
+      hash_table.Delete(key);
+    }
+    done = true;
+  });
+  while (!done) {
+    for (int key = 1; key <= 8; ++key) {
+      hash_table.Find(key, [](const std::string &value) {
+        assert(value.size() == VALUE_SIZE);
+        assert(value.find_first_not_of(value[0]) == std::string::npos);
+      });
+    }
+  }
+  writer.join();
+}
+
+#endif  // FIND_TEST_H_
@@ -1,11 +1,22 @@
 #include "fine_hash_table.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <chrono>
 #include <functional>
 #include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
 #include <thread>
 #include <utility>
+#include <vector>
+
+#include "counted_value.h"
+#include "find_test.h"
+#include "stats_test.h"
+#include "upsert_test.h"
 
 
 static int NUM_THREADS = 4;
@@ -16,6 +27,27 @@ enum Ops {
   DELETE,
 };
 
+/**
+ * Key that counts how often it is hashed
+ */
+struct CountedKey {
+  int value_;
+
+  bool operator==(const CountedKey &other) const {
+    return value_ == other.value_;
+  }
+};
+
+static std::atomic<int> num_hashes{0};
+
+template <>
+struct KeyHash<CountedKey> {
+  size_t operator()(const CountedKey &key) const {
+    num_hashes.fetch_add(1, std::memory_order_relaxed);
+    return std::hash<int>{}(key.value_);
+  }
+};
+
 /**
  * Correctness Test for the coarse-grained hash table
  */
@@ -106,6 +138,178 @@ void CorrectnessTest3() {
   std::cout << "Correctness Test 3 passed\n";
 }
 
+template <typename HashTable>
+void ConcurrentChurn(int id, HashTable &hash_table) {
+  // Long chains that are constantly reallocated and shifted under readers
+  // that do not lock the buckets
+  for (int round = 0; round < 200; ++round) {
+    for (int key = 0; key < 256; ++key) {
+      hash_table.Insert(key, key);
+      int value = hash_table.Get((key + id) % 256);
+      assert(value == 0 || value == (key + id) % 256);
+      hash_table.Delete(key);
+    }
+  }
+}
+
+void CorrectnessTest4() {
+  std::cout << "----------Correctness Test 4----------\n";
+  FineHashTable<int, int> hash_table(4, 128);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < NUM_THREADS; ++i) {
+    threads.push_back(std::thread(ConcurrentChurn<FineHashTable<int, int>>, i,
+                                  std::ref(hash_table)));
+  }
+
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  std::cout << "Correctness Test 4 passed\n";
+}
+
+void CorrectnessTest5() {
+  std::cout << "----------Correctness Test 5----------\n";
+  // 5 buckets and 3 stripes are rounded up to powers of two
+  FineHashTable<int, int, MaskIndex> hash_table(5, 0.75, 3);
+  for (int i = 0; i < 1000; ++i) {
+    hash_table.Insert(i, i);
+  }
+  for (int i = 0; i < 1000; i += 2) {
+    hash_table.Delete(i);
+  }
+  for (int i = 0; i < 1000; ++i) {
+    assert(hash_table.Contains(i) == (i % 2 == 1));
+  }
+  assert(hash_table.Get(999) == 999);
+  assert(hash_table.size() == 500);
+  std::cout << "Correctness Test 5 passed\n";
+}
+
+void CorrectnessTest6() {
+  std::cout << "----------Correctness Test 6----------\n";
+  FineHashTable<int, int> hash_table(4, 0.75);
+  std::vector<int> keys;
+  std::vector<int> values;
+  for (int i = 0; i < 1000; ++i) {
+    keys.push_back(i);
+    values.push_back(i + 1);
+  }
+  hash_table.MultiInsert(keys.data(), values.data(), 500);
+  std::vector<int> results(keys.size());
+  hash_table.MultiGet(keys.data(), keys.size(), results.data());
+  bool found[1000];
+  hash_table.MultiContains(keys.data(), keys.size(), found);
+  for (int i = 0; i < 1000; ++i) {
+    assert(results[i] == (i < 500 ? i + 1 : 0));
+    assert(found[i] == (i < 500));
+  }
+  std::cout << "Correctness Test 6 passed\n";
+}
+
+void CorrectnessTest7() {
+  std::cout << "----------Correctness Test 7----------\n";
+  // Few stripes, so that writers keep revoking the bias of busy stripes
+  using BravoTable =
+      FineHashTable<int, int, ModuloIndex, BravoReaderWriterLock>;
+  BravoTable hash_table(4, 128, 2);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < NUM_THREADS; ++i) {
+    threads.push_back(
+        std::thread(ConcurrentChurn<BravoTable>, i, std::ref(hash_table)));
+  }
+
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  std::cout << "Correctness Test 7 passed\n";
+}
+
+void CorrectnessTest8() {
+  std::cout << "----------Correctness Test 8----------\n";
+  TableStats stats = StatsTest<FineHashTable<int, int>>();
+  assert(stats.max_chain_length_ >= 1);
+  // The table started at 4 slots, so it must have grown
+  assert(!stats.enabled_ || stats.resizes_ > 0);
+  std::cout << "Correctness Test 8 passed\n";
+}
+
+void CorrectnessTest9() {
+  std::cout << "----------Correctness Test 9----------\n";
+  FineHashTable<std::string, int> hash_table(4, 0.75);
+  for (int i = 0; i < 100; ++i) {
+    std::string key = "key" + std::to_string(i);
+    hash_table.Insert(key, i);
+  }
+  // Lookups by std::string_view or C string do not build a std::string
+  for (int i = 0; i < 100; i += 2) {
+    std::string key = "key" + std::to_string(i);
+    hash_table.Delete(std::string_view(key));
+  }
+  assert(hash_table.Get(std::string_view("key1")) == 1);
+  assert(hash_table.Contains("key99"));
+  assert(!hash_table.Contains(std::string_view("key42")));
+  assert(hash_table.Get(std::string("key7")) == 7);
+  std::cout << "Correctness Test 9 passed\n";
+}
+
+void CorrectnessTest10() {
+  std::cout << "----------Correctness Test 10----------\n";
+  // Entries keep the hash of their key, so growing never hashes again
+  FineHashTable<CountedKey, int> hash_table(4, 0.75);
+  num_hashes = 0;
+  for (int i = 0; i < 1000; ++i) {
+    hash_table.Insert(CountedKey{i}, i);
+  }
+  assert(num_hashes == 1000);
+  assert(hash_table.Get(CountedKey{500}) == 500);
+
+  // Batched operations search with the hashes taken to prefetch the buckets
+  std::vector<CountedKey> keys;
+  std::vector<int> values;
+  for (int i = 1000; i < 1100; ++i) {
+    keys.push_back(CountedKey{i});
+    values.push_back(i);
+  }
+  std::vector<int> results(keys.size());
+  bool found[100];
+  num_hashes = 0;
+  hash_table.MultiInsert(keys.data(), values.data(), keys.size());
+  hash_table.MultiGet(keys.data(), keys.size(), results.data());
+  hash_table.MultiContains(keys.data(), keys.size(), found);
+  assert(num_hashes == 300);
+  for (size_t i = 0; i < keys.size(); ++i) {
+    assert(results[i] == values[i] && found[i]);
+  }
+  std::cout << "Correctness Test 10 passed\n";
+}
+
+void CorrectnessTest11() {
+  std::cout << "----------Correctness Test 11----------\n";
+  UpsertTest<FineHashTable<int, int>>(NUM_THREADS);
+  std::cout << "Correctness Test 11 passed\n";
+}
+
+void CorrectnessTest12() {
+  std::cout << "----------Correctness Test 12----------\n";
+  TryGetFindTest<FineHashTable<int, int>>();
+  // Large values are read in place, also while they are replaced and deleted
+  InPlaceFindTest<FineHashTable<int, std::string>>();
+  std::cout << "Correctness Test 12 passed\n";
+}
+
+void CorrectnessTest13() {
+  std::cout << "----------Correctness Test 13----------\n";
+  FineHashTable<std::string, CountedValue> hash_table(4, 0.75);
+  MoveTest(hash_table);
+  // InsertOrAssign moves a value in over an existing one
+  CountedValue value(std::string("new"));
+  assert(!hash_table.InsertOrAssign("0", std::move(value)));
+  assert(hash_table.Get("0").data_ == "new");
+  std::cout << "Correctness Test 13 passed\n";
+}
+
 /**
  * Benchmark for the coarse-grained hash table.
  * Performs concurrent read, insert, and delete without checking for
@@ -146,16 +350,51 @@ void mixed_workload(int id, FineHashTable<int, int> &hash_table,
   }
 }
 
+void batch_workload(int id, FineHashTable<int, int> &hash_table,
+                    std::vector<Ops> &op_mix,
+                    std::vector<std::pair<int, int>> &data) {
+  int stride = NUM_OPS / NUM_THREADS;
+  int start = id * stride;
+
+  // The same operations as mixed_workload, but the reads and inserts of
+  // every run of 100 operations are issued as one batch each
+  std::vector<int> read_keys;
+  std::vector<int> values;
+  std::vector<int> insert_keys;
+  std::vector<int> insert_values;
+  for (int run = start; run < start + stride; run += 100) {
+    read_keys.clear();
+    insert_keys.clear();
+    insert_values.clear();
+    for (int i = run; i < std::min(run + 100, start + stride); ++i) {
+      int idx = i % 100;
+      if (op_mix[idx] == READ) {
+        read_keys.push_back(data[i].first);
+      } else if (op_mix[idx] == INSERT) {
+        insert_keys.push_back(data[i].first);
+        insert_values.push_back(data[i].second);
+      } else {
+        hash_table.Delete(data[i].first);
+      }
+    }
+    values.resize(read_keys.size());
+    hash_table.MultiGet(read_keys.data(), read_keys.size(), values.data());
+    hash_table.MultiInsert(insert_keys.data(), insert_values.data(),
+                           insert_keys.size());
+  }
+}
+
 void Benchmark(int num_read, int num_insert, int num_delete,
-               std::vector<std::pair<int, int>> &data) {
+               std::vector<std::pair<int, int>> &data, bool batched = false) {
   std::vector<Ops> op_mix = CreateWorkLoad(num_read, num_insert, num_delete);
   FineHashTable<int, int> hash_table;
   std::vector<std::thread> threads;
 
   auto start = std::chrono::steady_clock::now();
   for (int i = 0; i < NUM_THREADS; ++i) {
-    threads.push_back(std::thread(mixed_workload, i, std::ref(hash_table),
-                                  std::ref(op_mix), std::ref(data)));
+    threads.push_back(std::thread(batched ? batch_workload : mixed_workload,
+                                  i, std::ref(hash_table), std::ref(op_mix),
+                                  std::ref(data)));
   }
 
   for (auto &thread : threads) {
@@ -167,11 +406,82 @@ void Benchmark(int num_read, int num_insert, int num_delete,
   std::cout
       << NUM_OPS << " access (" << num_read << "% read, " << num_insert
       << "% insert, " << num_delete
-      << "% delete) on fine-grained hash table: "
+      << "% delete)" << (batched ? " batched" : "")
+      << " on fine-grained hash table: "
       << std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count()
       << " ms \n";
 }
 
+template <typename IndexPolicy>
+void IndexWorkload(int id, FineHashTable<int, int, IndexPolicy> &hash_table,
+                   const std::vector<int> &keys) {
+  int stride = keys.size() / NUM_THREADS;
+  int start = id * stride;
+
+  for (int i = start; i < start + stride; ++i) {
+    hash_table.Insert(keys[i], i);
+  }
+  for (int i = start; i < start + stride; ++i) {
+    hash_table.Get(keys[i]);
+  }
+}
+
+/**
+ * Times inserting and reading keys in the given order with an index policy.
+ * Sequential keys favor ModuloIndex, whose identity hash puts consecutive
+ * keys into consecutive buckets; random keys leave neither policy any
+ * locality, so only the cost of the index itself differs
+ */
+template <typename IndexPolicy>
+void IndexBenchmark(const char *policy, const char *order,
+                    const std::vector<int> &keys) {
+  FineHashTable<int, int, IndexPolicy> hash_table;
+  std::vector<std::thread> threads;
+
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < NUM_THREADS; ++i) {
+    threads.push_back(std::thread(IndexWorkload<IndexPolicy>, i,
+                                  std::ref(hash_table), std::cref(keys)));
+  }
+
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  auto end = std::chrono::steady_clock::now();
+  std::chrono::duration<double> elapsed = end - start;
+  std::cout
+      << keys.size() << " " << order << " inserts and reads with " << policy
+      << " on fine-grained hash table: "
+      << std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count()
+      << " ms \n";
+}
+
+/**
+ * Times the index calculation alone, i.e. the division of ModuloIndex against
+ * the mixing and masking of MaskIndex. Each index feeds the next hash, as a
+ * lookup waits for its index before it loads the bucket
+ */
+template <typename IndexPolicy>
+void IndexCostBenchmark(const char *policy, const std::vector<int> &keys) {
+  // Not a compile-time constant, so the modulo is a real division
+  size_t capacity = IndexPolicy::RoundCapacity(keys.size() / 3);
+  size_t idx = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  for (int round = 0; round < 10; ++round) {
+    for (int key : keys) {
+      idx = IndexPolicy::Index(KeyHash<int>{}(key) ^ idx, capacity);
+    }
+  }
+  auto end = std::chrono::steady_clock::now();
+  std::chrono::duration<double> elapsed = end - start;
+  std::cout
+      << keys.size() * 10 << " indexes with " << policy << ": "
+      << std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count()
+      << " ms (last index " << idx << ")\n";
+}
+
 void GenerateKeyValue(std::vector<std::pair<int, int>> &data) {
   for (int i = 0; i < NUM_OPS; ++i) {
     data.push_back({rand(), rand()});
@@ -182,6 +492,16 @@ int main(int argc, char **argv) {
   // CorrectnessTest1();
   // CorrectnessTest2();
   // CorrectnessTest3();
+  // CorrectnessTest4();
+  // CorrectnessTest5();
+  // CorrectnessTest6();
+  // CorrectnessTest7();
+  // CorrectnessTest8();
+  // CorrectnessTest9();
+  // CorrectnessTest10();
+  // CorrectnessTest11();
+  // CorrectnessTest12();
+  // CorrectnessTest13();
 
   if (argc > 1) {
     NUM_THREADS = atoi(argv[1]);
@@ -189,6 +509,20 @@ int main(int argc, char **argv) {
   std::vector<std::pair<int, int>> data;
   GenerateKeyValue(data);
   Benchmark(80, 10, 10, data);
+  Benchmark(80, 10, 10, data, true);
+  std::vector<int> keys(NUM_OPS);
+  for (int i = 0; i < NUM_OPS; ++i) {
+    keys[i] = i;
+  }
+  IndexBenchmark<ModuloIndex>("ModuloIndex", "sequential", keys);
+  IndexBenchmark<MaskIndex>("MaskIndex", "sequential", keys);
+  for (int &key : keys) {
+    key = rand();
+  }
+  IndexBenchmark<ModuloIndex>("ModuloIndex", "random", keys);
+  IndexBenchmark<MaskIndex>("MaskIndex", "random", keys);
+  IndexCostBenchmark<ModuloIndex>("ModuloIndex", keys);
+  IndexCostBenchmark<MaskIndex>("MaskIndex", keys);
 
   std::cout << "All test cases passed\n";
 
@@ -0,0 +1,250 @@
+#ifndef FLAT_TABLE_TEST_H_
+#define FLAT_TABLE_TEST_H_
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <utility>
+#include <vector>
+
+inline constexpr int NUM_OPS = 1000000;
+enum Ops {
+  READ,
+  INSERT,
+  DELETE,
+};
+
+/**
+ * Checks Insert, Delete, Get and Contains on a table of the default size
+ */
+template <typename Table>
+void BasicTest() {
+  Table hash_table;
+  for (int i = 0; i < 10; ++i) {
+    hash_table.Insert(i + 1, i + 1);
+  }
+  hash_table.Delete(2);
+  hash_table.Delete(6);
+  hash_table.Delete(4);
+  assert(hash_table.Get(1) == 1);
+  assert(!hash_table.Contains(2));
+  hash_table.Insert(5, 10);
+}
+
+/**
+ * Checks the same operations on a table that starts at 4 slots and grows
+ */
+template <typename Table>
+void GrowthTest() {
+  Table hash_table(4, 0.75);
+  for (int i = 0; i < 30; ++i) {
+    hash_table.Insert(i + 1, i + 1);
+  }
+  for (int i = 0; i < 15; ++i) {
+    if (i % 2 == 0) {
+      hash_table.Delete(i);
+    }
+  }
+  assert(hash_table.Contains(5));
+  assert(!hash_table.Contains(8));
+  assert(hash_table.Get(7) == 7);
+  assert(hash_table.Contains(26));
+  assert(hash_table.Contains(29));
+  assert(!hash_table.Contains(4));
+}
+
+/**
+ * Every thread inserts, looks up, deletes and reinserts a range of keys of
+ * its own, and checks each step, while the other threads do the same
+ * @param num_threads the number of threads
+ */
+template <typename Table>
+void ConcurrentSearchInsertDeleteTest(int num_threads) {
+  Table hash_table;
+  int stride = NUM_OPS / num_threads;
+  std::vector<std::thread> threads;
+  for (int id = 0; id < num_threads; ++id) {
+    threads.emplace_back([&hash_table, stride, id] {
+      int start = id * stride;
+      for (int i = start; i < start + stride; ++i) {
+        if (i % 2 == 0) {
+          hash_table.Insert(i, i);
+        }
+      }
+
+      for (int i = start; i < start + stride; ++i) {
+        if (i % 2 == 0) {
+          assert(hash_table.Contains(i));
+          assert(hash_table.Get(i) == i);
+        } else {
+          assert(!hash_table.Contains(i));
+        }
+      }
+
+      for (int i = start; i < start + stride; ++i) {
+        if (i % 2 == 0) {
+          hash_table.Delete(i);
+        } else {
+          hash_table.Insert(i, i);
+        }
+      }
+
+      for (int i = start; i < start + stride; ++i) {
+        if (i % 2 == 0) {
+          assert(!hash_table.Contains(i));
+        } else {
+          assert(hash_table.Contains(i));
+          assert(hash_table.Get(i) == i);
+        }
+      }
+    });
+  }
+
+  for (auto &thread : threads) {
+    thread.join();
+  }
+}
+
+/**
+ * All threads insert and delete the same 64 keys, looking up the keys of
+ * the other threads in between, so that every write lands on slots other
+ * threads are reading or writing at the same time
+ * @param num_threads the number of threads
+ */
+template <typename Table>
+void ConcurrentChurnTest(int num_threads) {
+  Table hash_table;
+  std::vector<std::thread> threads;
+  for (int id = 0; id < num_threads; ++id) {
+    threads.emplace_back([&hash_table, id] {
+      for (int round = 0; round < 200; ++round) {
+        for (int key = 0; key < 64; ++key) {
+          hash_table.Insert(key, key);
+          hash_table.Contains((key + id) % 64);
+          hash_table.Delete(key);
+        }
+      }
+      for (int key = 0; key < 64; ++key) {
+        int value = hash_table.Get(key);
+        assert(value == 0 || value == key);
+      }
+    });
+  }
+
+  for (auto &thread : threads) {
+    thread.join();
+  }
+}
+
+/**
+ * Fills a table close to its maximum load with 1000 keys, then every thread
+ * inserts 20000 new keys, checking after each insert that the first 1000
+ * keys, which the new keys push out of their slots, are still visible
+ * @param num_threads the number of threads
+ * @param max_load_factor the maximum load factor of the table
+ */
+template <typename Table>
+void ConcurrentDisplaceTest(int num_threads, float max_load_factor) {
+  Table hash_table(1024, max_load_factor);
+  for (int key = 0; key < 1000; ++key) {
+    hash_table.Insert(key, key);
+  }
+  std::vector<std::thread> threads;
+  for (int id = 0; id < num_threads; ++id) {
+    threads.emplace_back([&hash_table, id] {
+      int start = 1000 + id * 20000;
+      for (int key = start; key < start + 20000; ++key) {
+        hash_table.Insert(key, key);
+        assert(hash_table.Get(key % 1000) == key % 1000);
+      }
+    });
+  }
+
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  assert(hash_table.size() == 1000 + static_cast<size_t>(num_threads) * 20000);
+  for (int key = 0; key < 1000 + num_threads * 20000; ++key) {
+    assert(hash_table.Get(key) == key);
+  }
+}
+
+/**
+ * Benchmark for the flat hash tables.
+ * Performs concurrent read, insert, and delete without checking for
+ * correctness, only making sure that everything completes without crashing.
+ */
+
+inline std::vector<Ops> CreateWorkLoad(int num_read, int num_insert,
+                                       int num_delete) {
+  std::vector<Ops> op_mix;
+  for (int i = 0; i < num_read; ++i) {
+    op_mix.push_back(READ);
+  }
+  for (int i = 0; i < num_insert; ++i) {
+    op_mix.push_back(INSERT);
+  }
+  for (int i = 0; i < num_delete; ++i) {
+    op_mix.push_back(DELETE);
+  }
+  std::random_shuffle(op_mix.begin(), op_mix.end());
+
+  return op_mix;
+}
+
+/**
+ * Runs NUM_OPS operations of the given mix on a table of the default size
+ * and prints how long they took
+ * @param name the name of the table in the output
+ * @param num_threads the number of threads sharing the operations
+ * @param data the keys and values of the operations
+ */
+template <typename Table>
+void Benchmark(const char *name, int num_threads, int num_read,
+               int num_insert, int num_delete,
+               std::vector<std::pair<int, int>> &data) {
+  std::vector<Ops> op_mix = CreateWorkLoad(num_read, num_insert, num_delete);
+  Table hash_table;
+  int stride = NUM_OPS / num_threads;
+  std::vector<std::thread> threads;
+
+  auto start = std::chrono::steady_clock::now();
+  for (int id = 0; id < num_threads; ++id) {
+    threads.emplace_back([&hash_table, &op_mix, &data, stride, id] {
+      for (int i = id * stride; i < (id + 1) * stride; ++i) {
+        int idx = i % 100;
+        if (op_mix[idx] == READ) {
+          hash_table.Get(data[i].first);
+        } else if (op_mix[idx] == INSERT) {
+          hash_table.Insert(data[i].first, data[i].second);
+        } else {
+          hash_table.Delete(data[i].first);
+        }
+      }
+    });
+  }
+
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  auto end = std::chrono::steady_clock::now();
+  std::chrono::duration<double> elapsed = end - start;
+  std::cout
+      << NUM_OPS << " access (" << num_read << "% read, " << num_insert
+      << "% insert, " << num_delete << "% delete) on " << name << ": "
+      << std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count()
+      << " ms \n";
+}
+
+inline void GenerateKeyValue(std::vector<std::pair<int, int>> &data) {
+  for (int i = 0; i < NUM_OPS; ++i) {
+    data.push_back({rand(), rand()});
+  }
+}
+
+#endif  // FLAT_TABLE_TEST_H_
@@ -0,0 +1,106 @@
+#ifndef HISTOGRAM_H_
+#define HISTOGRAM_H_
+
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Log-linear latency histogram in the style of HdrHistogram.
+ *
+ * Values below 2^SUB_BUCKET_BITS are counted exactly; above, every power of
+ * two is split into 2^SUB_BUCKET_BITS equal buckets, so a recorded value is
+ * known within 1/128 of itself whatever its magnitude. Recording is one
+ * bit scan and one increment, cheap enough to time every operation. A
+ * histogram belongs to a single thread; the histograms of a run are merged
+ * once the threads are done.
+ */
+class LatencyHistogram {
+ public:
+  LatencyHistogram() : counts_(NUM_BUCKETS, 0) {}
+
+  /**
+   * Counts one value
+   * @param value the value to count, e.g. a latency in nanoseconds
+   */
+  void Record(uint64_t value) {
+    value = std::min(value, MAX_VALUE);
+    ++counts_[BucketIndex(value)];
+    ++count_;
+    max_ = std::max(max_, value);
+  }
+
+  /**
+   * Adds the values counted by another histogram to this one
+   * @param other the histogram to add
+   */
+  void Merge(const LatencyHistogram &other) {
+    for (size_t i = 0; i < NUM_BUCKETS; ++i) {
+      counts_[i] += other.counts_[i];
+    }
+    count_ += other.count_;
+    max_ = std::max(max_, other.max_);
+  }
+
+  uint64_t Count() const { return count_; }
+
+  uint64_t Max() const { return max_; }
+
+  /**
+   * Gets a percentile of the counted values
+   * @param percentile the percentile, in [0, 100]
+   * @return the midpoint of the bucket holding that percentile (at most
+   * Max()), or 0 if nothing was counted
+   */
+  uint64_t Percentile(double percentile) const {
+    if (count_ == 0) {
+      return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(percentile / 100 * count_ + 0.5);
+    rank = std::max<uint64_t>(rank, 1);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < NUM_BUCKETS; ++i) {
+      seen += counts_[i];
+      if (seen >= rank) {
+        return std::min(BucketMidpoint(i), max_);
+      }
+    }
+    return max_;
+  }
+
+ private:
+  static constexpr int SUB_BUCKET_BITS{7};
+  static constexpr uint64_t SUB_BUCKETS{uint64_t{1} << SUB_BUCKET_BITS};
+  // Larger values are counted as MAX_VALUE (about 18 minutes in ns)
+  static constexpr int MAX_MAGNITUDE{40};
+  static constexpr uint64_t MAX_VALUE{(uint64_t{1} << MAX_MAGNITUDE) - 1};
+  static constexpr size_t NUM_BUCKETS{
+      SUB_BUCKETS * (MAX_MAGNITUDE - SUB_BUCKET_BITS + 1)};
+
+  static size_t BucketIndex(uint64_t value) {
+    if (value < SUB_BUCKETS) {
+      return value;
+    }
+    int magnitude = 63 - __builtin_clzll(value);
+    int shift = magnitude - SUB_BUCKET_BITS;
+    // The top SUB_BUCKET_BITS + 1 bits of the value, in [SUB_BUCKETS, 2 *
+    // SUB_BUCKETS), pick the bucket within the power of two
+    return (shift + 1) * SUB_BUCKETS + ((value >> shift) - SUB_BUCKETS);
+  }
+
+  static uint64_t BucketMidpoint(size_t index) {
+    if (index < SUB_BUCKETS) {
+      return index;
+    }
+    int shift = static_cast<int>(index / SUB_BUCKETS) - 1;
+    uint64_t lowest = (index % SUB_BUCKETS + SUB_BUCKETS) << shift;
+    return lowest + ((uint64_t{1} << shift) >> 1);
+  }
+
+  std::vector<uint64_t> counts_;
+  uint64_t count_{0};
+  uint64_t max_{0};
+};
+
+#endif  // HISTOGRAM_H_
@@ -0,0 +1,111 @@
+
+#include "hopscotch_hash_table.h"
+
+#include <cassert>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+#include "counted_value.h"
+#include "find_test.h"
+#include "flat_table_test.h"
+#include "short_string.h"
+#include "stats_test.h"
+#include "upsert_test.h"
+
+static int NUM_THREADS = 4;
+
+/**
+ * Correctness Test for the hopscotch hash table
+ */
+void CorrectnessTest1() {
+  std::cout << "----------Correctness Test 1----------\n";
+  BasicTest<HopscotchHashTable<int, int>>();
+  std::cout << "Correctness Test 1 passed\n";
+}
+
+void CorrectnessTest2() {
+  std::cout << "----------Correctness Test 2----------\n";
+  GrowthTest<HopscotchHashTable<int, int>>();
+  std::cout << "Correctness Test 2 passed\n";
+}
+
+void CorrectnessTest3() {
+  std::cout << "----------Correctness Test 3----------\n";
+  ConcurrentSearchInsertDeleteTest<HopscotchHashTable<int, int>>(NUM_THREADS);
+  std::cout << "Correctness Test 3 passed\n";
+}
+
+void CorrectnessTest4() {
+  std::cout << "----------Correctness Test 4----------\n";
+  // All threads insert and delete the same small set of keys, so that the
+  // same buckets are freed and refilled, and the hop bits of their home
+  // buckets set and cleared, under the segment locks while readers are still
+  // scanning those neighborhoods. Keys displaced within their neighborhoods
+  // are raced by CorrectnessTest5
+  ConcurrentChurnTest<HopscotchHashTable<int, int>>(NUM_THREADS);
+  std::cout << "Correctness Test 4 passed\n";
+}
+
+void CorrectnessTest5() {
+  std::cout << "----------Correctness Test 5----------\n";
+  // New keys displace the first 1000 keys within their neighborhoods, moving
+  // their hop bits along; they must stay visible to readers at all times
+  ConcurrentDisplaceTest<HopscotchHashTable<int, int>>(NUM_THREADS, 0.9);
+  std::cout << "Correctness Test 5 passed\n";
+}
+
+void CorrectnessTest6() {
+  std::cout << "----------Correctness Test 6----------\n";
+  TableStats stats = StatsTest<HopscotchHashTable<int, int>>();
+  // The table started at 4 slots, so it must have grown
+  assert(!stats.enabled_ || stats.resizes_ > 0);
+  std::cout << "Correctness Test 6 passed\n";
+}
+
+void CorrectnessTest7() {
+  std::cout << "----------Correctness Test 7----------\n";
+  TransparentLookupTest<HopscotchHashTable<ShortString, int>>();
+  std::cout << "Correctness Test 7 passed\n";
+}
+
+void CorrectnessTest8() {
+  std::cout << "----------Correctness Test 8----------\n";
+  UpsertTest<HopscotchHashTable<int, int>>(NUM_THREADS);
+  std::cout << "Correctness Test 8 passed\n";
+}
+
+void CorrectnessTest9() {
+  std::cout << "----------Correctness Test 9----------\n";
+  TryGetFindTest<HopscotchHashTable<int, int>>();
+  std::cout << "Correctness Test 9 passed\n";
+}
+
+void CorrectnessTest10() {
+  std::cout << "----------Correctness Test 10----------\n";
+  EmplaceTest<HopscotchHashTable<int, Point>>();
+  std::cout << "Correctness Test 10 passed\n";
+}
+
+int main(int argc, char **argv) {
+  // CorrectnessTest1();
+  // CorrectnessTest2();
+  // CorrectnessTest3();
+  // CorrectnessTest4();
+  // CorrectnessTest5();
+  // CorrectnessTest6();
+  // CorrectnessTest7();
+  // CorrectnessTest8();
+  // CorrectnessTest9();
+  // CorrectnessTest10();
+
+  if (argc > 1) {
+    NUM_THREADS = atoi(argv[1]);
+  }
+  std::vector<std::pair<int, int>> data;
+  GenerateKeyValue(data);
+  Benchmark<HopscotchHashTable<int, int>>("hopscotch hash table", NUM_THREADS,
+                                          80, 10, 10, data);
+
+  return 0;
+}
\ No newline at end of file
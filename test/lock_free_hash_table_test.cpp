@@ -2,10 +2,19 @@
 #include "lock_free_hash_table.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <optional>
+#include <string>
+#include <string_view>
 #include <thread>
 #include <vector>
 
+#include "counted_value.h"
+#include "find_test.h"
+#include "stats_test.h"
+#include "upsert_test.h"
+
 static int NUM_THREADS = 4;
 static constexpr int NUM_OPS = 1000000;
 enum Ops {
@@ -104,6 +113,197 @@ void CorrectnessTest3() {
   std::cout << "Correctness Test 3 passed\n";
 }
 
+void ConcurrentChurn(int id, LockFreeHashTable<int, int> &hash_table) {
+  // All threads insert and delete the same small set of keys so that nodes
+  // are unlinked while other threads are still traversing them
+  for (int round = 0; round < 200; ++round) {
+    for (int key = 0; key < 64; ++key) {
+      hash_table.Insert(key, key);
+      hash_table.Contains((key + id) % 64);
+      hash_table.Delete(key);
+    }
+  }
+  for (int key = 0; key < 64; ++key) {
+    int value = hash_table.Get(key);
+    assert(value == 0 || value == key);
+  }
+}
+
+void CorrectnessTest4() {
+  std::cout << "----------Correctness Test 4----------\n";
+  LockFreeHashTable<int, int> hash_table;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < NUM_THREADS; ++i) {
+    threads.push_back(std::thread(ConcurrentChurn, i, std::ref(hash_table)));
+  }
+
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  std::cout << "Correctness Test 4 passed\n";
+}
+
+void CorrectnessTest5() {
+  std::cout << "----------Correctness Test 5----------\n";
+  LockFreeHashTable<int, int> hash_table(4, 0.75);
+  std::vector<int> keys;
+  std::vector<int> values;
+  for (int i = 0; i < 1000; ++i) {
+    keys.push_back(i);
+    values.push_back(i + 1);
+  }
+  hash_table.MultiInsert(keys.data(), values.data(), 500);
+  std::vector<int> results(keys.size());
+  hash_table.MultiGet(keys.data(), keys.size(), results.data());
+  bool found[1000];
+  hash_table.MultiContains(keys.data(), keys.size(), found);
+  for (int i = 0; i < 1000; ++i) {
+    assert(results[i] == (i < 500 ? i + 1 : 0));
+    assert(found[i] == (i < 500));
+  }
+  std::cout << "Correctness Test 5 passed\n";
+}
+
+void CorrectnessTest6() {
+  std::cout << "----------Correctness Test 6----------\n";
+  TableStats stats = StatsTest<LockFreeHashTable<int, int>>();
+  // The table started at 4 slots, so it must have grown
+  assert(!stats.enabled_ || stats.resizes_ > 0);
+  std::cout << "Correctness Test 6 passed\n";
+}
+
+void CorrectnessTest7() {
+  std::cout << "----------Correctness Test 7----------\n";
+  LockFreeHashTable<std::string, int> hash_table(4, 0.75);
+  for (int i = 0; i < 100; ++i) {
+    std::string key = "key" + std::to_string(i);
+    hash_table.Insert(key, i);
+  }
+  // Lookups by std::string_view or C string do not build a std::string
+  for (int i = 0; i < 100; i += 2) {
+    std::string key = "key" + std::to_string(i);
+    hash_table.Delete(std::string_view(key));
+  }
+  assert(hash_table.Get(std::string_view("key1")) == 1);
+  assert(hash_table.Contains("key99"));
+  assert(!hash_table.Contains(std::string_view("key42")));
+  assert(hash_table.Get(std::string("key7")) == 7);
+  std::cout << "Correctness Test 7 passed\n";
+}
+
+void CorrectnessTest8() {
+  std::cout << "----------Correctness Test 8----------\n";
+  // Integral counters are also incremented with a fetch-and-add
+  UpsertTest<LockFreeHashTable<int, int>>(
+      NUM_THREADS, [](LockFreeHashTable<int, int> &hash_table, int key, int i) {
+        if (i % 2 == 0) {
+          hash_table.Compute(key, [](int &value) { ++value; });
+        } else {
+          hash_table.FetchAdd(key, 1);
+        }
+      });
+
+  // FetchAdd returns the previous value, inserting a missing key at 0
+  LockFreeHashTable<int, int> hash_table(4, 0.75);
+  assert(hash_table.Compute(3, [](int &value) { value += 5; }) == 5);
+  assert(hash_table.FetchAdd(3, 2) == 5);
+  assert(hash_table.FetchAdd(4, 7) == 0);
+  assert(hash_table.Get(3) == 7 && hash_table.Get(4) == 7);
+  std::cout << "Correctness Test 8 passed\n";
+}
+
+void CorrectnessTest9() {
+  std::cout << "----------Correctness Test 9----------\n";
+  TryGetFindTest<LockFreeHashTable<int, int>>();
+  // Large values are read in place, also while they are replaced and deleted
+  InPlaceFindTest<LockFreeHashTable<int, std::string>>();
+  std::cout << "Correctness Test 9 passed\n";
+}
+
+void CorrectnessTest10() {
+  std::cout << "----------Correctness Test 10----------\n";
+  LockFreeHashTable<std::string, CountedValue> hash_table(4, 0.75);
+  MoveTest(hash_table);
+  std::cout << "Correctness Test 10 passed\n";
+}
+
+void CorrectnessTest11() {
+  std::cout << "----------Correctness Test 11----------\n";
+  // Every thread touches the same fresh buckets at once, so they race to
+  // initialize each of them
+  constexpr int NUM_KEYS = 1 << 14;
+  LockFreeHashTable<int, int> hash_table(NUM_KEYS, 0.75);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < NUM_THREADS; ++t) {
+    threads.emplace_back([&hash_table] {
+      for (int i = 0; i < NUM_KEYS; ++i) {
+        hash_table.Insert(i, i);
+        assert(hash_table.Get(i) == i);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  for (int i = 0; i < NUM_KEYS; ++i) {
+    assert(hash_table.Get(i) == i);
+  }
+  assert(hash_table.Stats().size_ == NUM_KEYS);
+  std::cout << "Correctness Test 11 passed\n";
+}
+
+void CorrectnessTest12() {
+  std::cout << "----------Correctness Test 12----------\n";
+  // Values wider than a word are updated by replacing their node, so readers
+  // only ever see whole values and no increment is lost
+  struct Counter {
+    long count_{0};
+    long twice_{0};
+  };
+  constexpr int NUM_INCREMENTS = 10000;
+  constexpr int NUM_COUNTERS = 64;
+  LockFreeHashTable<int, Counter> hash_table(4, 0.75);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < NUM_THREADS; ++t) {
+    threads.emplace_back([&hash_table, t] {
+      for (int i = 0; i < NUM_INCREMENTS; ++i) {
+        hash_table.Compute((i + t) % NUM_COUNTERS, [](Counter &counter) {
+          ++counter.count_;
+          counter.twice_ += 2;
+        });
+        hash_table.Find((i + t + 1) % NUM_COUNTERS,
+                        [](const Counter &counter) {
+                          assert(counter.twice_ == 2 * counter.count_);
+                        });
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  long total = 0;
+  for (int key = 0; key < NUM_COUNTERS; ++key) {
+    Counter counter = hash_table.Get(key);
+    assert(counter.twice_ == 2 * counter.count_);
+    total += counter.count_;
+  }
+  assert(total == static_cast<long>(NUM_THREADS) * NUM_INCREMENTS);
+  assert(hash_table.size() == NUM_COUNTERS);
+
+  // Insert keeps an existing value, InsertOrAssign replaces it
+  LockFreeHashTable<int, std::string> strings(4, 0.75);
+  assert(strings.InsertOrAssign(1, "a"));
+  assert(!strings.InsertOrAssign(1, "b"));
+  strings.Insert(1, "c");
+  assert(strings.Get(1) == "b");
+  assert(strings.Update(1, [](std::string &value) { value += "d"; }));
+  assert(!strings.Update(2, [](std::string &value) { value = "e"; }));
+  assert(strings.Compute(2, [](std::string &value) { value += "f"; }) == "f");
+  assert(strings.Get(1) == "bd" && strings.Get(2) == "f");
+  std::cout << "Correctness Test 12 passed\n";
+}
+
 /**
  * Benchmark for the coarse-grained hash table.
  * Performs concurrent read, insert, and delete without checking for
@@ -144,16 +344,51 @@ void mixed_workload(int id, LockFreeHashTable<int, int> &hash_table,
   }
 }
 
+void batch_workload(int id, LockFreeHashTable<int, int> &hash_table,
+                    std::vector<Ops> &op_mix,
+                    std::vector<std::pair<int, int>> &data) {
+  int stride = NUM_OPS / NUM_THREADS;
+  int start = id * stride;
+
+  // The same operations as mixed_workload, but the reads and inserts of
+  // every run of 100 operations are issued as one batch each
+  std::vector<int> read_keys;
+  std::vector<int> values;
+  std::vector<int> insert_keys;
+  std::vector<int> insert_values;
+  for (int run = start; run < start + stride; run += 100) {
+    read_keys.clear();
+    insert_keys.clear();
+    insert_values.clear();
+    for (int i = run; i < std::min(run + 100, start + stride); ++i) {
+      int idx = i % 100;
+      if (op_mix[idx] == READ) {
+        read_keys.push_back(data[i].first);
+      } else if (op_mix[idx] == INSERT) {
+        insert_keys.push_back(data[i].first);
+        insert_values.push_back(data[i].second);
+      } else {
+        hash_table.Delete(data[i].first);
+      }
+    }
+    values.resize(read_keys.size());
+    hash_table.MultiGet(read_keys.data(), read_keys.size(), values.data());
+    hash_table.MultiInsert(insert_keys.data(), insert_values.data(),
+                           insert_keys.size());
+  }
+}
+
 void Benchmark(int num_read, int num_insert, int num_delete,
-               std::vector<std::pair<int, int>> &data) {
+               std::vector<std::pair<int, int>> &data, bool batched = false) {
   std::vector<Ops> op_mix = CreateWorkLoad(num_read, num_insert, num_delete);
   LockFreeHashTable<int, int> hash_table;
   std::vector<std::thread> threads;
 
   auto start = std::chrono::steady_clock::now();
   for (int i = 0; i < NUM_THREADS; ++i) {
-    threads.push_back(std::thread(mixed_workload, i, std::ref(hash_table),
-                                  std::ref(op_mix), std::ref(data)));
+    threads.push_back(std::thread(batched ? batch_workload : mixed_workload,
+                                  i, std::ref(hash_table), std::ref(op_mix),
+                                  std::ref(data)));
   }
 
   for (auto &thread : threads) {
@@ -164,7 +399,8 @@ void Benchmark(int num_read, int num_insert, int num_delete,
   std::chrono::duration<double> elapsed = end - start;
   std::cout
       << NUM_OPS << " access (" << num_read << "% read, " << num_insert
-      << "% insert, " << num_delete << "% delete) on fine-grained hash table: "
+      << "% insert, " << num_delete << "% delete)"
+      << (batched ? " batched" : "") << " on fine-grained hash table: "
       << std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count()
       << " ms \n";
 }
@@ -179,6 +415,15 @@ int main(int argc, char **argv) {
   // CorrectnessTest1();
   // CorrectnessTest2();
   // CorrectnessTest3();
+  // CorrectnessTest4();
+  // CorrectnessTest5();
+  // CorrectnessTest6();
+  // CorrectnessTest7();
+  // CorrectnessTest8();
+  // CorrectnessTest9();
+  // CorrectnessTest10();
+  // CorrectnessTest11();
+  // CorrectnessTest12();
 
   if (argc > 1) {
     NUM_THREADS = atoi(argv[1]);
@@ -186,6 +431,7 @@ int main(int argc, char **argv) {
   std::vector<std::pair<int, int>> data;
   GenerateKeyValue(data);
   Benchmark(80, 10, 10, data);
+  Benchmark(80, 10, 10, data, true);
 
   return 0;
 }
\ No newline at end of file
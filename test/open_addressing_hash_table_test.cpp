@@ -0,0 +1,145 @@
+
+#include "open_addressing_hash_table.h"
+
+#include <cassert>
+#include <functional>
+#include <iostream>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "counted_value.h"
+#include "find_test.h"
+#include "flat_table_test.h"
+#include "short_string.h"
+#include "stats_test.h"
+#include "upsert_test.h"
+
+static int NUM_THREADS = 4;
+
+/**
+ * Correctness Test for the open-addressing hash table
+ */
+void CorrectnessTest1() {
+  std::cout << "----------Correctness Test 1----------\n";
+  BasicTest<OpenAddressingHashTable<int, int>>();
+  std::cout << "Correctness Test 1 passed\n";
+}
+
+void CorrectnessTest2() {
+  std::cout << "----------Correctness Test 2----------\n";
+  GrowthTest<OpenAddressingHashTable<int, int>>();
+  std::cout << "Correctness Test 2 passed\n";
+}
+
+void CorrectnessTest3() {
+  std::cout << "----------Correctness Test 3----------\n";
+  ConcurrentSearchInsertDeleteTest<OpenAddressingHashTable<int, int>>(
+      NUM_THREADS);
+  std::cout << "Correctness Test 3 passed\n";
+}
+
+void CorrectnessTest4() {
+  std::cout << "----------Correctness Test 4----------\n";
+  // All threads insert and delete the same small set of keys, so that the
+  // tombstones they leave are reused for the same keys, and purged by
+  // migrations, while other threads are still probing those slots
+  ConcurrentChurnTest<OpenAddressingHashTable<int, int>>(NUM_THREADS);
+  std::cout << "Correctness Test 4 passed\n";
+}
+
+void CorrectnessTest5() {
+  std::cout << "----------Correctness Test 5----------\n";
+  TableStats stats = StatsTest<OpenAddressingHashTable<int, int>>();
+  // The table started at 4 slots, so it must have grown
+  assert(!stats.enabled_ || stats.resizes_ > 0);
+  std::cout << "Correctness Test 5 passed\n";
+}
+
+void CorrectnessTest6() {
+  std::cout << "----------Correctness Test 6----------\n";
+  TransparentLookupTest<OpenAddressingHashTable<ShortString, int>>();
+  std::cout << "Correctness Test 6 passed\n";
+}
+
+void CorrectnessTest7() {
+  std::cout << "----------Correctness Test 7----------\n";
+  UpsertTest<OpenAddressingHashTable<int, int>>(NUM_THREADS);
+  std::cout << "Correctness Test 7 passed\n";
+}
+
+void CorrectnessTest8() {
+  std::cout << "----------Correctness Test 8----------\n";
+  TryGetFindTest<OpenAddressingHashTable<int, int>>();
+  std::cout << "Correctness Test 8 passed\n";
+}
+
+void CorrectnessTest9() {
+  std::cout << "----------Correctness Test 9----------\n";
+  EmplaceTest<OpenAddressingHashTable<int, Point>>();
+  std::cout << "Correctness Test 9 passed\n";
+}
+
+void ConcurrentGrowth(int id, OpenAddressingHashTable<int, int> &hash_table) {
+  // Shared counters are incremented while the table keeps migrating under
+  // them, so a write lost to a migration shows up in their sum
+  int stride = NUM_OPS / 10 / NUM_THREADS;
+  int start = id * stride;
+  for (int i = start; i < start + stride; ++i) {
+    hash_table.Insert(i, i);
+    hash_table.Compute(-1 - i % 64, [](int &count) { ++count; });
+    if (i % 2 == 1) {
+      hash_table.Delete(i);
+    }
+    assert(hash_table.Get(i - i % 2) == i - i % 2);
+  }
+}
+
+void CorrectnessTest10() {
+  std::cout << "----------Correctness Test 10----------\n";
+  OpenAddressingHashTable<int, int> hash_table(2, 0.5);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < NUM_THREADS; ++i) {
+    threads.push_back(std::thread(ConcurrentGrowth, i, std::ref(hash_table)));
+  }
+
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  int stride = NUM_OPS / 10 / NUM_THREADS;
+  int sum = 0;
+  for (int key = -64; key < 0; ++key) {
+    sum += hash_table.Get(key);
+  }
+  assert(sum == stride * NUM_THREADS);
+  for (int i = 0; i < stride * NUM_THREADS; ++i) {
+    assert(hash_table.Contains(i) == (i % 2 == 0));
+  }
+  assert(hash_table.size() ==
+         static_cast<size_t>(64 + (stride * NUM_THREADS + 1) / 2));
+  std::cout << "Correctness Test 10 passed\n";
+}
+
+int main(int argc, char **argv) {
+  // CorrectnessTest1();
+  // CorrectnessTest2();
+  // CorrectnessTest3();
+  // CorrectnessTest4();
+  // CorrectnessTest5();
+  // CorrectnessTest6();
+  // CorrectnessTest7();
+  // CorrectnessTest8();
+  // CorrectnessTest9();
+  // CorrectnessTest10();
+
+  if (argc > 1) {
+    NUM_THREADS = atoi(argv[1]);
+  }
+  std::vector<std::pair<int, int>> data;
+  GenerateKeyValue(data);
+  Benchmark<OpenAddressingHashTable<int, int>>("open-addressing hash table",
+                                               NUM_THREADS, 80, 10, 10, data);
+
+  return 0;
+}
\ No newline at end of file
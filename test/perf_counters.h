@@ -0,0 +1,180 @@
+#ifndef PERF_COUNTERS_H_
+#define PERF_COUNTERS_H_
+
+
+#include <cstdint>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/**
+ * Hardware performance counters of the calling thread, read through Linux
+ * perf_event_open.
+ *
+ * Each event is opened on its own, so the events the machine or container
+ * does not allow (perf_event_paranoid, no PMU in a VM, seccomp) are simply
+ * marked unavailable while the others still count. Only user-space events
+ * are counted. If the kernel multiplexes the events, the counts are scaled
+ * by the fraction of time each one was actually counting.
+ */
+class PerfCounters {
+ public:
+  enum Event {
+    INSTRUCTIONS,
+    CYCLES,
+    L1D_MISSES,     // L1 data cache read misses
+    LLC_MISSES,     // last-level cache misses
+    BRANCH_MISSES,
+    NUM_EVENTS,
+  };
+
+  /**
+   * Opens the counters of the calling thread, stopped
+   */
+  PerfCounters() {
+    for (int event = 0; event < NUM_EVENTS; ++event) {
+      fds_[event] = Open(static_cast<Event>(event));
+    }
+  }
+
+  /**
+   * Disallows copy
+   */
+  PerfCounters(const PerfCounters &other) = delete;
+  PerfCounters &operator=(const PerfCounters &other) = delete;
+
+  ~PerfCounters() {
+#ifdef __linux__
+    for (int fd : fds_) {
+      if (fd >= 0) {
+        close(fd);
+      }
+    }
+#endif
+  }
+
+  static const char *Name(Event event) {
+    static const char *const NAMES[] = {"instructions", "cycles",
+                                        "l1d_misses", "llc_misses",
+                                        "branch_misses"};
+    return NAMES[event];
+  }
+
+  /**
+   * Resets the counters and starts counting
+   */
+  void Start() {
+#ifdef __linux__
+    for (int fd : fds_) {
+      if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+      }
+    }
+#endif
+  }
+
+  /**
+   * Stops counting
+   */
+  void Stop() {
+#ifdef __linux__
+    for (int fd : fds_) {
+      if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+      }
+    }
+#endif
+  }
+
+  /**
+   * Reads a counter, once stopped
+   * @param event the event to read
+   * @param[out] value the number of events counted between Start and Stop
+   * @return false if the event is unavailable; otherwise, true
+   */
+  bool Read(Event event, uint64_t *value) const {
+#ifdef __linux__
+    if (fds_[event] < 0) {
+      return false;
+    }
+    // Laid out as requested by read_format in Open
+    uint64_t data[3];
+    if (read(fds_[event], data, sizeof(data)) != sizeof(data)) {
+      return false;
+    }
+    uint64_t count = data[0], enabled = data[1], running = data[2];
+    if (running == 0) {
+      *value = 0;
+    } else if (running < enabled) {
+      *value = static_cast<uint64_t>(static_cast<double>(count) * enabled /
+                                     running);
+    } else {
+      *value = count;
+    }
+    return true;
+#else
+    (void)event;
+    (void)value;
+    return false;
+#endif
+  }
+
+ private:
+  /**
+   * Opens one counter of the calling thread
+   * @return the file descriptor of the counter, or -1 if unavailable
+   */
+  static int Open(Event event) {
+#ifdef __linux__
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format =
+        PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    switch (event) {
+      case INSTRUCTIONS:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+        break;
+      case CYCLES:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CPU_CYCLES;
+        break;
+      case L1D_MISSES:
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_L1D |
+                      (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        break;
+      case LLC_MISSES:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        break;
+      case BRANCH_MISSES:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+        break;
+      default:
+        return -1;
+    }
+    // This thread, any CPU, no group
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+#else
+    (void)event;
+    return -1;
+#endif
+  }
+
+  int fds_[NUM_EVENTS];
+};
+
+#endif  // PERF_COUNTERS_H_
@@ -0,0 +1,76 @@
+#ifndef SHORT_STRING_H_
+#define SHORT_STRING_H_
+
+#include <cassert>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <string_view>
+
+#include "key_traits.h"
+
+/**
+ * Fixed-size string key that the flat tables can store inline. Its hash and
+ * equality are transparent, so it can be looked up by a std::string_view
+ */
+struct ShortString {
+  char data_[16];
+
+  std::string_view View() const {
+    return std::string_view(data_, strnlen(data_, sizeof(data_)));
+  }
+};
+
+inline ShortString MakeShortString(std::string_view str) {
+  ShortString key{};
+  str.copy(key.data_, sizeof(key.data_));
+  return key;
+}
+
+template <>
+struct KeyHash<ShortString> {
+  using is_transparent = void;
+
+  size_t operator()(std::string_view key) const {
+    return std::hash<std::string_view>{}(key);
+  }
+  size_t operator()(const ShortString &key) const {
+    return (*this)(key.View());
+  }
+};
+
+template <>
+struct KeyEqual<ShortString> {
+  using is_transparent = void;
+
+  bool operator()(const ShortString &lhs, std::string_view rhs) const {
+    return lhs.View() == rhs;
+  }
+  bool operator()(const ShortString &lhs, const ShortString &rhs) const {
+    return lhs.View() == rhs.View();
+  }
+};
+
+/**
+ * Checks that a flat table keyed by ShortString can be looked up, and
+ * deleted from, by a std::string_view
+ */
+template <typename Table>
+void TransparentLookupTest() {
+  Table hash_table(4, 0.75);
+  for (int i = 0; i < 100; ++i) {
+    std::string key = "key" + std::to_string(i);
+    hash_table.Insert(MakeShortString(key), i);
+  }
+  // Lookups by std::string_view go through the transparent hash and equality
+  for (int i = 0; i < 100; i += 2) {
+    std::string key = "key" + std::to_string(i);
+    hash_table.Delete(std::string_view(key));
+  }
+  assert(hash_table.Get(std::string_view("key1")) == 1);
+  assert(hash_table.Contains("key99"));
+  assert(!hash_table.Contains(std::string_view("key42")));
+  assert(hash_table.Get(MakeShortString("key7")) == 7);
+}
+
+#endif  // SHORT_STRING_H_
@@ -0,0 +1,30 @@
+#ifndef STATS_TEST_H_
+#define STATS_TEST_H_
+
+#include <cassert>
+
+#include "table_stats.h"
+
+/**
+ * Checks the statistics every table reports after 1000 inserts and 500
+ * deletes, starting from 4 slots
+ * @return the statistics, for the caller to check the engine-specific fields
+ */
+template <typename Table>
+TableStats StatsTest() {
+  Table hash_table(4, 0.75);
+  for (int i = 0; i < 1000; ++i) {
+    hash_table.Insert(i, i);
+  }
+  for (int i = 0; i < 1000; i += 2) {
+    hash_table.Delete(i);
+  }
+  TableStats stats = hash_table.Stats();
+  assert(stats.size_ == 500);
+  assert(stats.capacity_ >= 500);
+  // The event counters are only collected when built with TABLE_STATS
+  assert(stats.enabled_ == StatsCounters::ENABLED);
+  return stats;
+}
+
+#endif  // STATS_TEST_H_
@@ -0,0 +1,100 @@
+
+#include "swiss_hash_table.h"
+
+#include <cassert>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+#include "counted_value.h"
+#include "find_test.h"
+#include "flat_table_test.h"
+#include "short_string.h"
+#include "stats_test.h"
+#include "upsert_test.h"
+
+static int NUM_THREADS = 4;
+
+/**
+ * Correctness Test for the Swiss hash table
+ */
+void CorrectnessTest1() {
+  std::cout << "----------Correctness Test 1----------\n";
+  BasicTest<SwissHashTable<int, int>>();
+  std::cout << "Correctness Test 1 passed\n";
+}
+
+void CorrectnessTest2() {
+  std::cout << "----------Correctness Test 2----------\n";
+  GrowthTest<SwissHashTable<int, int>>();
+  std::cout << "Correctness Test 2 passed\n";
+}
+
+void CorrectnessTest3() {
+  std::cout << "----------Correctness Test 3----------\n";
+  ConcurrentSearchInsertDeleteTest<SwissHashTable<int, int>>(NUM_THREADS);
+  std::cout << "Correctness Test 3 passed\n";
+}
+
+void CorrectnessTest4() {
+  std::cout << "----------Correctness Test 4----------\n";
+  // All threads insert and delete the same small set of keys, so that their
+  // control bytes flip between fingerprints and DELETED, and writers contend
+  // for the same group locks, while readers are still probing those groups
+  ConcurrentChurnTest<SwissHashTable<int, int>>(NUM_THREADS);
+  std::cout << "Correctness Test 4 passed\n";
+}
+
+void CorrectnessTest5() {
+  std::cout << "----------Correctness Test 5----------\n";
+  TableStats stats = StatsTest<SwissHashTable<int, int>>();
+  // The table started at 4 slots, so it must have grown
+  assert(!stats.enabled_ || stats.resizes_ > 0);
+  std::cout << "Correctness Test 5 passed\n";
+}
+
+void CorrectnessTest6() {
+  std::cout << "----------Correctness Test 6----------\n";
+  TransparentLookupTest<SwissHashTable<ShortString, int>>();
+  std::cout << "Correctness Test 6 passed\n";
+}
+
+void CorrectnessTest7() {
+  std::cout << "----------Correctness Test 7----------\n";
+  UpsertTest<SwissHashTable<int, int>>(NUM_THREADS);
+  std::cout << "Correctness Test 7 passed\n";
+}
+
+void CorrectnessTest8() {
+  std::cout << "----------Correctness Test 8----------\n";
+  TryGetFindTest<SwissHashTable<int, int>>();
+  std::cout << "Correctness Test 8 passed\n";
+}
+
+void CorrectnessTest9() {
+  std::cout << "----------Correctness Test 9----------\n";
+  EmplaceTest<SwissHashTable<int, Point>>();
+  std::cout << "Correctness Test 9 passed\n";
+}
+
+int main(int argc, char **argv) {
+  // CorrectnessTest1();
+  // CorrectnessTest2();
+  // CorrectnessTest3();
+  // CorrectnessTest4();
+  // CorrectnessTest5();
+  // CorrectnessTest6();
+  // CorrectnessTest7();
+  // CorrectnessTest8();
+  // CorrectnessTest9();
+
+  if (argc > 1) {
+    NUM_THREADS = atoi(argv[1]);
+  }
+  std::vector<std::pair<int, int>> data;
+  GenerateKeyValue(data);
+  Benchmark<SwissHashTable<int, int>>("Swiss hash table", NUM_THREADS,
+                                      80, 10, 10, data);
+
+  return 0;
+}
\ No newline at end of file
@@ -0,0 +1,63 @@
+#ifndef UPSERT_TEST_H_
+#define UPSERT_TEST_H_
+
+#include <cassert>
+#include <thread>
+#include <vector>
+
+/**
+ * Checks the update operations every table has: InsertOrAssign, TryEmplace,
+ * Update and Compute, then that concurrent read-modify-writes of a few
+ * counters, while the table grows, lose no increment
+ * @param num_threads the number of threads incrementing the counters
+ * @param increment called as increment(hash_table, key, i) to add one to the
+ * counter `key` on the i-th step of a thread
+ */
+template <typename Table, typename Increment>
+void UpsertTest(int num_threads, Increment increment) {
+  Table hash_table(4, 0.75);
+  assert(hash_table.InsertOrAssign(1, 10));
+  assert(!hash_table.InsertOrAssign(1, 11));
+  assert(hash_table.Get(1) == 11);
+  int existing = 0;
+  assert(!hash_table.TryEmplace(1, 12, &existing));
+  assert(existing == 11 && hash_table.Get(1) == 11);
+  assert(hash_table.TryEmplace(2, 20));
+  assert(hash_table.Update(2, [](int &value) { value *= 2; }));
+  assert(hash_table.Get(2) == 40);
+  assert(!hash_table.Update(3, [](int &value) { value = 1; }));
+  assert(!hash_table.Contains(3));
+  assert(hash_table.Compute(3, [](int &value) { value += 5; }) == 5);
+
+  constexpr int NUM_INCREMENTS = 10000;
+  constexpr int NUM_COUNTERS = 64;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < num_threads; ++t) {
+    threads.emplace_back([&hash_table, &increment, t] {
+      for (int i = 0; i < NUM_INCREMENTS; ++i) {
+        increment(hash_table, 100 + (i + t) % NUM_COUNTERS, i);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  int total = 0;
+  for (int key = 100; key < 100 + NUM_COUNTERS; ++key) {
+    total += hash_table.Get(key);
+  }
+  assert(total == num_threads * NUM_INCREMENTS);
+}
+
+/**
+ * Runs UpsertTest with counters incremented by Compute
+ * @param num_threads the number of threads incrementing the counters
+ */
+template <typename Table>
+void UpsertTest(int num_threads) {
+  UpsertTest<Table>(num_threads, [](Table &hash_table, int key, int) {
+    hash_table.Compute(key, [](int &value) { ++value; });
+  });
+}
+
+#endif  // UPSERT_TEST_H_
@@ -0,0 +1,230 @@
+#ifndef WORKLOAD_H_
+#define WORKLOAD_H_
+
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <string>
+
+/**
+ * Small, fast pseudo-random generator (SplitMix64), one per thread so that
+ * drawing keys neither shares state nor takes a lock like rand()
+ */
+class Random {
+ public:
+  explicit Random(uint64_t seed) : state_(seed) {}
+
+  uint64_t Next() {
+    uint64_t z = (state_ += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+  }
+
+  /**
+   * Draws a number uniformly from [0, bound)
+   */
+  uint64_t Uniform(uint64_t bound) {
+    return static_cast<uint64_t>(
+        (static_cast<unsigned __int128>(Next()) * bound) >> 64);
+  }
+
+  /**
+   * Draws a number uniformly from [0, 1)
+   */
+  double UniformReal() { return (Next() >> 11) * 0x1.0p-53; }
+
+ private:
+  uint64_t state_;
+};
+
+/**
+ * Zipfian distribution over the ranks [0, n): rank 0 is the most popular,
+ * and the popularity of rank i is proportional to 1 / (i + 1)^theta. Uses the
+ * method of Gray et al. ("Quickly Generating Billion-Record Synthetic
+ * Databases"), like YCSB: the constructor takes O(n) time, drawing O(1).
+ * Immutable once built, so the threads of a run share one instance.
+ */
+class ZipfianGenerator {
+ public:
+  /**
+   * Creates a new ZipfianGenerator instance
+   * @param n the number of ranks
+   * @param theta the skew, in (0, 1); YCSB uses 0.99
+   */
+  ZipfianGenerator(uint64_t n, double theta) : n_(n) {
+    double zeta2 = Zeta(2, theta);
+    zetan_ = Zeta(n, theta);
+    alpha_ = 1.0 / (1.0 - theta);
+    eta_ = (1.0 - std::pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / zetan_);
+    half_pow_theta_ = 1.0 + std::pow(0.5, theta);
+  }
+
+  /**
+   * Draws a rank
+   * @param random the generator of the calling thread
+   * @return a rank in [0, n)
+   */
+  uint64_t Next(Random &random) const {
+    double u = random.UniformReal();
+    double uz = u * zetan_;
+    if (uz < 1.0) {
+      return 0;
+    }
+    if (uz < half_pow_theta_) {
+      return 1;
+    }
+    uint64_t rank = static_cast<uint64_t>(
+        n_ * std::pow(eta_ * u - eta_ + 1.0, alpha_));
+    return rank < n_ ? rank : n_ - 1;
+  }
+
+ private:
+  static double Zeta(uint64_t n, double theta) {
+    double sum = 0;
+    for (uint64_t i = 1; i <= n; ++i) {
+      sum += 1.0 / std::pow(static_cast<double>(i), theta);
+    }
+    return sum;
+  }
+
+  uint64_t n_;
+  double zetan_;
+  double alpha_;
+  double eta_;
+  double half_pow_theta_;  // 1 + 0.5^theta, the bound of rank 1
+};
+
+/**
+ * How the keys of a workload are picked, as a rank into the key range
+ */
+enum Distribution {
+  UNIFORM,     // every key equally likely
+  ZIPFIAN,     // a few hot keys, see ZipfianGenerator
+  HOTSPOT,     // a fraction of the keys gets a fraction of the operations
+  SEQUENTIAL,  // each thread walks its own slice of the key range in order
+  LATEST,      // Zipfian over recency: recently inserted keys are hottest
+};
+
+static const char *const DISTRIBUTION_NAMES[] = {"uniform", "zipfian",
+                                                 "hotspot", "sequential",
+                                                 "latest"};
+
+/**
+ * Parses the name of a distribution
+ * @param name the name given on the command line
+ * @param[out] distribution the distribution of that name
+ * @return true if the name is known; otherwise, false
+ */
+inline bool ParseDistribution(const std::string &name,
+                              Distribution *distribution) {
+  for (int i = 0; i <= LATEST; ++i) {
+    if (name == DISTRIBUTION_NAMES[i]) {
+      *distribution = static_cast<Distribution>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * Gets the name of a distribution
+ */
+inline const char *DistributionName(Distribution distribution) {
+  return DISTRIBUTION_NAMES[distribution];
+}
+
+/**
+ * Parameters of a key distribution shared by the threads of a run
+ */
+struct KeySpace {
+  Distribution distribution_{UNIFORM};
+  uint64_t key_range_{0};                     // number of distinct ranks
+  const ZipfianGenerator *zipfian_{nullptr};  // for ZIPFIAN and LATEST
+  double hot_fraction_{0.2};  // HOTSPOT: share of the ranks that is hot
+  double hot_ops_{0.8};       // HOTSPOT: share of the operations on it
+  // LATEST: number of ranks inserted so far; rank count - 1 is the newest
+  std::atomic<uint64_t> *num_inserted_{nullptr};
+};
+
+/**
+ * Per-thread source of ranks following a KeySpace. Ranks are mapped to keys
+ * by the caller, so that hot ranks need not be neighbouring keys
+ */
+class KeyChooser {
+ public:
+  /**
+   * Creates a new KeyChooser instance
+   * @param space the distribution to follow
+   * @param seed the seed of this thread's generator
+   * @param id the index of this thread
+   * @param num_threads the number of threads (SEQUENTIAL slices the range)
+   */
+  KeyChooser(const KeySpace &space, uint64_t seed, int id, int num_threads)
+      : space_(space),
+        random_(seed),
+        next_(space.key_range_ * id / num_threads) {}
+
+  Random &random() { return random_; }
+
+  /**
+   * Picks the rank of an existing key for a read, update or delete
+   * @return a rank in [0, key_range)
+   */
+  uint64_t Next() {
+    uint64_t n = space_.key_range_;
+    switch (space_.distribution_) {
+      case UNIFORM:
+        return random_.Uniform(n);
+      case ZIPFIAN:
+        return space_.zipfian_->Next(random_);
+      case HOTSPOT: {
+        uint64_t hot = static_cast<uint64_t>(n * space_.hot_fraction_);
+        hot = hot == 0 ? 1 : hot;
+        if (hot == n || random_.UniformReal() < space_.hot_ops_) {
+          return random_.Uniform(hot);
+        }
+        return hot + random_.Uniform(n - hot);
+      }
+      case SEQUENTIAL: {
+        uint64_t rank = next_++;
+        if (next_ == n) {
+          next_ = 0;
+        }
+        return rank;
+      }
+      case LATEST: {
+        uint64_t count =
+            space_.num_inserted_->load(std::memory_order_relaxed);
+        if (count == 0) {
+          return 0;
+        }
+        uint64_t newest = count - 1;
+        uint64_t age = space_.zipfian_->Next(random_) % count;
+        return (newest - age) % n;
+      }
+    }
+    return 0;
+  }
+
+  /**
+   * Picks the rank of a key to insert. LATEST appends a new rank (wrapping
+   * around the key range); the other distributions pick like Next
+   * @return a rank in [0, key_range)
+   */
+  uint64_t NextInsert() {
+    if (space_.distribution_ == LATEST) {
+      return space_.num_inserted_->fetch_add(1, std::memory_order_relaxed) %
+             space_.key_range_;
+    }
+    return Next();
+  }
+
+ private:
+  const KeySpace &space_;
+  Random random_;
+  uint64_t next_;  // SEQUENTIAL: next rank of this thread
+};
+
+#endif  // WORKLOAD_H_